@@ -0,0 +1,52 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "alloc_counter.h"
+
+#ifdef _DEBUG
+
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t my_thread_allocation_count = 0;
+
+uint64_t MyGetThreadAllocationCount()
+{
+	return my_thread_allocation_count;
+}
+
+void *operator new( std::size_t size )
+{
+	my_thread_allocation_count++;
+
+	void *ptr = std::malloc( size ? size : 1 );
+	if ( ptr == nullptr )
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void *operator new[]( std::size_t size )
+{
+	return operator new( size );
+}
+
+void operator delete( void *ptr ) noexcept
+{
+	std::free( ptr );
+}
+
+void operator delete[]( void *ptr ) noexcept
+{
+	std::free( ptr );
+}
+
+void operator delete( void *ptr, std::size_t ) noexcept
+{
+	std::free( ptr );
+}
+
+void operator delete[]( void *ptr, std::size_t ) noexcept
+{
+	std::free( ptr );
+}
+
+#endif
@@ -0,0 +1,12 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstdint>
+
+#ifdef _DEBUG
+
+// In debug builds we replace the global operator new, so we can check that code which shouldn't touch the heap
+// (like the pose pump's steady-state loop) really doesn't. Returns how many allocations the calling thread has made.
+uint64_t MyGetThreadAllocationCount();
+
+#endif
@@ -0,0 +1,266 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "body_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "rotation_math.h"
+#include "vrmath.h"
+
+static const char *const my_body_joint_names[ MyBodyJoint_MAX ] = {
+	"head",
+	"chest",
+	"waist",
+	"left_elbow",
+	"left_hand",
+	"right_elbow",
+	"right_hand",
+	"left_knee",
+	"left_foot",
+	"right_knee",
+	"right_foot",
+};
+
+// The joint each joint hangs off, if it's worn. Every parent comes before its children.
+static const MyBodyJoint my_body_joint_parents[ MyBodyJoint_MAX ] = {
+	MyBodyJoint_None,       // Head
+	MyBodyJoint_Head,       // Chest
+	MyBodyJoint_Chest,      // Waist
+	MyBodyJoint_Chest,      // LeftElbow
+	MyBodyJoint_LeftElbow,  // LeftHand
+	MyBodyJoint_Chest,      // RightElbow
+	MyBodyJoint_RightElbow, // RightHand
+	MyBodyJoint_Waist,      // LeftKnee
+	MyBodyJoint_LeftKnee,   // LeftFoot
+	MyBodyJoint_Waist,      // RightKnee
+	MyBodyJoint_RightKnee,  // RightFoot
+};
+
+// A joint not observed for this long has gone: its tracker was deactivated, or given another joint
+static const std::chrono::milliseconds my_body_joint_timeout( 500 );
+
+// How many times we need to have seen a segment before its range of lengths is worth holding lost joints to, and how
+// far outside that range we let them go, since the range is only what we've seen so far
+static const uint32_t my_min_segment_length_samples = 50;
+static const double my_segment_length_slack = 0.02; // m
+
+// Relaxation stops once no joint moves further than this in a pass, or after this many passes, whatever the budget
+static const double my_body_solve_tolerance = 0.0005; // m
+static const uint32_t my_max_body_solve_iterations = 32;
+
+const char *MyGetBodyJointName( MyBodyJoint joint )
+{
+	return joint < MyBodyJoint_MAX ? my_body_joint_names[ joint ] : "none";
+}
+
+MyBodyJoint MyParseBodyJoint( const char *name )
+{
+	for ( int joint = MyBodyJoint_Head + 1; joint < MyBodyJoint_MAX; joint++ )
+	{
+		if ( strcmp( name, my_body_joint_names[ joint ] ) == 0 )
+			return (MyBodyJoint)joint;
+	}
+
+	return MyBodyJoint_None;
+}
+
+MyBodyModel::MyBodyModel()
+{
+	for ( Joint &joint : joints_ )
+	{
+		joint.observed_time = std::chrono::steady_clock::time_point();
+		joint.is_tracked = false;
+		joint.position = {};
+		joint.rotation = { 1.0, 0.0, 0.0, 0.0 };
+		joint.has_pose = false;
+		joint.parent = MyBodyJoint_None;
+		joint.segment_parent = MyBodyJoint_None;
+		joint.min_length = 0.0;
+		joint.max_length = 0.0;
+		joint.num_length_samples = 0;
+		joint.has_offset = false;
+		joint.offset_position = {};
+		joint.offset_rotation = { 1.0, 0.0, 0.0, 0.0 };
+	}
+
+	last_solve_duration_ = std::chrono::nanoseconds::zero();
+	last_solve_iterations_ = 0;
+}
+
+void MyBodyModel::Observe( MyBodyJoint joint, const vr::HmdVector3d_t &position, const vr::HmdQuaternion_t &rotation, bool is_tracked,
+	std::chrono::steady_clock::time_point now )
+{
+	if ( joint >= MyBodyJoint_MAX )
+		return;
+
+	Joint &observed = joints_[ joint ];
+	observed.observed_time = now;
+	observed.is_tracked = is_tracked;
+
+	if ( is_tracked )
+	{
+		observed.position = position;
+		observed.rotation = rotation;
+	}
+}
+
+bool MyBodyModel::IsWorn( const Joint &joint, std::chrono::steady_clock::time_point now ) const
+{
+	return joint.observed_time != std::chrono::steady_clock::time_point() && now - joint.observed_time <= my_body_joint_timeout;
+}
+
+bool MyBodyModel::HasTrackerJoints( std::chrono::steady_clock::time_point now ) const
+{
+	for ( int joint = MyBodyJoint_Head + 1; joint < MyBodyJoint_MAX; joint++ )
+	{
+		if ( IsWorn( joints_[ joint ], now ) )
+			return true;
+	}
+
+	return false;
+}
+
+void MyBodyModel::Solve( std::chrono::steady_clock::time_point now, std::chrono::nanoseconds budget )
+{
+	// The budget is real time spent, whatever clock the pump is running on, which is why it can be turned off
+	const std::chrono::steady_clock::time_point solve_start = std::chrono::steady_clock::now();
+
+	// Parents first, so every joint's parent already has its pose for this Solve
+	for ( int index = 0; index < MyBodyJoint_MAX; index++ )
+	{
+		Joint &joint = joints_[ index ];
+		joint.parent = MyBodyJoint_None;
+		joint.has_pose = false;
+
+		if ( !IsWorn( joint, now ) )
+			continue;
+
+		for ( MyBodyJoint parent = my_body_joint_parents[ index ]; parent != MyBodyJoint_None; parent = my_body_joint_parents[ parent ] )
+		{
+			if ( IsWorn( joints_[ parent ], now ) )
+			{
+				joint.parent = parent;
+				break;
+			}
+		}
+
+		if ( joint.is_tracked )
+		{
+			joint.has_pose = true;
+
+			if ( joint.parent != MyBodyJoint_None && joints_[ joint.parent ].is_tracked )
+				LearnSegment( joint, joints_[ joint.parent ] );
+		}
+		else if ( joint.parent != MyBodyJoint_None && joints_[ joint.parent ].has_pose && joint.has_offset && joint.segment_parent == joint.parent )
+		{
+			// Carried along with our parent, the way we were last seen relative to it
+			const Joint &parent = joints_[ joint.parent ];
+			const vr::HmdVector3d_t offset = MyRotate( parent.rotation, joint.offset_position );
+
+			joint.position = { { parent.position.v[ 0 ] + offset.v[ 0 ], parent.position.v[ 1 ] + offset.v[ 1 ], parent.position.v[ 2 ] + offset.v[ 2 ] } };
+			joint.rotation = parent.rotation * joint.offset_rotation;
+			joint.has_pose = true;
+		}
+	}
+
+	last_solve_iterations_ = 0;
+	while ( last_solve_iterations_ < my_max_body_solve_iterations )
+	{
+		const double furthest = Relax();
+		last_solve_iterations_++;
+
+		if ( furthest < my_body_solve_tolerance )
+			break;
+
+		if ( budget > std::chrono::nanoseconds::zero() && std::chrono::steady_clock::now() - solve_start >= budget )
+			break;
+	}
+
+	last_solve_duration_ = std::chrono::steady_clock::now() - solve_start;
+}
+
+bool MyBodyModel::GetEstimate( MyBodyJoint joint, vr::HmdVector3d_t &position, vr::HmdQuaternion_t &rotation ) const
+{
+	if ( joint >= MyBodyJoint_MAX || joints_[ joint ].is_tracked || !joints_[ joint ].has_pose )
+		return false;
+
+	position = joints_[ joint ].position;
+	rotation = joints_[ joint ].rotation;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Learns the segment from joint to its parent, while both are tracked: how long it gets, and where joint
+// sits in its parent's frame.
+//-----------------------------------------------------------------------------
+void MyBodyModel::LearnSegment( Joint &joint, const Joint &parent )
+{
+	const vr::HmdVector3d_t delta = {
+		{ joint.position.v[ 0 ] - parent.position.v[ 0 ], joint.position.v[ 1 ] - parent.position.v[ 1 ], joint.position.v[ 2 ] - parent.position.v[ 2 ] }
+	};
+	const double length = std::sqrt( delta.v[ 0 ] * delta.v[ 0 ] + delta.v[ 1 ] * delta.v[ 1 ] + delta.v[ 2 ] * delta.v[ 2 ] );
+
+	if ( joint.segment_parent != joint.parent )
+	{
+		joint.segment_parent = joint.parent;
+		joint.min_length = length;
+		joint.max_length = length;
+		joint.num_length_samples = 0;
+	}
+
+	joint.min_length = std::min( joint.min_length, length );
+	joint.max_length = std::max( joint.max_length, length );
+	joint.num_length_samples++;
+
+	joint.offset_position = MyRotate( -parent.rotation, delta );
+	joint.offset_rotation = -parent.rotation * joint.rotation;
+	joint.has_offset = true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: One pass over every segment with a lost joint at either end, pulling or pushing the lost ends just far
+// enough to bring its length back within the range we've seen. Tracked joints never move. A segment with both ends
+// lost shares the move between them.
+//-----------------------------------------------------------------------------
+double MyBodyModel::Relax()
+{
+	double furthest = 0.0;
+
+	for ( int index = MyBodyJoint_Head + 1; index < MyBodyJoint_MAX; index++ )
+	{
+		Joint &joint = joints_[ index ];
+		if ( !joint.has_pose || joint.parent == MyBodyJoint_None || joint.segment_parent != joint.parent ||
+			 joint.num_length_samples < my_min_segment_length_samples )
+			continue;
+
+		Joint &parent = joints_[ joint.parent ];
+		if ( !parent.has_pose || ( joint.is_tracked && parent.is_tracked ) )
+			continue;
+
+		const double delta[ 3 ] = { joint.position.v[ 0 ] - parent.position.v[ 0 ], joint.position.v[ 1 ] - parent.position.v[ 1 ],
+			joint.position.v[ 2 ] - parent.position.v[ 2 ] };
+		const double length = std::sqrt( delta[ 0 ] * delta[ 0 ] + delta[ 1 ] * delta[ 1 ] + delta[ 2 ] * delta[ 2 ] );
+		if ( length <= 0.0 )
+			continue;
+
+		const double target_length = std::min( std::max( length, joint.min_length - my_segment_length_slack ), joint.max_length + my_segment_length_slack );
+		const double correction = length - target_length;
+		if ( correction == 0.0 )
+			continue;
+
+		const double joint_share = joint.is_tracked ? 0.0 : parent.is_tracked ? 1.0 : 0.5;
+		const double parent_share = 1.0 - joint_share;
+
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			const double move = delta[ axis ] / length * correction;
+			joint.position.v[ axis ] -= move * joint_share;
+			parent.position.v[ axis ] += move * parent_share;
+		}
+
+		furthest = std::max( furthest, std::fabs( correction ) * std::max( joint_share, parent_share ) );
+	}
+
+	return furthest;
+}
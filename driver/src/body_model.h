@@ -0,0 +1,106 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "openvr_driver.h"
+
+// The points a full rig can track, parents before children: the HMD, and a tracker on each of the rest
+enum MyBodyJoint : uint8_t
+{
+	MyBodyJoint_Head,
+	MyBodyJoint_Chest,
+	MyBodyJoint_Waist,
+	MyBodyJoint_LeftElbow,
+	MyBodyJoint_LeftHand,
+	MyBodyJoint_RightElbow,
+	MyBodyJoint_RightHand,
+	MyBodyJoint_LeftKnee,
+	MyBodyJoint_LeftFoot,
+	MyBodyJoint_RightKnee,
+	MyBodyJoint_RightFoot,
+
+	MyBodyJoint_MAX,
+	MyBodyJoint_None = MyBodyJoint_MAX
+};
+
+// Names for joints, as they appear in settings and commands, e.g. "left_foot"
+const char *MyGetBodyJointName( MyBodyJoint joint );
+
+// The joint a tracker can be given by name, or MyBodyJoint_None if there's no such joint. The head is the HMD's, so
+// no tracker can take it.
+MyBodyJoint MyParseBodyJoint( const char *name );
+
+//-----------------------------------------------------------------------------
+// Purpose: A simple model of the body the trackers are worn on, for working out where a lost tracker must be from
+// the ones we can still see. Each joint hangs off the nearest joint above it that's being worn, by a segment whose
+// length is learned from live data: the range of distances seen between the two while both were tracked. That's a
+// range rather than a length, since a segment that skips a joint, like waist to foot without a knee tracker, bends.
+// A lost joint starts out carried along rigidly with the joint above it, from where it last was relative to it, then
+// the segment lengths are relaxed into place around the joints we can see.
+// Only ever touched from the pose pump.
+//-----------------------------------------------------------------------------
+class MyBodyModel
+{
+public:
+	MyBodyModel();
+
+	// Where a joint's device is as of now, and whether it's being tracked there. A joint that isn't tracked keeps
+	// whatever we estimated for it. Joints not observed for a while are taken to have gone, and drop out of the model.
+	void Observe( MyBodyJoint joint, const vr::HmdVector3d_t &position, const vr::HmdQuaternion_t &rotation, bool is_tracked,
+		std::chrono::steady_clock::time_point now );
+
+	// Whether any tracker is wearing a joint, so the model is worth solving. The head alone doesn't count.
+	bool HasTrackerJoints( std::chrono::steady_clock::time_point now ) const;
+
+	// Learns segment lengths from the joints that are tracked, and estimates the ones that aren't. Refining the
+	// estimate stops once it's converged, or budget has gone by on the steady clock, whichever comes first. A zero
+	// budget has no time limit, so the estimate only depends on what was observed, not on how fast we got through it.
+	void Solve( std::chrono::steady_clock::time_point now, std::chrono::nanoseconds budget );
+
+	// Where we think a joint that isn't tracked is, as of the last Solve. False if we can't say.
+	bool GetEstimate( MyBodyJoint joint, vr::HmdVector3d_t &position, vr::HmdQuaternion_t &rotation ) const;
+
+	// How long the last Solve took, and how many relaxation passes it got through
+	std::chrono::nanoseconds GetLastSolveDuration() const { return last_solve_duration_; }
+	uint32_t GetLastSolveIterations() const { return last_solve_iterations_; }
+
+private:
+	struct Joint
+	{
+		std::chrono::steady_clock::time_point observed_time;
+		bool is_tracked;
+
+		// Tracked, or estimated while we're not, and whether that's any good this Solve
+		vr::HmdVector3d_t position;
+		vr::HmdQuaternion_t rotation;
+		bool has_pose;
+
+		// The worn joint this one hangs off this Solve, or MyBodyJoint_None
+		MyBodyJoint parent;
+
+		// The segment to parent: the range of lengths seen, and how many times. Relearned whenever parent changes.
+		MyBodyJoint segment_parent;
+		double min_length;
+		double max_length;
+		uint32_t num_length_samples;
+
+		// Where we were relative to segment_parent, in its frame, as of when both were last tracked
+		bool has_offset;
+		vr::HmdVector3d_t offset_position;
+		vr::HmdQuaternion_t offset_rotation;
+	};
+
+	bool IsWorn( const Joint &joint, std::chrono::steady_clock::time_point now ) const;
+	void LearnSegment( Joint &joint, const Joint &parent );
+
+	// Moves lost joints to bring every segment back within its range. Returns the furthest any joint moved.
+	double Relax();
+
+	std::array< Joint, MyBodyJoint_MAX > joints_;
+
+	std::chrono::nanoseconds last_solve_duration_;
+	uint32_t last_solve_iterations_;
+};
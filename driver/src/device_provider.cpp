@@ -13,6 +13,11 @@ vr::EVRInitError MyDeviceProvider::Init( vr::IVRDriverContext *pDriverContext )
 	// OpenVR provides a macro to do this for us.
 	VR_INIT_SERVER_DRIVER_CONTEXT( pDriverContext );
 
+	// From here on, logging is handed off to a background thread
+	DriverLogInit();
+
+	device_index_table_.fill( nullptr );
+
 	const unsigned int number_of_trackers = 2;
 		// Let's get the number of trackers to create from settings
 	const char* settings_section = "PoseLockDriver";
@@ -26,14 +31,118 @@ vr::EVRInitError MyDeviceProvider::Init( vr::IVRDriverContext *pDriverContext )
 		num_trackers = 0;
 	}
 
+	// Every tracker needs a slot in the pump's state table
+	if (num_trackers > (int32_t)MyTrackerStateTable::k_unMaxSlots)
+	{
+		num_trackers = (int32_t)MyTrackerStateTable::k_unMaxSlots;
+	}
+
 	DriverLog("PoseLockDriver: Found setting to create %d virtual trackers.", num_trackers);
 
+	// Optionally, time pose submissions to land just before each compositor frame
+	eError = vr::VRSettingsError_None;
+	const bool phase_lock_enabled = vr::VRSettings()->GetBool(settings_section, "phase_lock_enabled", &eError);
+	if (eError == vr::VRSettingsError_None && phase_lock_enabled)
+	{
+		eError = vr::VRSettingsError_None;
+		float lead_time_ms = vr::VRSettings()->GetFloat(settings_section, "phase_lock_lead_ms", &eError);
+		if (eError != vr::VRSettingsError_None || lead_time_ms < 0.f)
+		{
+			lead_time_ms = 2.f;
+		}
+
+		DriverLog("PoseLockDriver: Phase-locking pose submission %.2f ms ahead of compositor frames.", lead_time_ms);
+		pose_pump_.EnablePhaseLock(std::chrono::microseconds((int64_t)(lead_time_ms * 1000.f)));
+	}
+
+	// Optionally, run the pump on simulated time that moves on one fixed step each RunFrame, rather than the steady
+	// clock. For test hosts: a run that's fed the same inputs then submits exactly the same poses, as fast as the host
+	// can call RunFrame. tools/pose_determinism checks that it does.
+	eError = vr::VRSettingsError_None;
+	const float simulated_clock_step_ms = vr::VRSettings()->GetFloat(settings_section, "simulated_clock_step_ms", &eError);
+	if (eError == vr::VRSettingsError_None && simulated_clock_step_ms > 0.f)
+	{
+		DriverLog("PoseLockDriver: Running on a simulated clock, %.3f ms per frame.", simulated_clock_step_ms);
+		pose_pump_.EnableSimulatedClock(std::chrono::microseconds((int64_t)(simulated_clock_step_ms * 1000.f)));
+	}
+
+	// Stop doing pose work when nobody's had the headset on for a while, unless a tracker is proxying another device.
+	// Defaults to 10 seconds, 0 turns it off.
+	eError = vr::VRSettingsError_None;
+	float park_after_hmd_idle_s = vr::VRSettings()->GetFloat(settings_section, "park_after_hmd_idle_s", &eError);
+	if (eError != vr::VRSettingsError_None || park_after_hmd_idle_s < 0.f)
+	{
+		park_after_hmd_idle_s = 10.f;
+	}
+	pose_pump_.SetHmdIdleParkTime(std::chrono::milliseconds((int64_t)(park_after_hmd_idle_s * 1000.f)));
+
+	// Publish live tracker state to shared memory for external monitors, unless turned off
+	eError = vr::VRSettingsError_None;
+	const bool telemetry_enabled = vr::VRSettings()->GetBool(settings_section, "telemetry_enabled", &eError);
+	if (eError != vr::VRSettingsError_None || telemetry_enabled)
+	{
+		pose_pump_.GetTelemetry().Open();
+	}
+
+	// Optionally, play back a recorded session through any trackers it has a track for
+	char replay_trace_path[1024] = {};
+	vr::VRSettings()->GetString(settings_section, "replay_trace_path", replay_trace_path, sizeof(replay_trace_path));
+	if (replay_trace_path[0] != 0)
+	{
+		eError = vr::VRSettingsError_None;
+		float replay_speed = vr::VRSettings()->GetFloat(settings_section, "replay_speed", &eError);
+		if (eError != vr::VRSettingsError_None || replay_speed <= 0.f)
+		{
+			replay_speed = 1.f;
+		}
+
+		eError = vr::VRSettingsError_None;
+		bool replay_loop = vr::VRSettings()->GetBool(settings_section, "replay_loop", &eError);
+		if (eError != vr::VRSettingsError_None)
+		{
+			replay_loop = false;
+		}
+
+		pose_pump_.GetReplay().Open(replay_trace_path, replay_speed, replay_loop, pose_pump_.GetClock().Now());
+	}
+
+	// Start the pump before adding trackers, so they're serviced as soon as they activate.
+	pose_pump_.Start();
+
 	// Create the specified number of trackers
 	for (int i = 0; i < num_trackers; i++)
 	{
 		// The tracker ID will start from 10, so we add 10 to the loop index
-		my_tracker_devices_.push_back(std::make_unique<MyTrackerDeviceDriver>(10 + i));
-		vr::VRServerDriverHost()->TrackedDeviceAdded(my_tracker_devices_.back()->MyGetSerialNumber().c_str(), vr::TrackedDeviceClass_GenericTracker, my_tracker_devices_.back().get());
+		my_tracker_devices_.push_back(std::make_unique<MyTrackerDeviceDriver>(10 + i, pose_pump_, device_index_table_));
+	}
+
+	// Optionally, record every pose our trackers read and submit, for tuning the lock logic offline
+	char record_poses_path[1024] = {};
+	vr::VRSettings()->GetString(settings_section, "record_poses_path", record_poses_path, sizeof(record_poses_path));
+	if (record_poses_path[0] != 0)
+	{
+		std::array<const char*, MyTrackerStateTable::k_unMaxSlots> serial_numbers{};
+		for (const auto& tracker : my_tracker_devices_)
+		{
+			if (tracker->MyGetStateSlot() < MyTrackerStateTable::k_unMaxSlots)
+				serial_numbers[tracker->MyGetStateSlot()] = tracker->MyGetSerialNumber().c_str();
+		}
+
+		// Positions are quantized to this resolution in a compressed trace. Zero, the default, records raw poses.
+		eError = vr::VRSettingsError_None;
+		const float record_resolution_mm = vr::VRSettings()->GetFloat(settings_section, "record_poses_resolution_mm", &eError);
+		if (eError == vr::VRSettingsError_None && record_resolution_mm > 0.f)
+		{
+			pose_pump_.GetRecorder().EnableCompression(record_resolution_mm * 0.001);
+		}
+
+		pose_pump_.GetRecorder().Start(record_poses_path, serial_numbers, pose_pump_.GetClock().Now());
+	}
+
+	// Only now hand the trackers to vrserver, so a recording has them from their first pose
+	for (const auto& tracker : my_tracker_devices_)
+	{
+		vr::VRServerDriverHost()->TrackedDeviceAdded(tracker->MyGetSerialNumber().c_str(), vr::TrackedDeviceClass_GenericTracker, tracker.get());
 	}
 
 	return vr::VRInitError_None;
@@ -63,6 +172,12 @@ bool MyDeviceProvider::ShouldBlockStandbyMode()
 //-----------------------------------------------------------------------------
 void MyDeviceProvider::RunFrame()
 {
+	// On simulated time, each frame is one step of the clock, and the pump's done with it before we carry on
+	if ( pose_pump_.GetClock().IsSimulated() )
+	{
+		pose_pump_.StepSimulatedClock();
+	}
+
 	// call our devices to run a frame
 	for ( const auto &tracker : my_tracker_devices_ )
 	{
@@ -70,22 +185,70 @@ void MyDeviceProvider::RunFrame()
 	}
 
 	// Now, process events that were submitted for this frame.
+	// Events for the whole driver are handled once, here. The rest go straight to the tracker they're for, if it's ours.
 	vr::VREvent_t vrevent{};
 	while ( vr::VRServerDriverHost()->PollNextEvent( &vrevent, sizeof( vr::VREvent_t ) ) )
 	{
-		for ( const auto &tracker : my_tracker_devices_ )
+		if ( MyProcessEvent( vrevent ) )
+			continue;
+
+		MyTrackerDeviceDriver *tracker = vrevent.trackedDeviceIndex < vr::k_unMaxTrackedDeviceCount
+											 ? device_index_table_[ vrevent.trackedDeviceIndex ]
+											 : nullptr;
+
+		if ( tracker != nullptr )
 		{
 			tracker->MyProcessEvent( vrevent );
 		}
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Handles events for the whole driver, rather than any one of our trackers. They're checked for before
+// events are routed by device index, since their device index can be anything, including one of our trackers'.
+// It's not part of the IServerTrackedDeviceProvider interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+bool MyDeviceProvider::MyProcessEvent( const vr::VREvent_t &vrevent )
+{
+	switch ( vrevent.eventType )
+	{
+		case vr::VREvent_EnterStandbyMode:
+		{
+			pose_pump_.SetStandby( true );
+			return true;
+		}
+
+		case vr::VREvent_LeaveStandbyMode:
+		{
+			pose_pump_.SetStandby( false );
+			return true;
+		}
+
+		// Our settings live in their own sections, which the UI edits while we're running
+		case vr::VREvent_OtherSectionSettingChanged:
+		case vr::VREvent_AnyDriverSettingsChanged:
+		{
+			for ( const auto &tracker : my_tracker_devices_ )
+			{
+				tracker->MyReloadSettings();
+			}
+			return true;
+		}
+
+		default:
+			return false;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: This function is called when the system enters a period of inactivity.
 // The devices might want to turn off their displays or go into a low power mode to preserve them.
 //-----------------------------------------------------------------------------
 void MyDeviceProvider::EnterStandby()
 {
+	// Our trackers follow the HMD, so there's nothing to update until we're woken up again.
+	DriverLog("PoseLockDriver: Entering standby, parking pose updates.");
+	pose_pump_.SetStandby(true);
 }
 
 //-----------------------------------------------------------------------------
@@ -94,6 +257,8 @@ void MyDeviceProvider::EnterStandby()
 //-----------------------------------------------------------------------------
 void MyDeviceProvider::LeaveStandby()
 {
+	DriverLog("PoseLockDriver: Leaving standby, resuming pose updates.");
+	pose_pump_.SetStandby(false);
 }
 
 //-----------------------------------------------------------------------------
@@ -103,9 +268,21 @@ void MyDeviceProvider::LeaveStandby()
 //-----------------------------------------------------------------------------
 void MyDeviceProvider::Cleanup()
 {
-	// Our tracker devices will have already deactivated. Let's now destroy them.
-	for ( auto &tracker : my_tracker_devices_ )
-	{
-		tracker = nullptr;
-	}
-}
\ No newline at end of file
+	// Our tracker devices will have already deactivated, so the pump has nothing left to do.
+	// Stopping it wakes it from whatever it's waiting on, so this returns as soon as the pump thread exits.
+	pose_pump_.Stop();
+
+	// Nothing more is going to be recorded, so finish off the trace
+	pose_pump_.GetRecorder().Stop();
+
+	// Let's now destroy them, all in one go.
+	device_index_table_.fill( nullptr );
+	my_tracker_devices_.clear();
+
+	// Nobody's publishing any more, so take the telemetry segment down, and we're done playing back
+	pose_pump_.GetTelemetry().Close();
+	pose_pump_.GetReplay().Close();
+
+	// Make sure everything we've logged reaches vrserver while it can still take it
+	DriverLogShutdown();
+}
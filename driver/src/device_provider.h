@@ -1,9 +1,12 @@
 //============ Copyright (c) Valve Corporation, All rights reserved. ============
 #pragma once
 
+#include <array>
 #include <memory>
+#include <vector>
 
 #include "openvr_driver.h"
+#include "pose_pump.h"
 #include "tracker_device_driver.h"
 
 // make sure your class is publicly inheriting vr::IServerTrackedDeviceProvider!
@@ -22,5 +25,16 @@ public:
 	void Cleanup() override;
 
 private:
+	// Handles events that are for the whole driver, whatever device index they carry: standby and settings changes.
+	// Returns false for anything else.
+	bool MyProcessEvent( const vr::VREvent_t &vrevent );
+
+	// Updates the poses of all our trackers from one thread. Declared before the trackers so it outlives them.
+	MyPosePump pose_pump_;
+
 	std::vector< std::unique_ptr< MyTrackerDeviceDriver > > my_tracker_devices_;
+
+	// Maps a device index to the tracker that owns it, so each event is handed straight to its device.
+	// Trackers keep their own entries up to date as they activate and deactivate.
+	MyDeviceIndexTable device_index_table_;
 };
\ No newline at end of file
@@ -1,41 +1,458 @@
 //============ Copyright (c) Valve Corporation, All rights reserved. ============
 #include "driverlog.h"
 
-#include <stdarg.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
 #include <stdio.h>
+#include <string.h>
+#include <thread>
 
-#if !defined( WIN32 )
-#define vsnprintf_s vsnprintf
-#endif
+// Number of messages the ring can hold before we start dropping them. Must be a power of two.
+static const size_t my_log_ring_size = 1024;
 
-static void DriverLogVarArgs( const char *pMsgFormat, va_list args )
+// Each call site may log this many messages per window before it's suppressed until the next window
+static const uint32_t my_max_messages_per_call_site = 16;
+static const std::chrono::milliseconds my_call_site_window( 1000 );
+
+// Call sites we can keep track of for rate limiting. Must be a power of two.
+static const size_t my_max_call_sites = 256;
+static const size_t my_max_call_site_probes = 8;
+
+// A slot in the ring. The record comes first, so we can get back to the slot from the record we handed out.
+struct DriverLogCell
+{
+	DriverLogRecord record;
+	size_t position;
+	std::atomic< size_t > sequence;
+};
+static_assert( offsetof( DriverLogCell, record ) == 0, "DriverLogCell's record must be its first member" );
+
+struct DriverLogCallSite
+{
+	std::atomic< const char * > format;
+	std::atomic< int64_t > window_start_ms;
+	std::atomic< uint32_t > count_in_window;
+	std::atomic< uint32_t > suppressed_count;
+};
+
+// A bounded multi-producer queue: producers claim a cell by advancing my_log_enqueue_position, and each cell's sequence
+// number tells the log thread (the only consumer) when the producer has finished filling it in.
+static DriverLogCell my_log_ring[ my_log_ring_size ];
+static std::atomic< size_t > my_log_enqueue_position( 0 );
+static size_t my_log_dequeue_position = 0;
+static std::atomic< uint32_t > my_num_dropped_log_messages( 0 );
+static bool my_is_log_ring_initialised = false;
+
+static DriverLogCallSite my_log_call_sites[ my_max_call_sites ];
+
+static std::atomic< bool > my_is_log_thread_running( false );
+static std::thread my_log_thread;
+
+// The log thread sleeps on these while the ring's empty. It sets my_is_log_thread_parked first, so producers only take
+// the lock to wake it when it's really asleep, and never while it's busy.
+static std::mutex my_log_thread_wake_mutex;
+static std::condition_variable my_log_thread_wake_condition;
+static std::atomic< bool > my_is_log_thread_parked( false );
+
+// Used instead of the ring while the log thread isn't running
+static thread_local DriverLogRecord my_sync_log_record;
+
+static int64_t DriverLogNowMs()
+{
+	return std::chrono::duration_cast< std::chrono::milliseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static DriverLogCallSite *DriverLogFindCallSite( const char *pchFormat )
+{
+	size_t index = ( reinterpret_cast< uintptr_t >( pchFormat ) >> 3 ) & ( my_max_call_sites - 1 );
+
+	for ( size_t probe = 0; probe < my_max_call_site_probes; probe++, index = ( index + 1 ) & ( my_max_call_sites - 1 ) )
+	{
+		DriverLogCallSite &site = my_log_call_sites[ index ];
+
+		const char *site_format = site.format.load( std::memory_order_acquire );
+		if ( site_format == pchFormat )
+			return &site;
+
+		if ( site_format == nullptr && site.format.compare_exchange_strong( site_format, pchFormat ) )
+			return &site;
+
+		// Someone else may have just claimed this slot for the same call site
+		if ( site_format == pchFormat )
+			return &site;
+	}
+
+	// Too many call sites hash here, so this one goes without rate limiting
+	return nullptr;
+}
+
+// Returns whether this call site may log now. Fills out how many of its messages were suppressed since it last could.
+static bool DriverLogAllowCallSite( const char *pchFormat, uint32_t *punSuppressedCount )
+{
+	*punSuppressedCount = 0;
+
+	DriverLogCallSite *site = DriverLogFindCallSite( pchFormat );
+	if ( site == nullptr )
+		return true;
+
+	const int64_t now_ms = DriverLogNowMs();
+	int64_t window_start_ms = site->window_start_ms.load( std::memory_order_relaxed );
+	if ( now_ms - window_start_ms >= my_call_site_window.count() )
+	{
+		// Whoever wins this starts the new window. Losing just means someone else already did.
+		if ( site->window_start_ms.compare_exchange_strong( window_start_ms, now_ms, std::memory_order_relaxed ) )
+			site->count_in_window.store( 0, std::memory_order_relaxed );
+	}
+
+	if ( site->count_in_window.fetch_add( 1, std::memory_order_relaxed ) >= my_max_messages_per_call_site )
+	{
+		site->suppressed_count.fetch_add( 1, std::memory_order_relaxed );
+		return false;
+	}
+
+	*punSuppressedCount = site->suppressed_count.exchange( 0, std::memory_order_relaxed );
+	return true;
+}
+
+static void DriverLogInitRing()
+{
+	if ( my_is_log_ring_initialised )
+		return;
+
+	for ( size_t i = 0; i < my_log_ring_size; i++ )
+	{
+		my_log_ring[ i ].sequence.store( i, std::memory_order_relaxed );
+	}
+
+	my_log_enqueue_position.store( 0, std::memory_order_relaxed );
+	my_log_dequeue_position = 0;
+	my_is_log_ring_initialised = true;
+}
+
+DriverLogRecord *DriverLogBeginRecord( const char *pchFormat )
+{
+	uint32_t suppressed_count;
+	if ( !DriverLogAllowCallSite( pchFormat, &suppressed_count ) )
+		return nullptr;
+
+	DriverLogRecord *record = nullptr;
+
+	if ( !my_is_log_thread_running.load( std::memory_order_acquire ) )
+	{
+		record = &my_sync_log_record;
+	}
+	else
+	{
+		size_t position = my_log_enqueue_position.load( std::memory_order_relaxed );
+		for ( ;; )
+		{
+			DriverLogCell &cell = my_log_ring[ position & ( my_log_ring_size - 1 ) ];
+			const intptr_t difference = (intptr_t)cell.sequence.load( std::memory_order_acquire ) - (intptr_t)position;
+
+			if ( difference == 0 )
+			{
+				if ( my_log_enqueue_position.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+				{
+					cell.position = position;
+					record = &cell.record;
+					break;
+				}
+			}
+			else if ( difference < 0 )
+			{
+				// The ring is full. Rather than block the caller, drop the message and say so later.
+				my_num_dropped_log_messages.fetch_add( 1, std::memory_order_relaxed );
+				return nullptr;
+			}
+			else
+			{
+				position = my_log_enqueue_position.load( std::memory_order_relaxed );
+			}
+		}
+	}
+
+	record->format = pchFormat;
+	record->suppressed_count = suppressed_count;
+	record->num_args = 0;
+	record->string_bytes_used = 0;
+
+	return record;
+}
+
+void DriverLogAddString( DriverLogRecord &record, const char *value )
+{
+	if ( record.num_args >= DriverLogRecord::k_unMaxArgs )
+		return;
+
+	DriverLogArg &arg = record.args[ record.num_args++ ];
+	arg.type = DriverLogArg::Type_String;
+	arg.string_offset = record.string_bytes_used;
+
+	if ( value == nullptr )
+		value = "(null)";
+
+	// Copy as much of the string as fits, always leaving it terminated
+	const uint32_t space = DriverLogRecord::k_unMaxStringBytes - record.string_bytes_used;
+	if ( space == 0 )
+	{
+		arg.string_offset = DriverLogRecord::k_unMaxStringBytes - 1;
+		return;
+	}
+
+	const size_t length = strnlen( value, space - 1 );
+	memcpy( record.strings + record.string_bytes_used, value, length );
+	record.strings[ record.string_bytes_used + length ] = 0;
+	record.string_bytes_used += (uint32_t)length + 1;
+}
+
+// Formats one conversion specification (e.g. "%-5.2f") with an argument of whatever type the caller gave us.
+// Length modifiers in the format are ignored, since we know the real size of every argument.
+static int DriverLogFormatArg( char *buf, size_t size, const char *spec, size_t spec_length, char conversion, const DriverLogRecord &record, const DriverLogArg &arg )
+{
+	char format[ 32 ];
+	if ( spec_length > sizeof( format ) - 4 )
+		spec_length = sizeof( format ) - 4;
+	memcpy( format, spec, spec_length );
+
+	switch ( conversion )
+	{
+		case 'd':
+		case 'i':
+		{
+			memcpy( format + spec_length, "lld", 4 );
+			const long long value = arg.type == DriverLogArg::Type_Double ? (long long)arg.d : (long long)arg.i;
+			return snprintf( buf, size, format, value );
+		}
+
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+		{
+			format[ spec_length ] = 'l';
+			format[ spec_length + 1 ] = 'l';
+			format[ spec_length + 2 ] = conversion;
+			format[ spec_length + 3 ] = 0;
+			const unsigned long long value = arg.type == DriverLogArg::Type_Double ? (unsigned long long)arg.d : (unsigned long long)arg.u;
+			return snprintf( buf, size, format, value );
+		}
+
+		case 'c':
+		{
+			memcpy( format + spec_length, "c", 2 );
+			return snprintf( buf, size, format, (int)arg.i );
+		}
+
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+		{
+			format[ spec_length ] = conversion;
+			format[ spec_length + 1 ] = 0;
+			double value = arg.d;
+			if ( arg.type == DriverLogArg::Type_Int )
+				value = (double)arg.i;
+			else if ( arg.type == DriverLogArg::Type_Uint )
+				value = (double)arg.u;
+			return snprintf( buf, size, format, value );
+		}
+
+		case 's':
+		{
+			memcpy( format + spec_length, "s", 2 );
+			return snprintf( buf, size, format, arg.type == DriverLogArg::Type_String ? record.strings + arg.string_offset : "(not a string)" );
+		}
+
+		case 'p':
+		{
+			memcpy( format + spec_length, "p", 2 );
+			return snprintf( buf, size, format, arg.p );
+		}
+
+		default:
+			return snprintf( buf, size, "%%%c", conversion );
+	}
+}
+
+static void DriverLogFormatRecord( const DriverLogRecord &record, char *buf, size_t size )
+{
+	size_t length = 0;
+	uint32_t next_arg = 0;
+
+	const char *c = record.format;
+	while ( *c && length < size - 1 )
+	{
+		if ( *c != '%' )
+		{
+			buf[ length++ ] = *c++;
+			continue;
+		}
+
+		if ( c[ 1 ] == '%' )
+		{
+			buf[ length++ ] = '%';
+			c += 2;
+			continue;
+		}
+
+		// Flags, width and precision are passed through. Length modifiers are dropped.
+		const char *spec = c++;
+		while ( *c && strchr( "-+ #0123456789.", *c ) )
+			c++;
+		const size_t spec_length = c - spec;
+		while ( *c && strchr( "hlLqjzt", *c ) )
+			c++;
+
+		const char conversion = *c;
+		if ( conversion == 0 )
+			break;
+		c++;
+
+		int written;
+		if ( next_arg < record.num_args )
+			written = DriverLogFormatArg( buf + length, size - length, spec, spec_length, conversion, record, record.args[ next_arg++ ] );
+		else
+			written = snprintf( buf + length, size - length, "(missing)" );
+
+		if ( written > 0 )
+			length += (size_t)written < size - length ? (size_t)written : size - length - 1;
+	}
+
+	if ( record.suppressed_count > 0 && length < size - 1 )
+	{
+		const int written = snprintf( buf + length, size - length, " (%u earlier messages like this were suppressed)", record.suppressed_count );
+		if ( written > 0 )
+			length += (size_t)written < size - length ? (size_t)written : size - length - 1;
+	}
+
+	buf[ length ] = 0;
+}
+
+static void DriverLogDeliver( const DriverLogRecord &record )
 {
 	char buf[ 1024 ];
-	vsnprintf_s( buf, sizeof( buf ), pMsgFormat, args );
+	DriverLogFormatRecord( record, buf, sizeof( buf ) );
 
 	vr::VRDriverLog()->Log( buf );
 }
 
+// Whether the next record on the ring has been finished, and can be delivered
+static bool DriverLogHasNext()
+{
+	const DriverLogCell &cell = my_log_ring[ my_log_dequeue_position & ( my_log_ring_size - 1 ) ];
+	return cell.sequence.load( std::memory_order_acquire ) == my_log_dequeue_position + 1;
+}
 
-void DriverLog( const char *pMsgFormat, ... )
+// Takes the next finished record off the ring and delivers it. Returns false if there wasn't one.
+static bool DriverLogDeliverNext()
 {
-	va_list args;
-	va_start( args, pMsgFormat );
+	if ( !DriverLogHasNext() )
+		return false;
 
-	DriverLogVarArgs( pMsgFormat, args );
+	DriverLogCell &cell = my_log_ring[ my_log_dequeue_position & ( my_log_ring_size - 1 ) ];
 
-	va_end( args );
+	DriverLogDeliver( cell.record );
+
+	// Hand the cell back to producers for their next lap around the ring
+	cell.sequence.store( my_log_dequeue_position + my_log_ring_size, std::memory_order_release );
+	my_log_dequeue_position++;
+
+	return true;
 }
 
+static void DriverLogThread()
+{
+	for ( ;; )
+	{
+		const bool keep_running = my_is_log_thread_running.load( std::memory_order_acquire );
+
+		while ( DriverLogDeliverNext() )
+		{
+		}
+
+		const uint32_t dropped = my_num_dropped_log_messages.exchange( 0, std::memory_order_relaxed );
+		if ( dropped > 0 )
+		{
+			char buf[ 128 ];
+			snprintf( buf, sizeof( buf ), "%u log messages were dropped because the log ring was full", dropped );
+			vr::VRDriverLog()->Log( buf );
+		}
+
+		// We've drained everything that was queued before we were asked to stop
+		if ( !keep_running )
+			break;
 
-void DebugDriverLog( const char *pMsgFormat, ... )
+		// Park until a producer wakes us. Saying we're parked before looking at the ring one last time, with a full
+		// fence between, means a producer either sees we're parked and wakes us, or finished its record in time for us
+		// to see it here.
+		std::unique_lock< std::mutex > lock( my_log_thread_wake_mutex );
+		my_is_log_thread_parked.store( true, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		if ( !DriverLogHasNext() && my_num_dropped_log_messages.load( std::memory_order_relaxed ) == 0 )
+		{
+			my_log_thread_wake_condition.wait( lock, [] {
+				return !my_is_log_thread_parked.load( std::memory_order_relaxed ) || !my_is_log_thread_running.load( std::memory_order_acquire );
+			} );
+		}
+		my_is_log_thread_parked.store( false, std::memory_order_relaxed );
+	}
+}
+
+// Called by producers once they've queued something for the log thread. Only takes the lock if it's parked.
+static void DriverLogWakeThread()
 {
-#ifdef _DEBUG
-	va_list args;
-	va_start( args, pMsgFormat );
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if ( !my_is_log_thread_parked.load( std::memory_order_relaxed ) )
+		return;
 
-	DriverLogVarArgs( pMsgFormat, args );
+	{
+		std::lock_guard< std::mutex > lock( my_log_thread_wake_mutex );
+		my_is_log_thread_parked.store( false, std::memory_order_relaxed );
+	}
+	my_log_thread_wake_condition.notify_one();
+}
+
+void DriverLogCommitRecord( DriverLogRecord *record )
+{
+	if ( record == &my_sync_log_record )
+	{
+		DriverLogDeliver( *record );
+		return;
+	}
+
+	// The record is the first member of its cell
+	DriverLogCell *cell = reinterpret_cast< DriverLogCell * >( record );
+	cell->sequence.store( cell->position + 1, std::memory_order_release );
+	DriverLogWakeThread();
+}
+
+void DriverLogInit()
+{
+	if ( my_is_log_thread_running.load() )
+		return;
+
+	DriverLogInitRing();
+
+	my_is_log_thread_running.store( true, std::memory_order_release );
+	my_log_thread = std::thread( DriverLogThread );
+}
+
+void DriverLogShutdown()
+{
+	{
+		std::lock_guard< std::mutex > lock( my_log_thread_wake_mutex );
+		if ( !my_is_log_thread_running.exchange( false ) )
+			return;
+	}
 
-	va_end( args );
-#endif
+	my_log_thread_wake_condition.notify_one();
+	my_log_thread.join();
 }
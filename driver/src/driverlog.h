@@ -1,9 +1,149 @@
 //============ Copyright (c) Valve Corporation, All rights reserved. ============
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <type_traits>
 #include <openvr_driver.h>
 
-extern void DriverLog( const char *pchFormat, ... );
+// DriverLog doesn't format or call into vrserver on the calling thread. It captures the format string and a copy of
+// its arguments into a lock-free ring, and a background thread does the formatting and IVRDriverLog delivery.
+// That makes it cheap enough to call from the pose pump. The thread sleeps while there's nothing to log, and only the
+// first message after that takes a lock, briefly, to wake it.
+//
+// Each call site (identified by its format string) is rate limited, so a flapping tracker can't flood the log.
+// The format string must therefore be a literal, or at least outlive the log thread.
 
-extern void DebugDriverLog( const char *pchFormat, ... );
\ No newline at end of file
+// Start the background log thread. Until this is called, and after DriverLogShutdown, DriverLog is synchronous.
+extern void DriverLogInit();
+
+// Deliver anything still queued and stop the background log thread. Call before the driver context goes away.
+extern void DriverLogShutdown();
+
+struct DriverLogArg
+{
+	enum Type : uint8_t
+	{
+		Type_Int,
+		Type_Uint,
+		Type_Double,
+		Type_String,
+		Type_Pointer,
+	};
+
+	Type type;
+	union
+	{
+		int64_t i;
+		uint64_t u;
+		double d;
+		const void *p;
+		uint32_t string_offset; // Into DriverLogRecord::strings
+	};
+};
+
+struct DriverLogRecord
+{
+	static const uint32_t k_unMaxArgs = 8;
+	static const uint32_t k_unMaxStringBytes = 192;
+
+	const char *format;
+
+	// How many messages from this call site were dropped by rate limiting just before this one
+	uint32_t suppressed_count;
+
+	uint32_t num_args;
+	uint32_t string_bytes_used;
+	DriverLogArg args[ k_unMaxArgs ];
+
+	// String arguments are copied in here, so they don't need to outlive the call
+	char strings[ k_unMaxStringBytes ];
+};
+
+// Returns a record to fill in for this call, or nullptr if the message is to be dropped (rate limited or ring full).
+extern DriverLogRecord *DriverLogBeginRecord( const char *pchFormat );
+
+// Hands a filled in record to the log thread, or formats and logs it straight away if the thread isn't running.
+extern void DriverLogCommitRecord( DriverLogRecord *record );
+
+extern void DriverLogAddString( DriverLogRecord &record, const char *value );
+
+inline void DriverLogAddArg( DriverLogRecord &record, const char *value )
+{
+	DriverLogAddString( record, value );
+}
+
+inline void DriverLogAddArg( DriverLogRecord &record, const std::string &value )
+{
+	DriverLogAddString( record, value.c_str() );
+}
+
+inline void DriverLogAddArg( DriverLogRecord &record, double value )
+{
+	if ( record.num_args < DriverLogRecord::k_unMaxArgs )
+	{
+		DriverLogArg &arg = record.args[ record.num_args++ ];
+		arg.type = DriverLogArg::Type_Double;
+		arg.d = value;
+	}
+}
+
+template < class T >
+inline void DriverLogAddArg( DriverLogRecord &record, const T *value )
+{
+	if ( record.num_args < DriverLogRecord::k_unMaxArgs )
+	{
+		DriverLogArg &arg = record.args[ record.num_args++ ];
+		arg.type = DriverLogArg::Type_Pointer;
+		arg.p = value;
+	}
+}
+
+template < class T >
+inline typename std::enable_if< std::is_integral< T >::value || std::is_enum< T >::value >::type DriverLogAddArg( DriverLogRecord &record, T value )
+{
+	if ( record.num_args < DriverLogRecord::k_unMaxArgs )
+	{
+		DriverLogArg &arg = record.args[ record.num_args++ ];
+		if ( std::is_integral< T >::value && !std::is_signed< T >::value )
+		{
+			arg.type = DriverLogArg::Type_Uint;
+			arg.u = static_cast< uint64_t >( value );
+		}
+		else
+		{
+			arg.type = DriverLogArg::Type_Int;
+			arg.i = static_cast< int64_t >( value );
+		}
+	}
+}
+
+inline void DriverLogAddArgs( DriverLogRecord & /* record */ )
+{
+}
+
+template < class T, class... Args >
+inline void DriverLogAddArgs( DriverLogRecord &record, const T &first, const Args &...rest )
+{
+	DriverLogAddArg( record, first );
+	DriverLogAddArgs( record, rest... );
+}
+
+template < class... Args >
+void DriverLog( const char *pchFormat, const Args &...args )
+{
+	DriverLogRecord *record = DriverLogBeginRecord( pchFormat );
+	if ( record == nullptr )
+		return;
+
+	DriverLogAddArgs( *record, args... );
+	DriverLogCommitRecord( record );
+}
+
+template < class... Args >
+void DebugDriverLog( const char *pchFormat, const Args &...args )
+{
+#ifdef _DEBUG
+	DriverLog( pchFormat, args... );
+#endif
+}
@@ -0,0 +1,86 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "frame_phase_estimator.h"
+
+#include "openvr_driver.h"
+
+// How often we re-read frame timings. The display clock drifts slowly, so this doesn't need to be frequent.
+static const std::chrono::milliseconds my_frame_timing_refresh_period( 250 );
+
+// How many of the most recent frames we measure the frame period over
+static const uint32_t my_frame_timing_history = 16;
+
+// Frame periods outside this range are treated as garbage (30 Hz to 240 Hz displays).
+static const std::chrono::nanoseconds my_min_frame_period = std::chrono::microseconds( 4166 );
+static const std::chrono::nanoseconds my_max_frame_period = std::chrono::microseconds( 33334 );
+
+// If the compositor's frame times are further than this from our clock, they're not on the same time base and
+// can't be used to schedule against.
+static const std::chrono::seconds my_max_frame_time_skew( 1 );
+
+MyFramePhaseEstimator::MyFramePhaseEstimator()
+{
+	has_estimate_ = false;
+	frame_period_ = std::chrono::nanoseconds::zero();
+}
+
+bool MyFramePhaseEstimator::Update( std::chrono::steady_clock::time_point now )
+{
+	if ( last_refresh_time_ == std::chrono::steady_clock::time_point() || now - last_refresh_time_ >= my_frame_timing_refresh_period )
+	{
+		last_refresh_time_ = now;
+		has_estimate_ = RefreshFromFrameTimings( now );
+	}
+
+	return has_estimate_;
+}
+
+std::chrono::steady_clock::time_point MyFramePhaseEstimator::GetNextFrameTime( std::chrono::steady_clock::time_point after ) const
+{
+	if ( after < frame_time_ )
+		return frame_time_;
+
+	// Step forward a whole number of frames from the frame we know about
+	const auto frames_ahead = ( after - frame_time_ ) / frame_period_ + 1;
+	return frame_time_ + frames_ahead * frame_period_;
+}
+
+bool MyFramePhaseEstimator::RefreshFromFrameTimings( std::chrono::steady_clock::time_point now )
+{
+	vr::Compositor_FrameTiming timings[ my_frame_timing_history ];
+
+	// Only the first entry's size needs to be set
+	timings[ 0 ].m_nSize = sizeof( vr::Compositor_FrameTiming );
+	const uint32_t num_timings = vr::VRServerDriverHost()->GetFrameTimings( timings, my_frame_timing_history );
+
+	// We need at least two frames to measure a period
+	if ( num_timings < 2 )
+		return false;
+
+	const vr::Compositor_FrameTiming &oldest = timings[ 0 ];
+	const vr::Compositor_FrameTiming &newest = timings[ num_timings - 1 ];
+
+	if ( newest.m_nFrameIndex <= oldest.m_nFrameIndex )
+		return false;
+
+	// Frame timings are in order, oldest to newest. Dividing by the difference in frame index, rather than the number
+	// of entries, accounts for any frames missing from the history.
+	const double period_seconds = ( newest.m_flSystemTimeInSeconds - oldest.m_flSystemTimeInSeconds ) / ( newest.m_nFrameIndex - oldest.m_nFrameIndex );
+	const std::chrono::nanoseconds frame_period =
+		std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::duration< double >( period_seconds ) );
+
+	if ( frame_period < my_min_frame_period || frame_period > my_max_frame_period )
+		return false;
+
+	// m_flSystemTimeInSeconds is on the same monotonic clock as steady_clock (QueryPerformanceCounter on Windows,
+	// CLOCK_MONOTONIC elsewhere).
+	const std::chrono::steady_clock::time_point frame_time( std::chrono::duration_cast< std::chrono::steady_clock::duration >(
+		std::chrono::duration< double >( newest.m_flSystemTimeInSeconds ) ) );
+
+	if ( frame_time > now + my_max_frame_time_skew || frame_time < now - my_max_frame_time_skew )
+		return false;
+
+	frame_time_ = frame_time;
+	frame_period_ = frame_period;
+
+	return true;
+}
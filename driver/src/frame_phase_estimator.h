@@ -0,0 +1,31 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <chrono>
+
+//-----------------------------------------------------------------------------
+// Purpose: Estimates when the compositor's upcoming frames start, from the frame timings vrserver gives us.
+// Used by the pose pump to submit poses just before the compositor samples them.
+//-----------------------------------------------------------------------------
+class MyFramePhaseEstimator
+{
+public:
+	MyFramePhaseEstimator();
+
+	// Re-reads the compositor frame timings if our estimate has gone stale.
+	// Returns whether we have a usable estimate of the frame phase.
+	bool Update( std::chrono::steady_clock::time_point now );
+
+	// The start of the first frame after the given time. Only meaningful if Update returned true.
+	std::chrono::steady_clock::time_point GetNextFrameTime( std::chrono::steady_clock::time_point after ) const;
+
+private:
+	bool RefreshFromFrameTimings( std::chrono::steady_clock::time_point now );
+
+	bool has_estimate_;
+	std::chrono::steady_clock::time_point last_refresh_time_;
+
+	// A known frame start, and the frame period measured around it
+	std::chrono::steady_clock::time_point frame_time_;
+	std::chrono::nanoseconds frame_period_;
+};
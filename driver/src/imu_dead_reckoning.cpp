@@ -0,0 +1,161 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "imu_dead_reckoning.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "rotation_math.h"
+
+// Samples further apart than this mean the IMU stopped for a while, so we don't integrate across the gap
+static const double my_max_imu_sample_gap = 0.1; // s
+
+// How quickly our velocity dies away without the accelerometer pushing it. Short, so the accelerometer's errors
+// can't carry us far; the reckoned position mostly coasts briefly, then stops.
+static const double my_imu_velocity_damping_time = 0.25; // s
+
+// Past this long without a position anchor, we stop moving the position altogether, and just hold it
+static const double my_max_imu_position_reckoning_time = 0.5; // s
+
+// How quickly each position anchor pulls the velocity we've integrated toward how fast we really moved. Anchors
+// further apart than my_max_imu_anchor_gap are after a loss, and the velocity's forgotten instead.
+static const double my_imu_velocity_correction_time = 0.03; // s
+static const double my_max_imu_anchor_gap = 0.1;            // s
+
+// Gravity is learned while anchored, averaged over long enough that our own acceleration cancels out, and isn't
+// used until we've seen enough of it
+static const double my_imu_gravity_averaging_time = 2.0; // s
+static const double my_min_imu_gravity_time = 0.5;       // s
+static const double my_max_imu_gravity_anchor_age = 0.05; // s
+
+MyImuDeadReckoner::MyImuDeadReckoner()
+{
+	Reset();
+}
+
+void MyImuDeadReckoner::Reset()
+{
+	has_position_anchor_ = false;
+	has_rotation_anchor_ = false;
+	is_saturated_ = false;
+
+	rotation_ = { 1.0, 0.0, 0.0, 0.0 };
+	position_ = {};
+	velocity_ = {};
+
+	anchor_position_ = {};
+	time_since_position_anchor_ = 0.0;
+
+	gravity_ = {};
+	gravity_time_ = 0.0;
+
+	has_sample_ = false;
+	last_sample_time_ = 0.0;
+}
+
+void MyImuDeadReckoner::AnchorPosition( const vr::HmdVector3d_t &position )
+{
+	position_ = position;
+
+	// If no samples have come since the last anchor, we can't tell how fast we moved yet. We'll measure from
+	// that one instead, next time.
+	if ( has_position_anchor_ && time_since_position_anchor_ == 0.0 )
+		return;
+
+	if ( has_position_anchor_ && time_since_position_anchor_ <= my_max_imu_anchor_gap )
+	{
+		// Pull our velocity toward how fast we really moved since the last anchor, so the accelerometer's errors
+		// don't build up
+		const double alpha = 1.0 - std::exp( -time_since_position_anchor_ / my_imu_velocity_correction_time );
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			const double measured_velocity = ( position.v[ axis ] - anchor_position_.v[ axis ] ) / time_since_position_anchor_;
+			velocity_.v[ axis ] += ( measured_velocity - velocity_.v[ axis ] ) * alpha;
+		}
+	}
+	else
+	{
+		velocity_ = {};
+	}
+
+	anchor_position_ = position;
+	time_since_position_anchor_ = 0.0;
+	has_position_anchor_ = true;
+}
+
+void MyImuDeadReckoner::AnchorRotation( const vr::HmdQuaternion_t &rotation )
+{
+	rotation_ = rotation;
+	has_rotation_anchor_ = true;
+	is_saturated_ = false;
+}
+
+void MyImuDeadReckoner::AddSample( const vr::ImuSample_t &sample )
+{
+	const double dt = sample.fSampleTime - last_sample_time_;
+	const bool is_continuous = has_sample_ && dt > 0.0 && dt <= my_max_imu_sample_gap;
+
+	has_sample_ = true;
+	last_sample_time_ = sample.fSampleTime;
+
+	if ( sample.unOffScaleFlags != 0 )
+		is_saturated_ = true;
+
+	if ( !is_continuous || is_saturated_ )
+		return;
+
+	// Turn by the gyro's rate over the sample, about its own axis: q * (cos(angle / 2), axis * sin(angle / 2))
+	const double rate = std::sqrt(
+		sample.vGyro.v[ 0 ] * sample.vGyro.v[ 0 ] + sample.vGyro.v[ 1 ] * sample.vGyro.v[ 1 ] + sample.vGyro.v[ 2 ] * sample.vGyro.v[ 2 ] );
+	if ( rate > 0.0 )
+	{
+		const double half_angle = 0.5 * rate * dt;
+		const double s = std::sin( half_angle ) / rate;
+		const vr::HmdQuaternion_t turn = { std::cos( half_angle ), sample.vGyro.v[ 0 ] * s, sample.vGyro.v[ 1 ] * s, sample.vGyro.v[ 2 ] * s };
+
+		const vr::HmdQuaternion_t &q = rotation_;
+		vr::HmdQuaternion_t turned = {
+			q.w * turn.w - q.x * turn.x - q.y * turn.y - q.z * turn.z,
+			q.w * turn.x + q.x * turn.w + q.y * turn.z - q.z * turn.y,
+			q.w * turn.y - q.x * turn.z + q.y * turn.w + q.z * turn.x,
+			q.w * turn.z + q.x * turn.y - q.y * turn.x + q.z * turn.w,
+		};
+
+		// Renormalize, or rounding errors build up over thousands of samples
+		const double length = std::sqrt( turned.w * turned.w + turned.x * turned.x + turned.y * turned.y + turned.z * turned.z );
+		rotation_ = { turned.w / length, turned.x / length, turned.y / length, turned.z / length };
+	}
+
+	// What the accelerometer reads, in world space: gravity, plus however we're accelerating
+	const vr::HmdVector3d_t reading = MyRotate( rotation_, sample.vAccel );
+	time_since_position_anchor_ += dt;
+
+	// While we're being anchored, our rotation's right, so the reading's a good sample of gravity
+	if ( has_rotation_anchor_ && time_since_position_anchor_ <= my_max_imu_gravity_anchor_age )
+	{
+		const double alpha = gravity_time_ == 0.0 ? 1.0 : std::min( dt / my_imu_gravity_averaging_time, 1.0 );
+		for ( int axis = 0; axis < 3; axis++ )
+			gravity_.v[ axis ] += ( reading.v[ axis ] - gravity_.v[ axis ] ) * alpha;
+
+		gravity_time_ += dt;
+	}
+
+	if ( gravity_time_ < my_min_imu_gravity_time || time_since_position_anchor_ > my_max_imu_position_reckoning_time )
+		return;
+
+	const double damping = std::exp( -dt / my_imu_velocity_damping_time );
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		velocity_.v[ axis ] = ( velocity_.v[ axis ] + ( reading.v[ axis ] - gravity_.v[ axis ] ) * dt ) * damping;
+		position_.v[ axis ] += velocity_.v[ axis ] * dt;
+	}
+}
+
+bool MyImuDeadReckoner::CanReckonRotation() const
+{
+	return has_rotation_anchor_ && has_sample_ && !is_saturated_;
+}
+
+bool MyImuDeadReckoner::CanReckonPosition() const
+{
+	return CanReckonRotation() && has_position_anchor_ && gravity_time_ >= my_min_imu_gravity_time;
+}
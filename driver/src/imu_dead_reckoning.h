@@ -0,0 +1,61 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include "openvr_driver.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Carries a tracker's pose on from where it was last known to be, using its IMU, while the pose itself
+// can't be trusted. Rotation follows the gyro. Position follows the accelerometer, less the gravity we learn while
+// tracking, with its velocity damped hard, since integrating accelerometer noise twice soon wanders off. It's only
+// meant to bridge brief losses.
+// Samples are taken to be in the tracker's own frame, the one its pose's rotation is of: rotation in rad/s, and
+// acceleration in m/s² as the accelerometer reads it, so pointing up at rest.
+// Each tracker's pose pipeline has its own, fed as the pump reads the IMU stream, and read back in the same update,
+// so there's nothing in it to lock.
+//-----------------------------------------------------------------------------
+class MyImuDeadReckoner
+{
+public:
+	MyImuDeadReckoner();
+
+	// Forget everything, e.g. when the samples start coming from another IMU, or stop coming at all
+	void Reset();
+
+	// Where the tracker really is, when we know. Dead reckoning carries on from the last of each.
+	void AnchorPosition( const vr::HmdVector3d_t &position );
+	void AnchorRotation( const vr::HmdQuaternion_t &rotation );
+
+	// Moves the pose on by one sample. Samples must come in time order.
+	void AddSample( const vr::ImuSample_t &sample );
+
+	// Whether our rotation and position are worth using in place of the pose's own: we've been anchored, the IMU's
+	// been running since, and for position, we know which way gravity is
+	bool CanReckonRotation() const;
+	bool CanReckonPosition() const;
+
+	const vr::HmdQuaternion_t &GetRotation() const { return rotation_; }
+	const vr::HmdVector3d_t &GetPosition() const { return position_; }
+
+private:
+	bool has_position_anchor_;
+	bool has_rotation_anchor_;
+
+	// Set when a sample reads off the scale, since we can't tell where it went after that. Cleared by an anchor.
+	bool is_saturated_;
+
+	vr::HmdQuaternion_t rotation_;
+	vr::HmdVector3d_t position_;
+	vr::HmdVector3d_t velocity_;
+
+	// Our last position anchor, and how much IMU time has gone by since, for working out our velocity at the next
+	vr::HmdVector3d_t anchor_position_;
+	double time_since_position_anchor_;
+
+	// What the accelerometer reads when the tracker isn't accelerating, in world space, and how many seconds of
+	// tracking we've learned it over
+	vr::HmdVector3d_t gravity_;
+	double gravity_time_;
+
+	bool has_sample_;
+	double last_sample_time_;
+};
@@ -0,0 +1,90 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "motion_rate_governor.h"
+
+static const MyMotionRateGovernorParams my_default_governor_params = {
+	// Update rates for each motion class. A tracker sitting on a desk only needs a trickle of updates,
+	// while a foot mid-kick wants everything we can give it.
+	{
+		std::chrono::microseconds( 20000 ), // static: 50 Hz
+		std::chrono::microseconds( 4000 ),  // slow: 250 Hz
+		std::chrono::microseconds( 1000 ),  // fast: 1000 Hz
+	},
+
+	0.02, // static_max_linear_speed
+	0.1,  // static_max_angular_speed
+	0.5,  // fast_min_linear_speed
+	3.0,  // fast_min_angular_speed
+
+	// Keeps a single noisy sample from changing the class
+	0.3,
+
+	// A tracker is promoted to a faster class immediately, but only demoted after it has stayed slower for this long,
+	// so a brief pause mid-motion doesn't drop the rate.
+	std::chrono::milliseconds( 500 ),
+};
+
+const MyMotionRateGovernorParams &MyGetDefaultMotionRateGovernorParams()
+{
+	return my_default_governor_params;
+}
+
+MyMotionRateGovernor::MyMotionRateGovernor()
+{
+	params_ = my_default_governor_params;
+	has_sample_ = false;
+	linear_speed_ = 0.0;
+	angular_speed_ = 0.0;
+
+	// Start fast so a freshly activated tracker is responsive until we know better.
+	motion_class_ = MyMotionClass_Fast;
+}
+
+void MyMotionRateGovernor::AddSample( double linear_speed, double angular_speed, std::chrono::steady_clock::time_point now )
+{
+	if ( has_sample_ )
+	{
+		linear_speed_ += params_.speed_smoothing * ( linear_speed - linear_speed_ );
+		angular_speed_ += params_.speed_smoothing * ( angular_speed - angular_speed_ );
+	}
+	else
+	{
+		linear_speed_ = linear_speed;
+		angular_speed_ = angular_speed;
+		last_class_confirmed_time_ = now;
+	}
+
+	has_sample_ = true;
+
+	const MyMotionClass measured_class = ClassifySpeed();
+	if ( measured_class >= motion_class_ )
+	{
+		motion_class_ = measured_class;
+		last_class_confirmed_time_ = now;
+	}
+	else if ( now - last_class_confirmed_time_ >= params_.demotion_delay )
+	{
+		motion_class_ = measured_class;
+		last_class_confirmed_time_ = now;
+	}
+}
+
+MyMotionClass MyMotionRateGovernor::GetMotionClass() const
+{
+	return motion_class_;
+}
+
+std::chrono::nanoseconds MyMotionRateGovernor::GetUpdatePeriod() const
+{
+	return params_.periods[ motion_class_ ];
+}
+
+MyMotionClass MyMotionRateGovernor::ClassifySpeed() const
+{
+	if ( linear_speed_ >= params_.fast_min_linear_speed || angular_speed_ >= params_.fast_min_angular_speed )
+		return MyMotionClass_Fast;
+
+	if ( linear_speed_ >= params_.static_max_linear_speed || angular_speed_ >= params_.static_max_angular_speed )
+		return MyMotionClass_Slow;
+
+	return MyMotionClass_Static;
+}
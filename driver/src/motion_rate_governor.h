@@ -0,0 +1,74 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <chrono>
+
+enum MyMotionClass
+{
+	MyMotionClass_Static,
+	MyMotionClass_Slow,
+	MyMotionClass_Fast,
+
+	MyMotionClass_MAX
+};
+
+// Everything that decides how a tracker is classified and how often each class is updated
+struct MyMotionRateGovernorParams
+{
+	// Update period for each motion class
+	std::chrono::nanoseconds periods[ MyMotionClass_MAX ];
+
+	// Speeds (m/s, rad/s) above which a tracker leaves the static class
+	double static_max_linear_speed;
+	double static_max_angular_speed;
+
+	// Speeds (m/s, rad/s) above which a tracker is considered to be moving fast
+	double fast_min_linear_speed;
+	double fast_min_angular_speed;
+
+	// Weight given to each new speed measurement
+	double speed_smoothing;
+
+	// How long a tracker has to stay slower before it is demoted
+	std::chrono::nanoseconds demotion_delay;
+};
+
+// What the driver runs with
+const MyMotionRateGovernorParams &MyGetDefaultMotionRateGovernorParams();
+
+//-----------------------------------------------------------------------------
+// Purpose: Classifies a tracker as static, slow or fast from its recent linear and angular speed,
+// and gives back the period the pose pump should use to schedule its next update.
+//-----------------------------------------------------------------------------
+class MyMotionRateGovernor
+{
+public:
+	MyMotionRateGovernor();
+
+	// Only meant to be changed before the first sample, e.g. by the offline tools when tuning
+	void SetParams( const MyMotionRateGovernorParams &params ) { params_ = params; }
+
+	// Feed the speeds measured between the two most recent valid poses, in m/s and rad/s, taken at time now.
+	void AddSample( double linear_speed, double angular_speed, std::chrono::steady_clock::time_point now );
+
+	MyMotionClass GetMotionClass() const;
+
+	// How long the pump should wait before updating this tracker again.
+	std::chrono::nanoseconds GetUpdatePeriod() const;
+
+private:
+	MyMotionClass ClassifySpeed() const;
+
+	MyMotionRateGovernorParams params_;
+
+	bool has_sample_;
+
+	// Exponentially smoothed speeds, in m/s and rad/s
+	double linear_speed_;
+	double angular_speed_;
+
+	MyMotionClass motion_class_;
+
+	// When the tracker last measured at or above its current class. Used to delay demotion.
+	std::chrono::steady_clock::time_point last_class_confirmed_time_;
+};
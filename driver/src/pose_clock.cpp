@@ -0,0 +1,21 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_clock.h"
+
+MyPoseClock::MyPoseClock()
+{
+	is_simulated_ = false;
+	step_ = std::chrono::steady_clock::duration::zero();
+	simulated_time_ = 0;
+}
+
+void MyPoseClock::Simulate( std::chrono::nanoseconds step )
+{
+	is_simulated_ = true;
+	step_ = std::chrono::duration_cast< std::chrono::steady_clock::duration >( step );
+	simulated_time_ = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+void MyPoseClock::Step()
+{
+	simulated_time_.store( simulated_time_.load( std::memory_order_relaxed ) + step_.count(), std::memory_order_release );
+}
@@ -0,0 +1,39 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+//-----------------------------------------------------------------------------
+// Purpose: Where the pose pump, and everything it feeds, gets the time from.
+// Normally that's the steady clock. A simulated clock only moves when it's stepped, by exactly one step at a time,
+// so a run driven by a host that steps it is timed identically every time, however fast the host goes.
+//-----------------------------------------------------------------------------
+class MyPoseClock
+{
+public:
+	MyPoseClock();
+
+	// Switch to simulated time, starting from the steady clock's current time. Must be called before anyone reads it.
+	void Simulate( std::chrono::nanoseconds step );
+
+	bool IsSimulated() const { return is_simulated_; }
+
+	std::chrono::steady_clock::time_point Now() const
+	{
+		if ( !is_simulated_ )
+			return std::chrono::steady_clock::now();
+
+		return std::chrono::steady_clock::time_point( std::chrono::steady_clock::duration( simulated_time_.load( std::memory_order_acquire ) ) );
+	}
+
+	// Moves simulated time forward one step. Only one thread may step the clock.
+	void Step();
+
+private:
+	bool is_simulated_;
+	std::chrono::steady_clock::duration step_;
+
+	// Time since the steady clock's epoch, so it can be read from any thread
+	std::atomic< std::chrono::steady_clock::rep > simulated_time_;
+};
@@ -0,0 +1,151 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_history.h"
+
+#include <algorithm>
+#include <cmath>
+
+static_assert( ( MyPoseHistory::k_unCapacity & ( MyPoseHistory::k_unCapacity - 1 ) ) == 0, "Pose history capacity must be a power of two" );
+static_assert( sizeof( MyPoseSample ) == MY_CACHE_LINE_SIZE, "Pose samples are meant to fill a cache line each" );
+
+// Below this angle between two rotations we lerp instead. sin() of the angle gets too small to divide by.
+static const double my_slerp_min_angle = 1e-6;
+
+vr::HmdQuaternion_t MySlerp( const vr::HmdQuaternion_t &a, const vr::HmdQuaternion_t &b, double t )
+{
+	double dot = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+
+	// q and -q are the same rotation. Go whichever way is shorter.
+	double sign = 1.0;
+	if ( dot < 0.0 )
+	{
+		dot = -dot;
+		sign = -1.0;
+	}
+
+	double weight_a = 1.0 - t;
+	double weight_b = t;
+
+	const double angle = std::acos( std::fmin( dot, 1.0 ) );
+	if ( angle > my_slerp_min_angle )
+	{
+		const double sin_angle = std::sin( angle );
+		weight_a = std::sin( ( 1.0 - t ) * angle ) / sin_angle;
+		weight_b = std::sin( t * angle ) / sin_angle;
+	}
+
+	weight_b *= sign;
+
+	vr::HmdQuaternion_t result = {
+		weight_a * a.w + weight_b * b.w,
+		weight_a * a.x + weight_b * b.x,
+		weight_a * a.y + weight_b * b.y,
+		weight_a * a.z + weight_b * b.z,
+	};
+
+	// Only the lerp fallback really needs this, but it keeps rounding from building up either way
+	const double length = std::sqrt( result.w * result.w + result.x * result.x + result.y * result.y + result.z * result.z );
+	if ( length > 0.0 )
+	{
+		result.w /= length;
+		result.x /= length;
+		result.y /= length;
+		result.z /= length;
+	}
+
+	return result;
+}
+
+// Lerps position and slerps rotation from before to after, by how far time is between them.
+// Times past after extrapolate.
+static void MyInterpolate( const MyPoseSample &before, const MyPoseSample &after, std::chrono::steady_clock::time_point time, MyPoseSample &pose )
+{
+	const double t = std::chrono::duration< double >( time - before.time ).count() / std::chrono::duration< double >( after.time - before.time ).count();
+
+	pose.time = time;
+	pose.position.v[ 0 ] = before.position.v[ 0 ] + t * ( after.position.v[ 0 ] - before.position.v[ 0 ] );
+	pose.position.v[ 1 ] = before.position.v[ 1 ] + t * ( after.position.v[ 1 ] - before.position.v[ 1 ] );
+	pose.position.v[ 2 ] = before.position.v[ 2 ] + t * ( after.position.v[ 2 ] - before.position.v[ 2 ] );
+	pose.rotation = MySlerp( before.rotation, after.rotation, t );
+}
+
+MyPoseHistory::MyPoseHistory()
+{
+	head_ = k_unCapacity - 1;
+	num_samples_ = 0;
+}
+
+void MyPoseHistory::Add( const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point time )
+{
+	if ( num_samples_ > 0 )
+	{
+		if ( time < samples_[ head_ ].time )
+			return;
+
+		if ( time > samples_[ head_ ].time )
+		{
+			head_ = ( head_ + 1 ) & ( k_unCapacity - 1 );
+			if ( num_samples_ < k_unCapacity )
+				num_samples_++;
+		}
+	}
+	else
+	{
+		head_ = ( head_ + 1 ) & ( k_unCapacity - 1 );
+		num_samples_ = 1;
+	}
+
+	MyPoseSample &sample = samples_[ head_ ];
+	sample.time = time;
+	sample.position = { pose.vecPosition[ 0 ], pose.vecPosition[ 1 ], pose.vecPosition[ 2 ] };
+	sample.rotation = pose.qRotation;
+}
+
+bool MyPoseHistory::GetPoseAt( std::chrono::steady_clock::time_point time, MyPoseSample &pose ) const
+{
+	if ( num_samples_ == 0 )
+		return false;
+
+	const MyPoseSample &oldest = GetOldest();
+	const MyPoseSample &newest = GetNewest();
+
+	if ( time < oldest.time )
+	{
+		pose = oldest;
+		return false;
+	}
+
+	if ( time >= newest.time )
+	{
+		pose = newest;
+		return time == newest.time;
+	}
+
+	// Find the first sample after time. There is one, since time is before the newest, and it isn't the oldest.
+	uint32_t low = 1;
+	uint32_t high = num_samples_ - 1;
+	while ( low < high )
+	{
+		const uint32_t middle = low + ( high - low ) / 2;
+		if ( GetSample( middle ).time > time )
+			high = middle;
+		else
+			low = middle + 1;
+	}
+
+	MyInterpolate( GetSample( low - 1 ), GetSample( low ), time, pose );
+	return true;
+}
+
+void MyPoseHistory::PredictPoseAt( std::chrono::steady_clock::time_point time, std::chrono::nanoseconds max_extrapolation, MyPoseSample &pose ) const
+{
+	if ( num_samples_ < 2 || time <= GetNewest().time )
+	{
+		GetPoseAt( time, pose );
+		return;
+	}
+
+	// Carrying on along the line through the last two samples is just interpolating past the end of it
+	const MyPoseSample &newest = GetNewest();
+	MyInterpolate( GetSample( num_samples_ - 2 ), newest, std::min( time, newest.time + max_extrapolation ), pose );
+	pose.time = time;
+}
@@ -0,0 +1,62 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "openvr_driver.h"
+#include "tracker_state_table.h"
+
+// One timestamped pose. Exactly a cache line, so a lookup touches as little memory as possible.
+struct MyPoseSample
+{
+	std::chrono::steady_clock::time_point time;
+	vr::HmdVector3d_t position;
+	vr::HmdQuaternion_t rotation;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: A fixed-capacity ring of a tracker's recent good poses, oldest overwritten first, that can be asked
+// for its pose at any moment it covers. Lookups binary search the ring by time, then lerp position and slerp
+// rotation between the samples either side.
+// Good poses are added, and looked up for resampling, by the same tracker's update, so the ring needs no locking and
+// a lookup never sees a half-written sample.
+//-----------------------------------------------------------------------------
+class MyPoseHistory
+{
+public:
+	// A power of two, so wrapping is a mask. At the fastest update rate this is the last 64 ms.
+	static const uint32_t k_unCapacity = 64;
+
+	MyPoseHistory();
+
+	void Clear() { num_samples_ = 0; }
+
+	// Samples must be added in time order. One with the same time as the newest replaces it, and one older than
+	// the newest is dropped.
+	void Add( const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point time );
+
+	uint32_t GetNumSamples() const { return num_samples_; }
+
+	// 0 is the oldest sample we have
+	const MyPoseSample &GetSample( uint32_t index ) const { return samples_[ ( head_ - num_samples_ + 1 + index ) & ( k_unCapacity - 1 ) ]; }
+	const MyPoseSample &GetNewest() const { return samples_[ head_ ]; }
+	const MyPoseSample &GetOldest() const { return GetSample( 0 ); }
+
+	// Our pose at time. Returns false if time is outside what we hold, in which case the pose is the nearest end
+	// of the history, or if we hold nothing at all, in which case the pose is left alone.
+	bool GetPoseAt( std::chrono::steady_clock::time_point time, MyPoseSample &pose ) const;
+
+	// Like GetPoseAt, but past the newest sample carries on at the speed we were last moving, for up to
+	// max_extrapolation, then holds there. Needs at least one sample.
+	void PredictPoseAt( std::chrono::steady_clock::time_point time, std::chrono::nanoseconds max_extrapolation, MyPoseSample &pose ) const;
+
+private:
+	alignas( MY_CACHE_LINE_SIZE ) MyPoseSample samples_[ k_unCapacity ];
+
+	uint32_t head_; // Where the newest sample is
+	uint32_t num_samples_;
+};
+
+// Spherical interpolation between unit quaternions, the short way round
+vr::HmdQuaternion_t MySlerp( const vr::HmdQuaternion_t &a, const vr::HmdQuaternion_t &b, double t );
@@ -0,0 +1,326 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "rotation_math.h"
+
+// How far past the source's newest sample a resampled pose may be extrapolated, before it holds still instead.
+// Enough to ride out a late sample or two without overshooting when the source stops altogether.
+static const std::chrono::milliseconds my_max_resample_extrapolation( 20 );
+
+// How many times longer than the gap before it a sample has to last before we take it that the source has stopped.
+// Sources don't sample perfectly evenly, so a sample that's just a little late mustn't count.
+static const int my_still_sample_gap_factor = 2;
+
+// How far past the last good pose a channel we're holding may carry on the way it was going, before it holds still.
+// Long enough to cover a brief loss of position, short enough that it can't wander off far if the tracker stopped.
+static const std::chrono::milliseconds my_max_held_extrapolation( 100 );
+
+// The fastest a tracker can plausibly move between two good poses, plus what noise can add on top. A channel that
+// moves further than this from its last good value is an outlier, like a position snapping to a reflection, and we
+// hold the last good value instead. The longer it's been, the further it may go, so a real move is accepted in the end.
+static const double my_max_plausible_linear_speed = 15.0; // m/s: a fast punch or kick
+static const double my_position_noise_allowance = 0.05;   // m
+static const double my_max_plausible_angular_speed = 40.0; // rad/s: a fast wrist flick
+static const double my_rotation_noise_allowance = 0.2;     // rad
+
+// Position needs the tracker to be properly tracked. Rotation comes from the tracker's IMU, so it can still be good
+// when the tracker is out of sight or only has rotation to go on.
+static bool MyIsPositionTracked( const vr::DriverPose_t &pose )
+{
+	return pose.poseIsValid && pose.result == vr::TrackingResult_Running_OK;
+}
+
+static bool MyIsRotationTracked( const vr::DriverPose_t &pose )
+{
+	if ( !pose.poseIsValid )
+		return false;
+
+	switch ( pose.result )
+	{
+	case vr::TrackingResult_Running_OK:
+	case vr::TrackingResult_Running_OutOfRange:
+	case vr::TrackingResult_Calibrating_OutOfRange:
+	case vr::TrackingResult_Fallback_RotationOnly:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Whether a source pose is a new sample, or one we've already seen
+static bool MyIsNewSample( const vr::DriverPose_t &pose, const MyPoseSample &newest )
+{
+	return pose.vecPosition[ 0 ] != newest.position.v[ 0 ] || pose.vecPosition[ 1 ] != newest.position.v[ 1 ] ||
+		   pose.vecPosition[ 2 ] != newest.position.v[ 2 ] || pose.qRotation.w != newest.rotation.w || pose.qRotation.x != newest.rotation.x ||
+		   pose.qRotation.y != newest.rotation.y || pose.qRotation.z != newest.rotation.z;
+}
+
+MyPosePipeline::MyPosePipeline( MyTrackerStateTable &tracker_states, uint32_t slot )
+	: tracker_states_( tracker_states ), slot_( slot )
+{
+	// Our pose slots are reused for every update, so they only need zeroing once
+	pose_slots_[ 0 ] = {};
+	pose_slots_[ 1 ] = {};
+	good_pose_slot_ = 0;
+	resampled_pose_ = {};
+
+	good_pose_time_ = std::chrono::steady_clock::time_point();
+	good_position_time_ = std::chrono::steady_clock::time_point();
+	good_rotation_time_ = std::chrono::steady_clock::time_point();
+
+	fixed_update_period_ = std::chrono::nanoseconds::zero();
+	output_time_ = std::chrono::steady_clock::time_point();
+
+	has_inferred_pose_ = false;
+	inferred_position_ = {};
+	inferred_rotation_ = { 1.0, 0.0, 0.0, 0.0 };
+
+	tracking_state_ = MyTrackingState_Inactive;
+}
+
+const vr::DriverPose_t *MyPosePipeline::Update( const MyPipelineConfig &config, std::chrono::steady_clock::time_point now )
+{
+	const bool was_valid = tracker_states_.HasFlags( slot_, MyTrackerStateFlag_PoseIsValid );
+
+	vr::DriverPose_t &current_pose = GetSourcePose();
+	tracker_states_.SetPoseIsValid( slot_, current_pose.poseIsValid );
+
+	const bool is_locking = config.pose_locking_enabled || config.is_force_locked;
+
+	// Without locking, there's nothing to hold in place of a bad channel, so we take the source's word for both
+	bool is_position_good = current_pose.poseIsValid;
+	bool is_rotation_good = current_pose.poseIsValid;
+	if ( is_locking )
+		CheckChannels( current_pose, now, is_position_good, is_rotation_good );
+
+	// While force locked, we hang on to the pose we already have, once we have one
+	const bool has_good_pose = tracker_states_.HasFlags( slot_, MyTrackerStateFlag_HasGoodPose );
+	const bool is_holding_pose = config.is_force_locked && has_good_pose;
+
+	if ( is_position_good && is_rotation_good && !is_holding_pose )
+	{
+		// It's valid, so it becomes our last known good pose. No need to copy it, just swap slots.
+		good_pose_slot_ = 1 - good_pose_slot_;
+		good_pose_time_ = now;
+		good_position_time_ = now;
+		good_rotation_time_ = now;
+		tracker_states_.StoreGoodPose( slot_, current_pose, now );
+
+		// We may well have looked at this sample already, if the source updates slower than we do. Once the same
+		// sample has lasted well past the gap before it, though, the source has stopped moving rather than not
+		// updated yet, and the history needs to know, or we'd carry on as if it were still moving.
+		const uint32_t num_samples = pose_history_.GetNumSamples();
+		if ( num_samples == 0 || MyIsNewSample( current_pose, pose_history_.GetNewest() ) ||
+			 ( num_samples >= 2 && now - pose_history_.GetNewest().time >
+									   my_still_sample_gap_factor * ( pose_history_.GetNewest().time - pose_history_.GetSample( num_samples - 2 ).time ) ) )
+		{
+			pose_history_.Add( current_pose, now );
+		}
+
+		imu_.AnchorPosition( { { current_pose.vecPosition[ 0 ], current_pose.vecPosition[ 1 ], current_pose.vecPosition[ 2 ] } } );
+		imu_.AnchorRotation( current_pose.qRotation );
+
+		// Only real measurements tell us how fast we're moving; a held pose would look perfectly still.
+		if ( tracker_states_.HasFlags( slot_, MyTrackerStateFlag_HasVelocity ) )
+		{
+			rate_governor_.AddSample( tracker_states_.GetLinearSpeed( slot_ ), tracker_states_.GetAngularSpeed( slot_ ), now );
+		}
+	}
+	else if ( is_locking && has_good_pose && !is_holding_pose )
+	{
+		// At most one channel is good. It goes live in our last known good pose. The others are carried on by the
+		// IMU, if we're being given its samples, or where we've been told we are, or else carry on the way they were
+		// going for a little while, if they were last good along with the rest of the pose. Then they stay where they are.
+		// Half a pose doesn't tell us how fast we're moving, or where we were, so the history and governor wait.
+		vr::DriverPose_t &good_pose = pose_slots_[ good_pose_slot_ ];
+		const bool is_held_channel_in_history = is_position_good != is_rotation_good &&
+												( is_position_good ? good_rotation_time_ : good_position_time_ ) == good_pose_time_;
+
+		const bool is_predicting = is_held_channel_in_history && pose_history_.GetNumSamples() > 0;
+
+		MyPoseSample predicted;
+		if ( is_predicting )
+			pose_history_.PredictPoseAt( now, my_max_held_extrapolation, predicted );
+
+		if ( is_position_good )
+		{
+			std::copy( current_pose.vecPosition, current_pose.vecPosition + 3, good_pose.vecPosition );
+			std::copy( current_pose.vecVelocity, current_pose.vecVelocity + 3, good_pose.vecVelocity );
+			std::copy( current_pose.vecAcceleration, current_pose.vecAcceleration + 3, good_pose.vecAcceleration );
+			imu_.AnchorPosition( { { current_pose.vecPosition[ 0 ], current_pose.vecPosition[ 1 ], current_pose.vecPosition[ 2 ] } } );
+			good_position_time_ = now;
+		}
+		else
+		{
+			if ( has_inferred_pose_ )
+				std::copy( inferred_position_.v, inferred_position_.v + 3, good_pose.vecPosition );
+			else if ( imu_.CanReckonPosition() )
+				std::copy( imu_.GetPosition().v, imu_.GetPosition().v + 3, good_pose.vecPosition );
+			else if ( is_predicting )
+				std::copy( predicted.position.v, predicted.position.v + 3, good_pose.vecPosition );
+
+			std::fill( good_pose.vecVelocity, good_pose.vecVelocity + 3, 0.0 );
+			std::fill( good_pose.vecAcceleration, good_pose.vecAcceleration + 3, 0.0 );
+		}
+
+		if ( is_rotation_good )
+		{
+			good_pose.qRotation = current_pose.qRotation;
+			std::copy( current_pose.vecAngularVelocity, current_pose.vecAngularVelocity + 3, good_pose.vecAngularVelocity );
+			std::copy( current_pose.vecAngularAcceleration, current_pose.vecAngularAcceleration + 3, good_pose.vecAngularAcceleration );
+			imu_.AnchorRotation( current_pose.qRotation );
+			good_rotation_time_ = now;
+		}
+		else
+		{
+			if ( imu_.CanReckonRotation() )
+				good_pose.qRotation = imu_.GetRotation();
+			else if ( has_inferred_pose_ )
+				good_pose.qRotation = inferred_rotation_;
+			else if ( is_predicting )
+				good_pose.qRotation = predicted.rotation;
+
+			std::fill( good_pose.vecAngularVelocity, good_pose.vecAngularVelocity + 3, 0.0 );
+			std::fill( good_pose.vecAngularAcceleration, good_pose.vecAngularAcceleration + 3, 0.0 );
+		}
+	}
+
+	has_inferred_pose_ = false;
+
+	if ( was_valid && !current_pose.poseIsValid )
+	{
+		tracker_states_.AddDropout( slot_ );
+	}
+
+	tracking_state_ = current_pose.poseIsValid ? MyTrackingState_Tracking : MyTrackingState_Lost;
+	const vr::DriverPose_t *submitted_pose = nullptr;
+
+	if ( is_locking )
+	{
+		// If we have a last known good pose, that's what we submit, with whatever's good in the source pose already
+		// in it. It was valid when we stored it, so it's already marked as valid.
+		if ( tracker_states_.HasFlags( slot_, MyTrackerStateFlag_HasGoodPose ) )
+		{
+			submitted_pose = &pose_slots_[ good_pose_slot_ ];
+
+			if ( is_holding_pose || ( !is_position_good && !is_rotation_good ) )
+				tracking_state_ = MyTrackingState_Locked;
+			else if ( !is_position_good || !is_rotation_good )
+				tracking_state_ = MyTrackingState_PartlyLocked;
+			else
+				tracking_state_ = MyTrackingState_Tracking;
+		}
+		else
+		{
+			tracking_state_ = MyTrackingState_Lost;
+		}
+	}
+	else
+	{
+		// Pose locking is disabled, so just send the latest pose directly.
+		submitted_pose = &current_pose;
+	}
+
+	// Time spent holding a pose is only known once we stop holding it
+	if ( tracking_state_ == MyTrackingState_Locked || tracking_state_ == MyTrackingState_PartlyLocked )
+		tracker_states_.BeginLock( slot_, now );
+	else
+		tracker_states_.EndLock( slot_, now );
+
+	tracker_states_.SetTrackingState( slot_, tracking_state_ );
+	tracker_states_.SetMotionClass( slot_, rate_governor_.GetMotionClass() );
+
+	if ( config.is_resampling )
+	{
+		// The pump wakes us a little after each grid point, by however late it was. Stepping on by whole periods
+		// keeps our poses evenly spaced regardless. If we're a period or more off the grid, we weren't resampling,
+		// the period changed under us, or the pump fell behind, so we start a new grid from now.
+		const std::chrono::nanoseconds period = GetUpdatePeriod();
+		const std::chrono::steady_clock::time_point next_output_time = output_time_ + period;
+
+		if ( output_time_ == std::chrono::steady_clock::time_point() || std::abs( ( now - next_output_time ).count() ) >= period.count() )
+			output_time_ = now;
+		else
+			output_time_ = next_output_time;
+
+		// Fresh poses are the only ones we resample. A held pose is already as still as it gets.
+		if ( submitted_pose != nullptr && tracking_state_ == MyTrackingState_Tracking )
+			submitted_pose = Resample( *submitted_pose, output_time_ - config.resample_delay );
+	}
+	else
+	{
+		output_time_ = std::chrono::steady_clock::time_point();
+	}
+
+	fixed_update_period_ = config.fixed_update_period;
+
+	return submitted_pose;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Works out which of a source pose's position and rotation are good enough to submit: the tracking result
+// has to vouch for them, and they can't have moved implausibly far from the last good ones.
+//-----------------------------------------------------------------------------
+void MyPosePipeline::CheckChannels(
+	const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point now, bool &is_position_good, bool &is_rotation_good )
+{
+	is_position_good = MyIsPositionTracked( pose );
+	is_rotation_good = MyIsRotationTracked( pose );
+
+	if ( !tracker_states_.HasFlags( slot_, MyTrackerStateFlag_HasGoodPose ) )
+		return;
+
+	const vr::DriverPose_t &good_pose = pose_slots_[ good_pose_slot_ ];
+	bool is_outlier = false;
+
+	if ( is_position_good )
+	{
+		const double dx = pose.vecPosition[ 0 ] - good_pose.vecPosition[ 0 ];
+		const double dy = pose.vecPosition[ 1 ] - good_pose.vecPosition[ 1 ];
+		const double dz = pose.vecPosition[ 2 ] - good_pose.vecPosition[ 2 ];
+		const double max_distance =
+			my_max_plausible_linear_speed * std::chrono::duration< double >( now - good_position_time_ ).count() + my_position_noise_allowance;
+
+		if ( dx * dx + dy * dy + dz * dz > max_distance * max_distance )
+		{
+			is_position_good = false;
+			is_outlier = true;
+		}
+	}
+
+	if ( is_rotation_good )
+	{
+		const double max_angle =
+			my_max_plausible_angular_speed * std::chrono::duration< double >( now - good_rotation_time_ ).count() + my_rotation_noise_allowance;
+
+		if ( MyAngleBetween( pose.qRotation, good_pose.qRotation ) > max_angle )
+		{
+			is_rotation_good = false;
+			is_outlier = true;
+		}
+	}
+
+	if ( is_outlier )
+		tracker_states_.AddRejectedOutlier( slot_ );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds a copy of pose with its position and rotation taken from the source's samples around time.
+//-----------------------------------------------------------------------------
+const vr::DriverPose_t *MyPosePipeline::Resample( const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point time )
+{
+	MyPoseSample sample;
+	pose_history_.PredictPoseAt( time, my_max_resample_extrapolation, sample );
+
+	resampled_pose_ = pose;
+	resampled_pose_.vecPosition[ 0 ] = sample.position.v[ 0 ];
+	resampled_pose_.vecPosition[ 1 ] = sample.position.v[ 1 ];
+	resampled_pose_.vecPosition[ 2 ] = sample.position.v[ 2 ];
+	resampled_pose_.qRotation = sample.rotation;
+
+	return &resampled_pose_;
+}
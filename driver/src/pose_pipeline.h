@@ -0,0 +1,128 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "imu_dead_reckoning.h"
+#include "motion_rate_governor.h"
+#include "pose_history.h"
+#include "openvr_driver.h"
+#include "tracker_state_table.h"
+
+// How one update should treat the pose, decided by the tracker's config at the time
+struct MyPipelineConfig
+{
+	// Submit our last known good pose in place of invalid ones. Position and rotation are judged separately, so when
+	// only one of them is any good, it stays live and just the other is held.
+	bool pose_locking_enabled;
+
+	// Hold our last known good pose even while the source is valid
+	bool is_force_locked;
+
+	// Update at this fixed period, or zero to let the motion rate governor decide
+	std::chrono::nanoseconds fixed_update_period;
+
+	// Submit fresh poses on an even grid, interpolated from the source's own samples resample_delay in the past,
+	// rather than whatever the source had when we happened to look
+	bool is_resampling;
+	std::chrono::nanoseconds resample_delay;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Everything that happens to one tracker's pose between reading it from its source and submitting it:
+// keeping track of whether it's valid, holding on to the last known good pose, and working out how soon the tracker
+// wants updating again. State goes in the tracker's slot of a state table.
+// It doesn't talk to vrserver, so the offline tools can run exactly what the driver runs.
+//-----------------------------------------------------------------------------
+class MyPosePipeline
+{
+public:
+	MyPosePipeline( MyTrackerStateTable &tracker_states, uint32_t slot );
+
+	// Where the next source pose should be built. Only valid until the next Update.
+	vr::DriverPose_t &GetSourcePose() { return pose_slots_[ 1 - good_pose_slot_ ]; }
+
+	// Runs the source pose through the pipeline. Returns the pose to submit, or nullptr if we have nothing to submit.
+	// The pose returned is only valid until the next Update.
+	const vr::DriverPose_t *Update( const MyPipelineConfig &config, std::chrono::steady_clock::time_point now );
+
+	// Feeds in the tracker's IMU samples, oldest first, ahead of the Update they arrived in time for. While locking,
+	// they carry on whatever we can't trust in the source pose, instead of it being held.
+	void AddImuSample( const vr::ImuSample_t &sample ) { imu_.AddSample( sample ); }
+
+	// Forgets the IMU, when its samples stop coming or start coming from somewhere else
+	void ResetImu() { imu_.Reset(); }
+
+	// Where something else, like a body model, reckons we are, for the next Update only. While locking, it stands in
+	// for whatever we can't trust in the source pose: position ahead of the IMU's, which soon wanders, and rotation
+	// behind it, since the gyro tracks our own rotation better than anything else can guess it.
+	void InferPose( const vr::HmdVector3d_t &position, const vr::HmdQuaternion_t &rotation )
+	{
+		inferred_position_ = position;
+		inferred_rotation_ = rotation;
+		has_inferred_pose_ = true;
+	}
+
+	// Our recent good poses, for anything that needs to know where we were at some other moment than now
+	const MyPoseHistory &GetPoseHistory() const { return pose_history_; }
+
+	MyTrackingState GetTrackingState() const { return tracking_state_; }
+	MyMotionClass GetMotionClass() const { return rate_governor_.GetMotionClass(); }
+
+	// For the offline tools, to try out other rate governor settings
+	void SetRateGovernorParams( const MyMotionRateGovernorParams &params ) { rate_governor_.SetParams( params ); }
+
+	// How long until the tracker wants its next update: the fixed period it was last updated with,
+	// or going by how fast it's moving
+	std::chrono::nanoseconds GetUpdatePeriod() const
+	{
+		return fixed_update_period_ != std::chrono::nanoseconds::zero() ? fixed_update_period_ : rate_governor_.GetUpdatePeriod();
+	}
+
+private:
+	void CheckChannels( const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point now, bool &is_position_good, bool &is_rotation_good );
+	const vr::DriverPose_t *Resample( const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point time );
+
+	MyTrackerStateTable &tracker_states_;
+	uint32_t slot_;
+
+	// Decides how often we need updating, based on how fast we're moving
+	MyMotionRateGovernor rate_governor_;
+
+	// Poses are built in place in one of two preallocated slots. The slot holding our last known good pose is never
+	// written to, so keeping a new good pose is just a matter of switching which slot is which. The exception is
+	// when only one channel of a source pose is good: that channel alone is copied over, so the good pose always has
+	// the last good position and the last good rotation, however far apart they came.
+	std::array< vr::DriverPose_t, 2 > pose_slots_;
+	int good_pose_slot_;
+
+	// When the good pose was last wholly good, and when its position and rotation were last good on their own,
+	// for judging how far the next ones could have moved
+	std::chrono::steady_clock::time_point good_pose_time_;
+	std::chrono::steady_clock::time_point good_position_time_;
+	std::chrono::steady_clock::time_point good_rotation_time_;
+
+	// The source's distinct samples. Reading the same sample twice doesn't add it again, so these are as far apart
+	// as the source's own updates are, not ours.
+	MyPoseHistory pose_history_;
+
+	std::chrono::nanoseconds fixed_update_period_;
+
+	// Carries on our pose from the last good one while we can't trust it, when we're given IMU samples
+	MyImuDeadReckoner imu_;
+
+	// What InferPose gave us for this Update, if anything
+	bool has_inferred_pose_;
+	vr::HmdVector3d_t inferred_position_;
+	vr::HmdQuaternion_t inferred_rotation_;
+
+	// Resampled poses are built here, so the good pose slot keeps the source's own pose
+	vr::DriverPose_t resampled_pose_;
+
+	// The grid point the last resampled pose was for. Zero when we aren't resampling.
+	std::chrono::steady_clock::time_point output_time_;
+
+	MyTrackingState tracking_state_;
+};
@@ -0,0 +1,349 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_pump.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "alloc_counter.h"
+#include "openvr_driver.h"
+#include "tracker_device_driver.h"
+#include "vrmath.h"
+
+// The longest the pump will sleep for when there are no trackers to update.
+static const std::chrono::milliseconds my_pump_idle_period( 20 );
+
+// How often we look at whether the HMD is being tracked, both while running and while parked waiting for it.
+static const std::chrono::milliseconds my_hmd_check_period( 100 );
+
+// The most time solving the body model may take each pass, before it settles for the estimate it has. Plenty for a
+// full rig, which normally converges in a few microseconds; it's there so a bad pass can't hold up the trackers.
+static const std::chrono::microseconds my_body_solve_budget( 100 );
+
+#ifdef _DEBUG
+// Update passes allowed to allocate while everything settles (e.g. vrserver setting up on first use),
+// after which the pump's loop must not touch the heap at all.
+static const uint64_t my_allocation_check_warmup_passes = 1000;
+#endif
+
+MyPosePump::MyPosePump()
+{
+	is_running_ = false;
+	phase_lock_enabled_ = false;
+	phase_lock_lead_time_ = std::chrono::microseconds::zero();
+	hmd_idle_park_time_ = std::chrono::milliseconds::zero();
+	is_in_standby_ = false;
+	wake_requested_ = false;
+	is_waiting_for_clock_ = false;
+
+	trackers_.fill( nullptr );
+	num_tracker_slots_ = 0;
+	is_in_schedule_.fill( false );
+	updating_slot_ = MyTrackerStateTable::k_unInvalidSlot;
+}
+
+void MyPosePump::SetHmdIdleParkTime( std::chrono::milliseconds park_time )
+{
+	hmd_idle_park_time_ = park_time;
+}
+
+void MyPosePump::EnablePhaseLock( std::chrono::microseconds lead_time )
+{
+	phase_lock_enabled_ = true;
+	phase_lock_lead_time_ = lead_time;
+}
+
+void MyPosePump::EnableSimulatedClock( std::chrono::nanoseconds step )
+{
+	clock_.Simulate( step );
+	phase_lock_enabled_ = false;
+}
+
+void MyPosePump::StepSimulatedClock()
+{
+	// Caught up once the pump is back to waiting for a time we haven't reached yet.
+	// A parked pump has nothing to catch up on.
+	const auto is_caught_up = [ this ] {
+		return !is_running_ || is_in_standby_ || ( is_waiting_for_clock_ && clock_.Now() < wait_deadline_ );
+	};
+
+	std::unique_lock< std::mutex > lock( wake_mutex_ );
+
+	// Anything that woke the pump since the last step (like a tracker being added) happens at the time it happened at
+	caught_up_condition_.wait( lock, is_caught_up );
+
+	clock_.Step();
+	wake_condition_.notify_one();
+
+	caught_up_condition_.wait( lock, is_caught_up );
+}
+
+void MyPosePump::Start()
+{
+	if ( !is_running_.exchange( true ) )
+	{
+		next_phase_lock_time_ = std::chrono::steady_clock::time_point();
+#ifdef _DEBUG
+		num_update_passes_ = 0;
+#endif
+		hmd_last_valid_time_ = clock_.Now();
+		next_hmd_check_time_ = hmd_last_valid_time_;
+		pump_thread_ = std::thread( &MyPosePump::MyPumpThread, this );
+	}
+}
+
+void MyPosePump::Stop()
+{
+	bool was_running;
+	{
+		// Change is_running_ under the wake lock, so a waiting pump can't miss the wakeup
+		std::lock_guard< std::mutex > lock( wake_mutex_ );
+		was_running = is_running_.exchange( false );
+	}
+
+	if ( was_running )
+	{
+		wake_condition_.notify_one();
+		caught_up_condition_.notify_all();
+		pump_thread_.join();
+	}
+}
+
+void MyPosePump::SetStandby( bool is_in_standby )
+{
+	{
+		std::lock_guard< std::mutex > lock( wake_mutex_ );
+		is_in_standby_ = is_in_standby;
+	}
+
+	caught_up_condition_.notify_all();
+
+	// Wake the pump, so we're back to updating poses within one tick of leaving standby,
+	// or parked straight away on entering it.
+	MyWake();
+}
+
+void MyPosePump::AddTracker( MyTrackerDeviceDriver *tracker )
+{
+	const uint32_t slot = tracker->MyGetStateSlot();
+	if ( slot >= MyTrackerStateTable::k_unMaxSlots )
+		return;
+
+	trackers_[ slot ] = tracker;
+	if ( slot >= num_tracker_slots_.load( std::memory_order_relaxed ) )
+		num_tracker_slots_.store( slot + 1, std::memory_order_release );
+
+	// Due straight away
+	tracker_states_.SetIsScheduled( slot, true );
+
+	MyWake();
+}
+
+void MyPosePump::RemoveTracker( MyTrackerDeviceDriver *tracker )
+{
+	const uint32_t slot = tracker->MyGetStateSlot();
+	if ( slot >= MyTrackerStateTable::k_unMaxSlots )
+		return;
+
+	// The pump won't start another update of ours from here on. If it had already started one, it's only one
+	// tracker's update, so it's cheaper to spin for it than to sleep.
+	tracker_states_.SetIsScheduled( slot, false );
+	while ( updating_slot_.load() == slot )
+		std::this_thread::yield();
+}
+
+void MyPosePump::MyPumpThread()
+{
+	while ( is_running_ )
+	{
+		const std::chrono::steady_clock::time_point now = clock_.Now();
+
+		if ( MyShouldPark( now ) )
+		{
+			std::unique_lock< std::mutex > lock( wake_mutex_ );
+
+			if ( is_in_standby_ )
+			{
+				// Nothing to do until LeaveStandby or Stop wakes us
+				wake_condition_.wait( lock, [ this ] { return !is_in_standby_ || !is_running_; } );
+
+				// Give the HMD a fresh idle period after waking, rather than parking again straight away
+				hmd_last_valid_time_ = clock_.Now();
+				next_hmd_check_time_ = hmd_last_valid_time_;
+			}
+			else
+			{
+				// Parked because the HMD isn't being tracked. Sleep until it's time to look again.
+				MyWaitUntil( lock, next_hmd_check_time_, [ this ] { return !is_running_; } );
+			}
+
+			continue;
+		}
+
+		std::chrono::steady_clock::time_point next_wake_time = now + my_pump_idle_period;
+
+		// In phase-locked mode, everyone is due when a compositor frame is about to start
+		bool is_phase_lock_update = false;
+		if ( phase_lock_enabled_ )
+		{
+			if ( next_phase_lock_time_ <= now )
+			{
+				is_phase_lock_update = next_phase_lock_time_ != std::chrono::steady_clock::time_point();
+				next_phase_lock_time_ = MyGetNextPhaseLockTime( now );
+			}
+
+			next_wake_time = std::min( next_wake_time, next_phase_lock_time_ );
+		}
+
+#ifdef _DEBUG
+		const uint64_t allocations_before_pass = MyGetThreadAllocationCount();
+#endif
+
+		// Lost trackers take their estimates from the body as the others left it last pass
+		MySolveBodyModel( now );
+
+		const uint32_t num_tracker_slots = num_tracker_slots_.load( std::memory_order_acquire );
+		for ( uint32_t slot = 0; slot < num_tracker_slots; slot++ )
+		{
+			// Claim the slot before checking it's still scheduled. Whichever of us and RemoveTracker goes second
+			// sees what the other did, so a removed tracker is either skipped or waited for.
+			updating_slot_.store( slot );
+			if ( !tracker_states_.IsScheduled( slot ) )
+			{
+				is_in_schedule_[ slot ] = false;
+				continue;
+			}
+
+			if ( !is_in_schedule_[ slot ] )
+			{
+				is_in_schedule_[ slot ] = true;
+				next_update_times_[ slot ] = now;
+			}
+
+			std::chrono::steady_clock::time_point &next_update_time = next_update_times_[ slot ];
+			if ( is_phase_lock_update || next_update_time <= now )
+			{
+				const std::chrono::nanoseconds period = trackers_[ slot ]->MyPoseUpdate( now );
+
+				// Keep to the tracker's cadence, but if we've fallen behind don't try to catch up with a burst of updates.
+				// A phase-locked update restarts the tracker's cadence from now.
+				next_update_time += period;
+				if ( is_phase_lock_update || next_update_time < now )
+					next_update_time = now + period;
+			}
+
+			next_wake_time = std::min( next_wake_time, next_update_time );
+		}
+		updating_slot_.store( MyTrackerStateTable::k_unInvalidSlot );
+
+#ifdef _DEBUG
+		// Poses are built in preallocated slots, so once we're warmed up an update pass should never allocate
+		if ( ++num_update_passes_ > my_allocation_check_warmup_passes )
+		{
+			assert( MyGetThreadAllocationCount() == allocations_before_pass && "Pose pump allocated on the heap" );
+		}
+#endif
+
+		std::unique_lock< std::mutex > lock( wake_mutex_ );
+		MyWaitUntil( lock, next_wake_time, [ this ] { return wake_requested_ || !is_running_; } );
+		wake_requested_ = false;
+	}
+}
+
+void MyPosePump::MyWake()
+{
+	{
+		std::lock_guard< std::mutex > lock( wake_mutex_ );
+		wake_requested_ = true;
+
+		// Whatever woke us needs seeing to before we've caught up with the clock
+		is_waiting_for_clock_ = false;
+	}
+
+	wake_condition_.notify_one();
+}
+
+template < class Predicate >
+void MyPosePump::MyWaitUntil( std::unique_lock< std::mutex > &lock, std::chrono::steady_clock::time_point deadline, Predicate should_wake )
+{
+	if ( !clock_.IsSimulated() )
+	{
+		wake_condition_.wait_until( lock, deadline, should_wake );
+		return;
+	}
+
+	// Simulated time only moves when it's stepped, so wait for a step to take us to the deadline,
+	// letting the stepper know we've caught up each time we go back to sleep.
+	wait_deadline_ = deadline;
+	while ( !should_wake() && clock_.Now() < deadline )
+	{
+		is_waiting_for_clock_ = true;
+		caught_up_condition_.notify_all();
+		wake_condition_.wait( lock );
+	}
+	is_waiting_for_clock_ = false;
+}
+
+bool MyPosePump::MyShouldPark( std::chrono::steady_clock::time_point now )
+{
+	{
+		std::lock_guard< std::mutex > lock( wake_mutex_ );
+		if ( is_in_standby_ )
+			return true;
+	}
+
+	if ( hmd_idle_park_time_ == std::chrono::milliseconds::zero() )
+		return false;
+
+	// A tracker following something other than the HMD is still of use to whoever's wearing it
+	const uint32_t num_tracker_slots = num_tracker_slots_.load( std::memory_order_acquire );
+	for ( uint32_t slot = 0; slot < num_tracker_slots; slot++ )
+	{
+		if ( tracker_states_.IsScheduled( slot ) && !trackers_[ slot ]->MyIsFollowingHmd() )
+			return false;
+	}
+
+	if ( now >= next_hmd_check_time_ )
+	{
+		next_hmd_check_time_ = now + my_hmd_check_period;
+
+		vr::TrackedDevicePose_t hmd_pose;
+		vr::VRServerDriverHost()->GetRawTrackedDevicePoses( 0.f, &hmd_pose, 1 );
+
+		if ( hmd_pose.bPoseIsValid )
+			hmd_last_valid_time_ = now;
+	}
+
+	// Nobody's wearing the headset, so nobody's looking at our trackers either
+	return now - hmd_last_valid_time_ >= hmd_idle_park_time_;
+}
+
+void MyPosePump::MySolveBodyModel( std::chrono::steady_clock::time_point now )
+{
+	if ( !body_model_.HasTrackerJoints( now ) )
+		return;
+
+	vr::TrackedDevicePose_t hmd_pose;
+	vr::VRServerDriverHost()->GetRawTrackedDevicePoses( 0.f, &hmd_pose, 1 );
+
+	const vr::HmdMatrix34_t &matrix = hmd_pose.mDeviceToAbsoluteTracking;
+	body_model_.Observe( MyBodyJoint_Head, { { matrix.m[ 0 ][ 3 ], matrix.m[ 1 ][ 3 ], matrix.m[ 2 ][ 3 ] } }, HmdQuaternion_FromMatrix( matrix ),
+		hmd_pose.bPoseIsValid && hmd_pose.eTrackingResult == vr::TrackingResult_Running_OK, now );
+
+	// On simulated time, a run has to come out the same however fast the host is, so the solve isn't cut short by
+	// real time and only stops on its own tolerance and pass limit
+	body_model_.Solve( now, clock_.IsSimulated() ? std::chrono::nanoseconds::zero() : my_body_solve_budget );
+}
+
+std::chrono::steady_clock::time_point MyPosePump::MyGetNextPhaseLockTime( std::chrono::steady_clock::time_point now )
+{
+	// If the compositor isn't giving us frame timings (e.g. no app running), just check back later.
+	// Trackers carry on with their own schedules in the meantime.
+	if ( !frame_phase_estimator_.Update( now ) )
+		return now + my_pump_idle_period;
+
+	// The first frame that starts far enough from now that we can still get in ahead of it
+	const std::chrono::steady_clock::time_point next_frame_time =
+		frame_phase_estimator_.GetNextFrameTime( now + phase_lock_lead_time_ + std::chrono::nanoseconds( 1 ) );
+
+	return next_frame_time - phase_lock_lead_time_;
+}
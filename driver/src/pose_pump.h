@@ -0,0 +1,148 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "body_model.h"
+#include "frame_phase_estimator.h"
+#include "pose_clock.h"
+#include "pose_recorder.h"
+#include "pose_trace_replay.h"
+#include "telemetry_segment.h"
+#include "tracker_state_table.h"
+
+class MyTrackerDeviceDriver;
+
+//-----------------------------------------------------------------------------
+// Purpose: Drives pose updates for all of our activated trackers from a single thread.
+// Each tracker is scheduled on its own deadline, at whatever period it asks for after each update.
+//-----------------------------------------------------------------------------
+class MyPosePump
+{
+public:
+	MyPosePump();
+
+	// Phase-locked mode: on top of each tracker's own schedule, update every tracker lead_time before each compositor
+	// frame starts, so the pose it samples is as fresh as possible. Must be called before Start.
+	void EnablePhaseLock( std::chrono::microseconds lead_time );
+
+	// Park the pump once the HMD has had no valid pose for this long, as long as every tracker follows the HMD. Trackers
+	// proxying other devices or replaying carry on regardless. Zero never parks. Must be called before Start.
+	void SetHmdIdleParkTime( std::chrono::milliseconds park_time );
+
+	// Run on simulated time that only moves when StepSimulatedClock is called, instead of the steady clock.
+	// Phase locking follows the compositor's real frame times, so it's turned off. Must be called before Start.
+	void EnableSimulatedClock( std::chrono::nanoseconds step );
+
+	// Moves simulated time forward one step, then waits until the pump has done every update that came due.
+	void StepSimulatedClock();
+
+	void Start();
+	void Stop();
+
+	// While the system is in standby, the pump is parked and does no pose work at all.
+	void SetStandby( bool is_in_standby );
+
+	// Trackers add themselves when they activate, and remove themselves when they deactivate.
+	// A newly added tracker is updated straight away, even if the pump was in the middle of waiting.
+	// RemoveTracker will not return while the pump is in the middle of updating that tracker, but it only ever waits for
+	// that one update to finish, never for the rest of the pump's pass.
+	void AddTracker( MyTrackerDeviceDriver *tracker );
+	void RemoveTracker( MyTrackerDeviceDriver *tracker );
+
+	// The time every update the pump makes is based on. Anything that runs alongside the pump reads the time from here too.
+	const MyPoseClock &GetClock() const { return clock_; }
+
+	// Hot state for every tracker the pump drives. Trackers take a slot in it when they're created.
+	MyTrackerStateTable &GetTrackerStates() { return tracker_states_; }
+
+	// Shared-memory telemetry for every tracker the pump drives, laid out by state table slot.
+	// Open it before Start to have the trackers publish into it.
+	MyTelemetrySegment &GetTelemetry() { return telemetry_; }
+
+	// Optional recording of every pose the trackers read and submit. Stop it only after the pump has stopped.
+	MyPoseRecorder &GetRecorder() { return pose_recorder_; }
+
+	// Recorded session that trackers can play back in place of their usual source. Open it before trackers activate.
+	MyPoseTraceReplay &GetReplay() { return pose_replay_; }
+
+	// The body our trackers are worn on. Trackers given a joint observe it as they update, and the pump solves it once
+	// per pass, ahead of updating them. Only for use from the pump.
+	MyBodyModel &GetBodyModel() { return body_model_; }
+
+private:
+	void MyPumpThread();
+
+	// Wakes the pump from whatever wait it's in
+	void MyWake();
+
+	// Waits on wake_condition_ until should_wake or the deadline, on whichever clock we're running on
+	template < class Predicate >
+	void MyWaitUntil( std::unique_lock< std::mutex > &lock, std::chrono::steady_clock::time_point deadline, Predicate should_wake );
+
+	// Whether there's any point updating poses right now
+	bool MyShouldPark( std::chrono::steady_clock::time_point now );
+
+	// Observes the HMD as the body's head and solves the body, if anyone's wearing it
+	void MySolveBodyModel( std::chrono::steady_clock::time_point now );
+
+	// Works out when we next need to submit ahead of a compositor frame, after the given time
+	std::chrono::steady_clock::time_point MyGetNextPhaseLockTime( std::chrono::steady_clock::time_point now );
+
+	MyPoseClock clock_;
+	MyTrackerStateTable tracker_states_;
+	MyTelemetrySegment telemetry_;
+	MyPoseRecorder pose_recorder_;
+	MyPoseTraceReplay pose_replay_;
+	MyBodyModel body_model_;
+
+	// Trackers by state table slot. A slot's tracker is set before the slot is first scheduled, and never changes.
+	// Whether the pump updates it is down to the slot's scheduled flag, so adding and removing trackers never takes a
+	// lock the pump holds while it works.
+	std::array< MyTrackerDeviceDriver *, MyTrackerStateTable::k_unMaxSlots > trackers_;
+	std::atomic< uint32_t > num_tracker_slots_; // One past the highest slot ever scheduled
+
+	// The pump's own schedule: when each slot is next due, and whether it was scheduled when we last looked, so a
+	// newly added tracker is due straight away
+	std::array< std::chrono::steady_clock::time_point, MyTrackerStateTable::k_unMaxSlots > next_update_times_;
+	std::array< bool, MyTrackerStateTable::k_unMaxSlots > is_in_schedule_;
+
+	// The slot the pump is updating, or k_unInvalidSlot. Set before it checks the slot is still scheduled, so
+	// RemoveTracker, which clears the flag before reading this, either stops the update or sees it to wait for.
+	std::atomic< uint32_t > updating_slot_;
+
+	bool phase_lock_enabled_;
+	std::chrono::microseconds phase_lock_lead_time_;
+	MyFramePhaseEstimator frame_phase_estimator_;
+	std::chrono::steady_clock::time_point next_phase_lock_time_;
+
+	std::chrono::milliseconds hmd_idle_park_time_;
+	std::chrono::steady_clock::time_point hmd_last_valid_time_;
+	std::chrono::steady_clock::time_point next_hmd_check_time_;
+
+	// All of the pump's waits are on wake_condition_, so Stop, LeaveStandby and AddTracker can cut them short.
+	// wake_mutex_ guards is_in_standby_ and wake_requested_.
+	std::mutex wake_mutex_;
+	std::condition_variable wake_condition_;
+	bool is_in_standby_;
+	bool wake_requested_;
+
+	// On simulated time, set while the pump is waiting for the clock to reach wait_deadline_, so StepSimulatedClock
+	// can tell when it's caught up. Also guarded by wake_mutex_.
+	std::condition_variable caught_up_condition_;
+	bool is_waiting_for_clock_;
+	std::chrono::steady_clock::time_point wait_deadline_;
+
+#ifdef _DEBUG
+	// Number of update passes the pump has made, so we can let it warm up before checking it for heap allocations
+	uint64_t num_update_passes_;
+#endif
+
+	std::atomic< bool > is_running_;
+	std::thread pump_thread_;
+};
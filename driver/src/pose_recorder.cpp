@@ -0,0 +1,313 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_recorder.h"
+
+#include <cstring>
+
+#include "driverlog.h"
+
+// How often the writer thread drains the ring. The pump never wakes it, so this bounds how full the ring gets.
+static const std::chrono::milliseconds my_writer_poll_period( 20 );
+
+// Records are written to the file in batches of at most this many
+static const uint32_t my_writer_batch_size = 1024;
+
+MyPoseRecorder::MyPoseRecorder()
+{
+	write_position_ = 0;
+	cached_read_position_ = 0;
+	num_dropped_records_ = 0;
+	read_position_ = 0;
+	file_ = nullptr;
+	has_failed_ = false;
+	is_recording_ = false;
+	position_resolution_m_ = 0.0;
+	file_offset_ = 0;
+}
+
+void MyPoseRecorder::EnableCompression( double position_resolution_m )
+{
+	position_resolution_m_ = position_resolution_m > 0.0 ? position_resolution_m : 0.0;
+}
+
+MyPoseRecorder::~MyPoseRecorder()
+{
+	Stop();
+}
+
+bool MyPoseRecorder::Start( const char *path, const std::array< const char *, MyTrackerStateTable::k_unMaxSlots > &serial_numbers,
+	std::chrono::steady_clock::time_point start_time )
+{
+	if ( IsRecording() )
+		return true;
+
+	file_ = fopen( path, "wb" );
+	if ( file_ == nullptr )
+	{
+		DriverLog( "Failed to open pose trace file %s", path );
+		return false;
+	}
+
+	has_failed_ = false;
+
+	const uint64_t session_start_unix_ns =
+		std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::system_clock::now().time_since_epoch() ).count();
+
+	if ( position_resolution_m_ > 0.0 )
+	{
+		MyCompressedPoseTraceHeader header = {};
+		memcpy( header.magic, my_compressed_pose_trace_magic, sizeof( header.magic ) );
+		header.version = my_compressed_pose_trace_version;
+		header.header_size = sizeof( MyCompressedPoseTraceHeader );
+		header.num_slots = MyTrackerStateTable::k_unMaxSlots;
+		header.samples_per_block = my_pose_trace_samples_per_block;
+		header.position_resolution_m = position_resolution_m_;
+		header.session_start_unix_ns = session_start_unix_ns;
+
+		for ( uint32_t slot = 0; slot < MyTrackerStateTable::k_unMaxSlots; slot++ )
+		{
+			if ( serial_numbers[ slot ] != nullptr )
+				snprintf( header.serial_numbers[ slot ], sizeof( header.serial_numbers[ slot ] ), "%s", serial_numbers[ slot ] );
+		}
+
+		MyWrite( &header, sizeof( header ), 1 );
+		file_offset_ = sizeof( header );
+
+		// A stream per slot and record kind, each delta coded on its own
+		encoders_.resize( MyTrackerStateTable::k_unMaxSlots * 2 );
+		for ( uint32_t stream = 0; stream < encoders_.size(); stream++ )
+		{
+			encoders_[ stream ].Begin( (uint8_t)( stream / 2 ), (uint8_t)( stream % 2 ), position_resolution_m_ );
+		}
+		block_index_.clear();
+	}
+	else
+	{
+		MyPoseTraceHeader header = {};
+		memcpy( header.magic, my_pose_trace_magic, sizeof( header.magic ) );
+		header.version = my_pose_trace_version;
+		header.header_size = sizeof( MyPoseTraceHeader );
+		header.record_size = sizeof( MyPoseTraceRecord );
+		header.num_slots = MyTrackerStateTable::k_unMaxSlots;
+		header.session_start_unix_ns = session_start_unix_ns;
+
+		for ( uint32_t slot = 0; slot < MyTrackerStateTable::k_unMaxSlots; slot++ )
+		{
+			if ( serial_numbers[ slot ] != nullptr )
+				snprintf( header.serial_numbers[ slot ], sizeof( header.serial_numbers[ slot ] ), "%s", serial_numbers[ slot ] );
+		}
+
+		MyWrite( &header, sizeof( header ), 1 );
+	}
+
+	if ( has_failed_ )
+	{
+		fclose( file_ );
+		file_ = nullptr;
+		encoders_.clear();
+		return false;
+	}
+
+	session_start_time_ = start_time;
+	write_position_ = 0;
+	cached_read_position_ = 0;
+	num_dropped_records_ = 0;
+	read_position_ = 0;
+
+	// The pump starts recording as soon as it sees this, so everything above has to be ready first
+	is_recording_.store( true, std::memory_order_release );
+	writer_thread_ = std::thread( &MyPoseRecorder::MyWriterThread, this );
+
+	DriverLog( "Recording poses to %s", path );
+	return true;
+}
+
+void MyPoseRecorder::Stop()
+{
+	{
+		std::lock_guard< std::mutex > lock( wake_mutex_ );
+		if ( !is_recording_.exchange( false ) )
+			return;
+	}
+
+	wake_condition_.notify_one();
+	writer_thread_.join();
+
+	// The pump has stopped, so whatever's left in the ring is all there's going to be
+	MyDrain();
+
+	if ( position_resolution_m_ > 0.0 && !has_failed_ )
+	{
+		MyFinishCompressedTrace();
+	}
+
+	if ( num_dropped_records_ > 0 )
+	{
+		DriverLog( "Pose recorder dropped %llu records because the writer fell behind", (unsigned long long)num_dropped_records_ );
+	}
+
+	// Whatever's still buffered is written out now, so this can fail too
+	if ( fclose( file_ ) != 0 && !has_failed_ )
+	{
+		MyFail();
+	}
+	file_ = nullptr;
+	encoders_.clear();
+	block_index_.clear();
+}
+
+void MyPoseRecorder::Record( uint32_t slot, MyPoseTraceRecordKind kind, const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point now )
+{
+	if ( !IsRecording() || has_failed_.load( std::memory_order_relaxed ) )
+		return;
+
+	const uint32_t write_position = write_position_.load( std::memory_order_relaxed );
+	if ( write_position - cached_read_position_ >= k_unRingSize )
+	{
+		cached_read_position_ = read_position_.load( std::memory_order_acquire );
+		if ( write_position - cached_read_position_ >= k_unRingSize )
+		{
+			num_dropped_records_++;
+			return;
+		}
+	}
+
+	MyPoseTraceRecord &record = ring_[ write_position & ( k_unRingSize - 1 ) ];
+	record.time_ns = std::chrono::duration_cast< std::chrono::nanoseconds >( now - session_start_time_ ).count();
+	record.slot = (uint8_t)slot;
+	record.kind = kind;
+	MyPoseToTraceRecord( pose, record );
+
+	write_position_.store( write_position + 1, std::memory_order_release );
+}
+
+void MyPoseRecorder::MyWriterThread()
+{
+	std::unique_lock< std::mutex > lock( wake_mutex_ );
+	while ( is_recording_ )
+	{
+		lock.unlock();
+		MyDrain();
+		lock.lock();
+
+		wake_condition_.wait_for( lock, my_writer_poll_period, [ this ] { return !is_recording_; } );
+	}
+}
+
+size_t MyPoseRecorder::MyDrain()
+{
+	size_t num_written = 0;
+
+	const uint32_t write_position = write_position_.load( std::memory_order_acquire );
+	uint32_t read_position = read_position_.load( std::memory_order_relaxed );
+
+	// Nothing more can be written, so just give the space back
+	if ( has_failed_ )
+	{
+		read_position_.store( write_position, std::memory_order_release );
+		return 0;
+	}
+
+	while ( read_position != write_position )
+	{
+		// Write contiguous runs straight out of the ring, stopping at the end of it or the end of a batch
+		const uint32_t ring_index = read_position & ( k_unRingSize - 1 );
+		uint32_t batch_size = write_position - read_position;
+		if ( batch_size > k_unRingSize - ring_index )
+			batch_size = k_unRingSize - ring_index;
+		if ( batch_size > my_writer_batch_size )
+			batch_size = my_writer_batch_size;
+
+		if ( position_resolution_m_ > 0.0 )
+		{
+			MyCompress( &ring_[ ring_index ], batch_size );
+		}
+		else
+		{
+			MyWrite( &ring_[ ring_index ], sizeof( MyPoseTraceRecord ), batch_size );
+		}
+
+		read_position += batch_size;
+		num_written += batch_size;
+
+		// Hand the space back to the pump as we go
+		read_position_.store( read_position, std::memory_order_release );
+	}
+
+	if ( num_written > 0 && !has_failed_ && fflush( file_ ) != 0 )
+		MyFail();
+
+	return num_written;
+}
+
+bool MyPoseRecorder::MyWrite( const void *data, size_t size, size_t count )
+{
+	if ( has_failed_ )
+		return false;
+
+	if ( fwrite( data, size, count, file_ ) != count )
+	{
+		MyFail();
+		return false;
+	}
+
+	return true;
+}
+
+void MyPoseRecorder::MyFail()
+{
+	DriverLog( "Pose recorder couldn't write to its trace file, so it's stopped recording. The trace ends with the last complete write." );
+	has_failed_.store( true, std::memory_order_relaxed );
+}
+
+void MyPoseRecorder::MyCompress( const MyPoseTraceRecord *records, uint32_t num_records )
+{
+	for ( uint32_t index = 0; index < num_records && !has_failed_; index++ )
+	{
+		const MyPoseTraceRecord &record = records[ index ];
+		if ( record.slot >= MyTrackerStateTable::k_unMaxSlots || record.kind > MyPoseTraceRecordKind_Submitted )
+			continue;
+
+		MyPoseBlockEncoder &encoder = encoders_[ record.slot * 2 + record.kind ];
+		encoder.Add( record );
+
+		if ( encoder.IsFull() )
+		{
+			MyWriteBlock( encoder );
+		}
+	}
+}
+
+void MyPoseRecorder::MyWriteBlock( MyPoseBlockEncoder &encoder )
+{
+	const MyPoseTraceBlockHeader &block = encoder.GetHeader();
+
+	if ( !MyWrite( &block, sizeof( block ), 1 ) || !MyWrite( encoder.GetPayload(), 1, block.payload_size ) )
+		return;
+
+	block_index_.push_back( { block, file_offset_ } );
+	file_offset_ += sizeof( block ) + block.payload_size;
+
+	encoder.Begin( block.slot, block.kind, position_resolution_m_ );
+}
+
+void MyPoseRecorder::MyFinishCompressedTrace()
+{
+	for ( MyPoseBlockEncoder &encoder : encoders_ )
+	{
+		if ( !encoder.IsEmpty() )
+		{
+			MyWriteBlock( encoder );
+		}
+	}
+
+	MyCompressedPoseTraceFooter footer = {};
+	footer.index_offset = file_offset_;
+	footer.num_blocks = block_index_.size();
+	memcpy( footer.magic, my_compressed_pose_trace_footer_magic, sizeof( footer.magic ) );
+
+	if ( MyWrite( block_index_.data(), sizeof( MyPoseTraceIndexEntry ), block_index_.size() ) )
+		MyWrite( &footer, sizeof( footer ), 1 );
+
+	encoders_.clear();
+	block_index_.clear();
+}
@@ -0,0 +1,97 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "openvr_driver.h"
+#include "pose_trace.h"
+#include "pose_trace_codec.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Records every source and submitted pose to a binary trace file (see pose_trace.h).
+// The pose pump pushes fixed-size records into a single-producer, single-consumer ring without locking or
+// allocating, and a background thread drains the ring to disk. If the writer falls behind, records are dropped
+// rather than making the pump wait.
+//-----------------------------------------------------------------------------
+class MyPoseRecorder
+{
+public:
+	MyPoseRecorder();
+	~MyPoseRecorder();
+
+	// Write a compressed trace, with positions quantized to this resolution, instead of raw records.
+	// Must be called before Start.
+	void EnableCompression( double position_resolution_m );
+
+	// Opens the trace file, writes its header and starts the writer thread. serial_numbers is indexed by state table
+	// slot, with nullptr for unused slots. Record times are relative to start_time, on the pump's clock.
+	// Returns false if the file couldn't be opened.
+	bool Start( const char *path, const std::array< const char *, MyTrackerStateTable::k_unMaxSlots > &serial_numbers,
+		std::chrono::steady_clock::time_point start_time );
+
+	// Writes out everything recorded so far and closes the file. The pose pump must have stopped first.
+	void Stop();
+
+	bool IsRecording() const { return is_recording_.load( std::memory_order_acquire ); }
+
+	// Called by the pose pump only
+	void Record( uint32_t slot, MyPoseTraceRecordKind kind, const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point now );
+
+private:
+	void MyWriterThread();
+
+	// Writes whatever's in the ring to the file. Returns how many records were written.
+	size_t MyDrain();
+
+	// Writes to the file, or fails the recording if it can't. Returns false once the recording has failed.
+	bool MyWrite( const void *data, size_t size, size_t count );
+	void MyFail();
+
+	// Adds records to their streams' blocks, writing out blocks as they fill
+	void MyCompress( const MyPoseTraceRecord *records, uint32_t num_records );
+	void MyWriteBlock( MyPoseBlockEncoder &encoder );
+
+	// Writes out any partly filled blocks, then the block index
+	void MyFinishCompressedTrace();
+
+	// Number of records the ring can hold. Must be a power of two. At 64 bytes a record, this is 1 MB,
+	// or about a quarter of a second of 16 trackers at 1 kHz, both source and submitted.
+	static const uint32_t k_unRingSize = 16384;
+
+	// Written by the pump only. Keeps its own copy of the read position, so it only has to look at the writer's
+	// cache line when the ring seems full.
+	alignas( MY_CACHE_LINE_SIZE ) std::atomic< uint32_t > write_position_;
+	uint32_t cached_read_position_;
+	uint64_t num_dropped_records_;
+
+	// Written by the writer thread only
+	alignas( MY_CACHE_LINE_SIZE ) std::atomic< uint32_t > read_position_;
+
+	alignas( MY_CACHE_LINE_SIZE ) MyPoseTraceRecord ring_[ k_unRingSize ];
+
+	std::chrono::steady_clock::time_point session_start_time_;
+	FILE *file_;
+
+	// Compression state, only used by the writer thread. A position resolution of zero means we write raw records.
+	double position_resolution_m_;
+	std::vector< MyPoseBlockEncoder > encoders_; // One per slot and record kind
+	std::vector< MyPoseTraceIndexEntry > block_index_;
+	uint64_t file_offset_;
+
+	// Set by the writer once the file can't be written to, e.g. because the disk is full. The pump stops recording,
+	// and whatever was already in the ring is thrown away. The trace ends with the last complete write.
+	std::atomic< bool > has_failed_;
+
+	std::atomic< bool > is_recording_;
+	std::mutex wake_mutex_;
+	std::condition_variable wake_condition_;
+	std::thread writer_thread_;
+};
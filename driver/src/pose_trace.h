@@ -0,0 +1,145 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstdint>
+
+#include "tracker_state_table.h"
+
+// Layout of a raw pose trace file: a MyPoseTraceHeader, then MyPoseTraceRecords until the end of the file.
+// Everything is little endian, as written by the machine that recorded it.
+
+// "STTRACE" plus a terminator
+static const char my_pose_trace_magic[ 8 ] = { 'S', 'T', 'T', 'R', 'A', 'C', 'E', 0 };
+
+// Bumped whenever the layout below changes in a way readers need to know about.
+static const uint32_t my_pose_trace_version = 1;
+
+static const uint32_t my_pose_trace_max_serial_length = 32;
+
+struct MyPoseTraceHeader
+{
+	char magic[ 8 ];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t record_size;
+	uint32_t num_slots;
+
+	// Wall clock time the session started, in nanoseconds since the Unix epoch. Record times are relative to it.
+	uint64_t session_start_unix_ns;
+
+	// Serial number of the tracker in each state table slot, or empty if the slot isn't in use
+	char serial_numbers[ MyTrackerStateTable::k_unMaxSlots ][ my_pose_trace_max_serial_length ];
+};
+
+enum MyPoseTraceRecordKind : uint8_t
+{
+	MyPoseTraceRecordKind_Source,    // A pose as read from the source (HMD offset or proxy target), before locking
+	MyPoseTraceRecordKind_Submitted, // A pose as we handed it to vrserver
+};
+
+struct MyPoseTraceRecord
+{
+	uint64_t time_ns; // Since the session started
+
+	uint8_t slot;
+	uint8_t kind;            // MyPoseTraceRecordKind
+	uint8_t pose_is_valid;
+	uint8_t tracking_result; // vr::ETrackingResult
+
+	float position[ 3 ];
+	float rotation[ 4 ]; // w, x, y, z
+	float velocity[ 3 ];
+	float angular_velocity[ 3 ];
+};
+
+static_assert( sizeof( MyPoseTraceRecord ) == 64, "Pose trace records are a fixed 64 bytes" );
+
+// Copies the parts of a pose a trace keeps into a record, leaving its time, slot and kind alone
+inline void MyPoseToTraceRecord( const vr::DriverPose_t &pose, MyPoseTraceRecord &record )
+{
+	record.pose_is_valid = pose.poseIsValid ? 1 : 0;
+	record.tracking_result = (uint8_t)pose.result;
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		record.position[ axis ] = (float)pose.vecPosition[ axis ];
+		record.velocity[ axis ] = (float)pose.vecVelocity[ axis ];
+		record.angular_velocity[ axis ] = (float)pose.vecAngularVelocity[ axis ];
+	}
+	record.rotation[ 0 ] = (float)pose.qRotation.w;
+	record.rotation[ 1 ] = (float)pose.qRotation.x;
+	record.rotation[ 2 ] = (float)pose.qRotation.y;
+	record.rotation[ 3 ] = (float)pose.qRotation.z;
+}
+
+// The other way around. Anything in the pose a trace doesn't keep is left alone.
+inline void MyPoseFromTraceRecord( const MyPoseTraceRecord &record, vr::DriverPose_t &pose )
+{
+	pose.poseIsValid = record.pose_is_valid != 0;
+	pose.result = (vr::ETrackingResult)record.tracking_result;
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		pose.vecPosition[ axis ] = record.position[ axis ];
+		pose.vecVelocity[ axis ] = record.velocity[ axis ];
+		pose.vecAngularVelocity[ axis ] = record.angular_velocity[ axis ];
+	}
+	pose.qRotation.w = record.rotation[ 0 ];
+	pose.qRotation.x = record.rotation[ 1 ];
+	pose.qRotation.y = record.rotation[ 2 ];
+	pose.qRotation.z = record.rotation[ 3 ];
+}
+
+// Layout of a compressed pose trace file: a MyCompressedPoseTraceHeader, then blocks, then an index of the blocks,
+// then a MyCompressedPoseTraceFooter. Each block is a MyPoseTraceBlockHeader followed by its payload. The index and
+// footer are only written when recording stops cleanly, so a reader that finds no footer walks the blocks instead.
+//
+// A block holds up to samples_per_block consecutive records of one kind from one slot. Positions and velocities are
+// quantized to position_resolution_m (per second, for velocities), angular velocities to
+// my_pose_trace_angular_velocity_resolution, and rotations are stored as their smallest three components.
+// Every value is delta coded against the block's previous sample as a zigzag LEB128 varint, starting from zero,
+// so any block can be decoded without the ones before it.
+
+// "STTRACEZ"
+static const char my_compressed_pose_trace_magic[ 8 ] = { 'S', 'T', 'T', 'R', 'A', 'C', 'E', 'Z' };
+
+// "STTINDEX", at the very end of a complete file
+static const char my_compressed_pose_trace_footer_magic[ 8 ] = { 'S', 'T', 'T', 'I', 'N', 'D', 'E', 'X' };
+
+static const uint32_t my_compressed_pose_trace_version = 1;
+
+static const double my_pose_trace_angular_velocity_resolution = 0.0001; // rad/s
+
+struct MyCompressedPoseTraceHeader
+{
+	char magic[ 8 ];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t num_slots;
+	uint32_t samples_per_block;
+	double position_resolution_m;
+	uint64_t session_start_unix_ns;
+	char serial_numbers[ MyTrackerStateTable::k_unMaxSlots ][ my_pose_trace_max_serial_length ];
+};
+
+struct MyPoseTraceBlockHeader
+{
+	uint64_t first_time_ns;
+	uint64_t last_time_ns;
+	uint32_t payload_size;
+	uint16_t num_samples;
+	uint8_t slot;
+	uint8_t kind; // MyPoseTraceRecordKind
+};
+
+// One per block, in the order the blocks were written
+struct MyPoseTraceIndexEntry
+{
+	MyPoseTraceBlockHeader block;
+	uint64_t offset; // Of the block's header, from the start of the file
+};
+
+struct MyCompressedPoseTraceFooter
+{
+	uint64_t index_offset;
+	uint64_t num_blocks;
+	char magic[ 8 ];
+};
@@ -0,0 +1,241 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_trace_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Each of the smallest three components of a unit quaternion is within +-1/sqrt(2), which we spread over 16 bits.
+static const double my_rotation_scale = 32767.0 * 1.4142135623730951;
+static const int64_t my_rotation_max = 32767;
+
+// Bits of a sample's flags byte
+static const uint8_t my_sample_flag_pose_is_valid = 1 << 0;
+static const int my_sample_largest_component_shift = 1; // Two bits: which rotation component was dropped
+static const uint8_t my_sample_flag_has_tracking_result = 1 << 3;
+
+// Worst case size of one encoded sample: flags, result, and 13 varints of at most 10 bytes
+static const size_t my_max_sample_size = 2 + 13 * 10;
+
+static inline uint64_t MyZigZag( int64_t value )
+{
+	return ( static_cast< uint64_t >( value ) << 1 ) ^ static_cast< uint64_t >( value >> 63 );
+}
+
+static inline int64_t MyUnZigZag( uint64_t value )
+{
+	return static_cast< int64_t >( value >> 1 ) ^ -static_cast< int64_t >( value & 1 );
+}
+
+static inline uint8_t *MyWriteVarint( uint8_t *out, uint64_t value )
+{
+	while ( value >= 0x80 )
+	{
+		*out++ = static_cast< uint8_t >( value ) | 0x80;
+		value >>= 7;
+	}
+	*out++ = static_cast< uint8_t >( value );
+	return out;
+}
+
+// Returns nullptr if the varint runs past end
+static inline const uint8_t *MyReadVarint( const uint8_t *in, const uint8_t *end, uint64_t &value )
+{
+	value = 0;
+	for ( int shift = 0; in < end && shift < 64; shift += 7 )
+	{
+		const uint8_t byte = *in++;
+		value |= static_cast< uint64_t >( byte & 0x7F ) << shift;
+		if ( ( byte & 0x80 ) == 0 )
+			return in;
+	}
+	return nullptr;
+}
+
+static inline int64_t MyQuantize( double value, double scale )
+{
+	return static_cast< int64_t >( std::llround( value * scale ) );
+}
+
+// Drops the largest component of the quaternion, flipping the sign of the whole thing so the dropped one is positive,
+// and quantizes the other three. Returns the index of the one we dropped.
+static int MyEncodeRotation( const float rotation[ 4 ], int64_t quantized[ 3 ] )
+{
+	int largest = 0;
+	for ( int component = 1; component < 4; component++ )
+	{
+		if ( std::fabs( rotation[ component ] ) > std::fabs( rotation[ largest ] ) )
+			largest = component;
+	}
+
+	const double sign = rotation[ largest ] < 0.f ? -1.0 : 1.0;
+
+	int out = 0;
+	for ( int component = 0; component < 4; component++ )
+	{
+		if ( component != largest )
+			quantized[ out++ ] = std::max( -my_rotation_max, std::min( my_rotation_max, MyQuantize( sign * rotation[ component ], my_rotation_scale ) ) );
+	}
+
+	return largest;
+}
+
+static void MyDecodeRotation( const int64_t quantized[ 3 ], int largest, float rotation[ 4 ] )
+{
+	double sum_of_squares = 0.0;
+	int in = 0;
+	for ( int component = 0; component < 4; component++ )
+	{
+		if ( component == largest )
+			continue;
+
+		const double value = quantized[ in++ ] / my_rotation_scale;
+		rotation[ component ] = static_cast< float >( value );
+		sum_of_squares += value * value;
+	}
+
+	rotation[ largest ] = static_cast< float >( std::sqrt( std::max( 0.0, 1.0 - sum_of_squares ) ) );
+}
+
+MyPoseBlockEncoder::MyPoseBlockEncoder()
+{
+	Begin( 0, 0, 0.0001 );
+}
+
+void MyPoseBlockEncoder::Begin( uint8_t slot, uint8_t kind, double position_resolution_m )
+{
+	header_ = {};
+	header_.slot = slot;
+	header_.kind = kind;
+
+	// Keeps its capacity from the last block, so after the first few blocks encoding doesn't allocate
+	payload_.clear();
+	previous_ = {};
+	position_scale_ = 1.0 / position_resolution_m;
+}
+
+void MyPoseBlockEncoder::Add( const MyPoseTraceRecord &record )
+{
+	MyPoseTraceCodecState current;
+
+	// Times only go forwards within a block, so they're stored unsigned
+	current.time_ns = std::max( record.time_ns, previous_.time_ns );
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		current.position[ axis ] = MyQuantize( record.position[ axis ], position_scale_ );
+		current.velocity[ axis ] = MyQuantize( record.velocity[ axis ], position_scale_ );
+		current.angular_velocity[ axis ] = MyQuantize( record.angular_velocity[ axis ], 1.0 / my_pose_trace_angular_velocity_resolution );
+	}
+	const int largest = MyEncodeRotation( record.rotation, current.rotation );
+	current.tracking_result = record.tracking_result;
+
+	// Make sure there's room for the worst case, then write straight into the buffer
+	const size_t used = payload_.size();
+	payload_.resize( used + my_max_sample_size );
+	uint8_t *out = payload_.data() + used;
+
+	const bool has_tracking_result = header_.num_samples == 0 || current.tracking_result != previous_.tracking_result;
+
+	*out++ = ( record.pose_is_valid ? my_sample_flag_pose_is_valid : 0 ) | static_cast< uint8_t >( largest << my_sample_largest_component_shift ) |
+			 ( has_tracking_result ? my_sample_flag_has_tracking_result : 0 );
+	out = MyWriteVarint( out, current.time_ns - previous_.time_ns );
+	if ( has_tracking_result )
+		*out++ = current.tracking_result;
+
+	for ( int axis = 0; axis < 3; axis++ )
+		out = MyWriteVarint( out, MyZigZag( current.position[ axis ] - previous_.position[ axis ] ) );
+	for ( int component = 0; component < 3; component++ )
+		out = MyWriteVarint( out, MyZigZag( current.rotation[ component ] - previous_.rotation[ component ] ) );
+	for ( int axis = 0; axis < 3; axis++ )
+		out = MyWriteVarint( out, MyZigZag( current.velocity[ axis ] - previous_.velocity[ axis ] ) );
+	for ( int axis = 0; axis < 3; axis++ )
+		out = MyWriteVarint( out, MyZigZag( current.angular_velocity[ axis ] - previous_.angular_velocity[ axis ] ) );
+
+	payload_.resize( out - payload_.data() );
+
+	if ( header_.num_samples == 0 )
+		header_.first_time_ns = current.time_ns;
+	header_.last_time_ns = current.time_ns;
+	header_.num_samples++;
+	header_.payload_size = static_cast< uint32_t >( payload_.size() );
+
+	previous_ = current;
+}
+
+MyPoseBlockDecoder::MyPoseBlockDecoder( const MyPoseTraceBlockHeader &header, const uint8_t *payload, double position_resolution_m )
+	: header_( header )
+{
+	cursor_ = payload;
+	end_ = payload + header.payload_size;
+	num_decoded_ = 0;
+	previous_ = {};
+	position_resolution_m_ = position_resolution_m;
+}
+
+uint64_t MyPoseBlockDecoder::PeekTime() const
+{
+	uint64_t time_delta_ns = 0;
+	if ( cursor_ >= end_ || MyReadVarint( cursor_ + 1, end_, time_delta_ns ) == nullptr )
+		return previous_.time_ns;
+
+	return previous_.time_ns + time_delta_ns;
+}
+
+bool MyPoseBlockDecoder::Next( MyPoseTraceRecord &record )
+{
+	if ( num_decoded_ >= header_.num_samples || cursor_ >= end_ )
+		return false;
+
+	const uint8_t flags = *cursor_++;
+
+	uint64_t value = 0;
+	cursor_ = MyReadVarint( cursor_, end_, value );
+	if ( cursor_ == nullptr )
+	{
+		cursor_ = end_;
+		return false;
+	}
+	previous_.time_ns += value;
+
+	if ( flags & my_sample_flag_has_tracking_result )
+	{
+		if ( cursor_ >= end_ )
+			return false;
+		previous_.tracking_result = *cursor_++;
+	}
+
+	// Twelve deltas, in the order they were written
+	int64_t *const fields[ 12 ] = {
+		&previous_.position[ 0 ], &previous_.position[ 1 ], &previous_.position[ 2 ],
+		&previous_.rotation[ 0 ], &previous_.rotation[ 1 ], &previous_.rotation[ 2 ],
+		&previous_.velocity[ 0 ], &previous_.velocity[ 1 ], &previous_.velocity[ 2 ],
+		&previous_.angular_velocity[ 0 ], &previous_.angular_velocity[ 1 ], &previous_.angular_velocity[ 2 ],
+	};
+	for ( int64_t *field : fields )
+	{
+		cursor_ = MyReadVarint( cursor_, end_, value );
+		if ( cursor_ == nullptr )
+		{
+			cursor_ = end_;
+			return false;
+		}
+		*field += MyUnZigZag( value );
+	}
+
+	num_decoded_++;
+
+	record.time_ns = previous_.time_ns;
+	record.slot = header_.slot;
+	record.kind = header_.kind;
+	record.pose_is_valid = ( flags & my_sample_flag_pose_is_valid ) ? 1 : 0;
+	record.tracking_result = previous_.tracking_result;
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		record.position[ axis ] = static_cast< float >( previous_.position[ axis ] * position_resolution_m_ );
+		record.velocity[ axis ] = static_cast< float >( previous_.velocity[ axis ] * position_resolution_m_ );
+		record.angular_velocity[ axis ] = static_cast< float >( previous_.angular_velocity[ axis ] * my_pose_trace_angular_velocity_resolution );
+	}
+	MyDecodeRotation( previous_.rotation, ( flags >> my_sample_largest_component_shift ) & 3, record.rotation );
+
+	return true;
+}
@@ -0,0 +1,73 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "pose_trace.h"
+
+// Samples per block of a compressed trace. Small enough that seeking into a block is cheap,
+// big enough that block headers and the index are a rounding error.
+static const uint32_t my_pose_trace_samples_per_block = 256;
+
+// The values a block delta codes each sample against
+struct MyPoseTraceCodecState
+{
+	uint64_t time_ns;
+	int64_t position[ 3 ];
+	int64_t rotation[ 3 ];
+	int64_t velocity[ 3 ];
+	int64_t angular_velocity[ 3 ];
+	uint8_t tracking_result;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Compresses a stream of records of one kind from one slot into blocks (see pose_trace.h).
+//-----------------------------------------------------------------------------
+class MyPoseBlockEncoder
+{
+public:
+	MyPoseBlockEncoder();
+
+	void Begin( uint8_t slot, uint8_t kind, double position_resolution_m );
+
+	// Records must come in time order
+	void Add( const MyPoseTraceRecord &record );
+
+	bool IsEmpty() const { return header_.num_samples == 0; }
+	bool IsFull() const { return header_.num_samples >= my_pose_trace_samples_per_block; }
+
+	// The block so far. Begin starts the next one.
+	const MyPoseTraceBlockHeader &GetHeader() const { return header_; }
+	const uint8_t *GetPayload() const { return payload_.data(); }
+
+private:
+	MyPoseTraceBlockHeader header_;
+	std::vector< uint8_t > payload_;
+	MyPoseTraceCodecState previous_;
+	double position_scale_;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads records back out of a block, in order. Doesn't allocate or hold on to anything but the payload.
+//-----------------------------------------------------------------------------
+class MyPoseBlockDecoder
+{
+public:
+	MyPoseBlockDecoder( const MyPoseTraceBlockHeader &header, const uint8_t *payload, double position_resolution_m );
+
+	// Fills in the next record, or returns false at the end of the block (or if it's corrupt)
+	bool Next( MyPoseTraceRecord &record );
+
+	// The time of the next record, without decoding it. Only valid if there is one.
+	uint64_t PeekTime() const;
+
+private:
+	MyPoseTraceBlockHeader header_;
+	const uint8_t *cursor_;
+	const uint8_t *end_;
+	uint32_t num_decoded_;
+	MyPoseTraceCodecState previous_;
+	double position_resolution_m_;
+};
@@ -0,0 +1,360 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_trace_replay.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "driverlog.h"
+#include "pose_trace_codec.h"
+
+MyPoseTraceReplay::MyPoseTraceReplay()
+{
+	mapping_ = nullptr;
+	mapping_size_ = 0;
+	serial_numbers_ = nullptr;
+	records_ = nullptr;
+	block_index_ = nullptr;
+	position_resolution_m_ = 0.0;
+	trace_start_ns_ = 0;
+	trace_end_ns_ = 0;
+	speed_ = 1.0;
+	loop_ = false;
+#if defined( _WIN32 )
+	file_handle_ = nullptr;
+	mapping_handle_ = nullptr;
+#endif
+}
+
+MyPoseTraceReplay::~MyPoseTraceReplay()
+{
+	Close();
+}
+
+bool MyPoseTraceReplay::Open( const char *path, double speed, bool loop, std::chrono::steady_clock::time_point start_time )
+{
+	Close();
+
+	const void *mapping = nullptr;
+
+#if defined( _WIN32 )
+	file_handle_ = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	LARGE_INTEGER file_size;
+	if ( file_handle_ == INVALID_HANDLE_VALUE || !GetFileSizeEx( file_handle_, &file_size ) || file_size.QuadPart < (LONGLONG)sizeof( MyPoseTraceHeader ) )
+	{
+		DriverLog( "Failed to open pose trace %s", path );
+		if ( file_handle_ != INVALID_HANDLE_VALUE )
+			CloseHandle( file_handle_ );
+		file_handle_ = nullptr;
+		return false;
+	}
+
+	mapping_size_ = (size_t)file_size.QuadPart;
+	mapping_handle_ = CreateFileMappingA( file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if ( mapping_handle_ != nullptr )
+		mapping = MapViewOfFile( mapping_handle_, FILE_MAP_READ, 0, 0, 0 );
+
+	if ( mapping == nullptr )
+	{
+		DriverLog( "Failed to map pose trace %s", path );
+		if ( mapping_handle_ != nullptr )
+			CloseHandle( mapping_handle_ );
+		CloseHandle( file_handle_ );
+		mapping_handle_ = nullptr;
+		file_handle_ = nullptr;
+		return false;
+	}
+#else
+	const int fd = open( path, O_RDONLY );
+	struct stat file_stat;
+	if ( fd < 0 || fstat( fd, &file_stat ) != 0 || file_stat.st_size < (off_t)sizeof( MyPoseTraceHeader ) )
+	{
+		DriverLog( "Failed to open pose trace %s", path );
+		if ( fd >= 0 )
+			close( fd );
+		return false;
+	}
+
+	mapping_size_ = (size_t)file_stat.st_size;
+	mapping = mmap( nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+	// The mapping keeps the file alive on its own
+	close( fd );
+
+	if ( mapping == MAP_FAILED )
+	{
+		DriverLog( "Failed to map pose trace %s", path );
+		return false;
+	}
+#endif
+
+	mapping_ = static_cast< const uint8_t * >( mapping );
+
+	const bool is_compressed = memcmp( mapping_, my_compressed_pose_trace_magic, sizeof( my_compressed_pose_trace_magic ) ) == 0;
+	if ( !( is_compressed ? MyIndexCompressedTrace() : MyIndexRawTrace() ) )
+	{
+		DriverLog( "%s isn't a pose trace we can play", path );
+		Close();
+		return false;
+	}
+
+	speed_ = speed > 0.0 ? speed : 1.0;
+	loop_ = loop;
+	start_time_ = start_time;
+
+	DriverLog( "Replaying %s pose trace %s at %.2fx speed%s", is_compressed ? "compressed" : "raw", path, speed_, loop_ ? ", looping" : "" );
+	return true;
+}
+
+bool MyPoseTraceReplay::MyIndexRawTrace()
+{
+	const MyPoseTraceHeader *header = reinterpret_cast< const MyPoseTraceHeader * >( mapping_ );
+	if ( memcmp( header->magic, my_pose_trace_magic, sizeof( header->magic ) ) != 0 || header->version != my_pose_trace_version ||
+		 header->header_size != sizeof( MyPoseTraceHeader ) || header->record_size != sizeof( MyPoseTraceRecord ) ||
+		 header->num_slots != MyTrackerStateTable::k_unMaxSlots )
+		return false;
+
+	serial_numbers_ = header->serial_numbers;
+	records_ = reinterpret_cast< const MyPoseTraceRecord * >( mapping_ + sizeof( MyPoseTraceHeader ) );
+
+	// A trace cut short by a crash may end part way through a record, which we ignore
+	const size_t num_records = ( mapping_size_ - sizeof( MyPoseTraceHeader ) ) / sizeof( MyPoseTraceRecord );
+
+	trace_start_ns_ = num_records > 0 ? records_[ 0 ].time_ns : 0;
+	trace_end_ns_ = trace_start_ns_;
+
+	for ( size_t index = 0; index < num_records; index++ )
+	{
+		const MyPoseTraceRecord &record = records_[ index ];
+		if ( record.kind != MyPoseTraceRecordKind_Source || record.slot >= MyTrackerStateTable::k_unMaxSlots )
+			continue;
+
+		// The pump records in time order, so each track comes out sorted
+		tracks_[ record.slot ].push_back( (uint32_t)index );
+		trace_start_ns_ = std::min( trace_start_ns_, record.time_ns );
+		trace_end_ns_ = std::max( trace_end_ns_, record.time_ns );
+	}
+
+	return true;
+}
+
+bool MyPoseTraceReplay::MyIndexCompressedTrace()
+{
+	const MyCompressedPoseTraceHeader *header = reinterpret_cast< const MyCompressedPoseTraceHeader * >( mapping_ );
+	if ( mapping_size_ < sizeof( MyCompressedPoseTraceHeader ) || header->version != my_compressed_pose_trace_version ||
+		 header->header_size != sizeof( MyCompressedPoseTraceHeader ) || header->num_slots != MyTrackerStateTable::k_unMaxSlots ||
+		 !( header->position_resolution_m > 0.0 ) || header->samples_per_block == 0 )
+		return false;
+
+	serial_numbers_ = header->serial_numbers;
+	position_resolution_m_ = header->position_resolution_m;
+
+	// The index is only written when recording stops cleanly. Without it, we find the blocks ourselves.
+	const MyCompressedPoseTraceFooter *footer = mapping_size_ >= sizeof( MyCompressedPoseTraceHeader ) + sizeof( MyCompressedPoseTraceFooter ) ?
+		reinterpret_cast< const MyCompressedPoseTraceFooter * >( mapping_ + mapping_size_ - sizeof( MyCompressedPoseTraceFooter ) ) : nullptr;
+	const bool has_index = footer != nullptr && memcmp( footer->magic, my_compressed_pose_trace_footer_magic, sizeof( footer->magic ) ) == 0 &&
+		footer->index_offset <= mapping_size_ - sizeof( MyCompressedPoseTraceFooter ) &&
+		footer->num_blocks <= ( mapping_size_ - sizeof( MyCompressedPoseTraceFooter ) - footer->index_offset ) / sizeof( MyPoseTraceIndexEntry );
+
+	uint64_t num_blocks;
+	uint64_t blocks_end;
+	if ( has_index )
+	{
+		block_index_ = reinterpret_cast< const MyPoseTraceIndexEntry * >( mapping_ + footer->index_offset );
+		num_blocks = footer->num_blocks;
+		blocks_end = footer->index_offset;
+	}
+	else
+	{
+		MyRecoverBlockIndex( header->samples_per_block );
+		if ( recovered_block_index_.empty() )
+		{
+			DriverLog( "Compressed pose trace has no block index and no complete blocks" );
+			return false;
+		}
+
+		const MyPoseTraceIndexEntry &last_entry = recovered_block_index_.back();
+		block_index_ = recovered_block_index_.data();
+		num_blocks = recovered_block_index_.size();
+		blocks_end = last_entry.offset + sizeof( MyPoseTraceBlockHeader ) + last_entry.block.payload_size;
+
+		DriverLog( "Compressed pose trace has no block index, so recording probably didn't stop cleanly. Recovered %llu blocks.",
+			(unsigned long long)num_blocks );
+	}
+
+	bool has_blocks = false;
+	for ( uint64_t index = 0; index < num_blocks; index++ )
+	{
+		const MyPoseTraceIndexEntry &entry = block_index_[ index ];
+		if ( entry.block.kind != MyPoseTraceRecordKind_Source || entry.block.slot >= MyTrackerStateTable::k_unMaxSlots ||
+			 entry.block.num_samples == 0 || entry.offset + sizeof( MyPoseTraceBlockHeader ) + entry.block.payload_size > blocks_end )
+			continue;
+
+		// Each stream's blocks are written in time order
+		tracks_[ entry.block.slot ].push_back( (uint32_t)index );
+		trace_start_ns_ = has_blocks ? std::min( trace_start_ns_, entry.block.first_time_ns ) : entry.block.first_time_ns;
+		trace_end_ns_ = has_blocks ? std::max( trace_end_ns_, entry.block.last_time_ns ) : entry.block.last_time_ns;
+		has_blocks = true;
+	}
+
+	return true;
+}
+
+void MyPoseTraceReplay::MyRecoverBlockIndex( uint32_t samples_per_block )
+{
+	recovered_block_index_.clear();
+
+	uint64_t offset = sizeof( MyCompressedPoseTraceHeader );
+	while ( offset + sizeof( MyPoseTraceBlockHeader ) <= mapping_size_ )
+	{
+		// Blocks are packed end to end, so their headers aren't aligned
+		MyPoseTraceBlockHeader block;
+		memcpy( &block, mapping_ + offset, sizeof( block ) );
+
+		const uint64_t payload_offset = offset + sizeof( MyPoseTraceBlockHeader );
+		if ( block.slot >= MyTrackerStateTable::k_unMaxSlots || block.kind > MyPoseTraceRecordKind_Submitted || block.num_samples == 0 ||
+			 block.num_samples > samples_per_block || block.last_time_ns < block.first_time_ns || block.payload_size > mapping_size_ - payload_offset )
+			break;
+
+		// The index starts with a copy of the first block's header, so a trace cut short part way through writing its
+		// index would otherwise have the index read as more blocks
+		if ( !recovered_block_index_.empty() && memcmp( &block, &recovered_block_index_.front().block, sizeof( block ) ) == 0 )
+			break;
+
+		recovered_block_index_.push_back( { block, offset } );
+		offset = payload_offset + block.payload_size;
+	}
+}
+
+void MyPoseTraceReplay::Close()
+{
+	if ( mapping_ == nullptr )
+		return;
+
+#if defined( _WIN32 )
+	UnmapViewOfFile( mapping_ );
+	CloseHandle( mapping_handle_ );
+	CloseHandle( file_handle_ );
+	mapping_handle_ = nullptr;
+	file_handle_ = nullptr;
+#else
+	munmap( const_cast< uint8_t * >( mapping_ ), mapping_size_ );
+#endif
+
+	mapping_ = nullptr;
+	mapping_size_ = 0;
+	serial_numbers_ = nullptr;
+	records_ = nullptr;
+	block_index_ = nullptr;
+	recovered_block_index_.clear();
+	trace_start_ns_ = 0;
+	trace_end_ns_ = 0;
+
+	for ( std::vector< uint32_t > &track : tracks_ )
+	{
+		track.clear();
+	}
+}
+
+uint32_t MyPoseTraceReplay::FindTrack( const char *serial_number ) const
+{
+	if ( !IsOpen() )
+		return MyTrackerStateTable::k_unInvalidSlot;
+
+	for ( uint32_t slot = 0; slot < MyTrackerStateTable::k_unMaxSlots; slot++ )
+	{
+		if ( !tracks_[ slot ].empty() &&
+			 strncmp( serial_numbers_[ slot ], serial_number, my_pose_trace_max_serial_length ) == 0 )
+			return slot;
+	}
+
+	return MyTrackerStateTable::k_unInvalidSlot;
+}
+
+const char *MyPoseTraceReplay::GetSerialNumber( uint32_t track ) const
+{
+	if ( !IsOpen() || track >= MyTrackerStateTable::k_unMaxSlots || tracks_[ track ].empty() )
+		return nullptr;
+
+	return serial_numbers_[ track ];
+}
+
+uint64_t MyPoseTraceReplay::MyGetTraceTime( std::chrono::steady_clock::time_point now ) const
+{
+	if ( now <= start_time_ )
+		return trace_start_ns_;
+
+	const uint64_t elapsed_ns = (uint64_t)( std::chrono::duration< double, std::nano >( now - start_time_ ).count() * speed_ );
+	const uint64_t trace_length_ns = trace_end_ns_ - trace_start_ns_;
+
+	if ( loop_ && trace_length_ns > 0 )
+		return trace_start_ns_ + elapsed_ns % trace_length_ns;
+
+	return trace_start_ns_ + std::min( elapsed_ns, trace_length_ns );
+}
+
+void MyPoseTraceReplay::GetPose( uint32_t track, std::chrono::steady_clock::time_point now, vr::DriverPose_t &pose ) const
+{
+	pose.poseIsValid = false;
+	pose.result = vr::TrackingResult_Uninitialized;
+
+	if ( !IsOpen() || track >= MyTrackerStateTable::k_unMaxSlots )
+		return;
+
+	// The last record at or before the trace time. That's exactly the pose the pump would have been seeing.
+	MyPoseTraceRecord record;
+	const uint64_t trace_time_ns = MyGetTraceTime( now );
+	if ( !( block_index_ != nullptr ? MyFindCompressedRecord( track, trace_time_ns, record ) : MyFindRawRecord( track, trace_time_ns, record ) ) )
+		return;
+
+	MyPoseFromTraceRecord( record, pose );
+}
+
+bool MyPoseTraceReplay::MyFindRawRecord( uint32_t track, uint64_t trace_time_ns, MyPoseTraceRecord &record ) const
+{
+	const std::vector< uint32_t > &indices = tracks_[ track ];
+
+	const auto next = std::upper_bound( indices.begin(), indices.end(), trace_time_ns,
+		[ this ]( uint64_t time_ns, uint32_t index ) { return time_ns < records_[ index ].time_ns; } );
+	if ( next == indices.begin() )
+		return false;
+
+	record = records_[ *( next - 1 ) ];
+	return true;
+}
+
+bool MyPoseTraceReplay::MyFindCompressedRecord( uint32_t track, uint64_t trace_time_ns, MyPoseTraceRecord &record ) const
+{
+	const std::vector< uint32_t > &blocks = tracks_[ track ];
+
+	// The last block that starts at or before the trace time holds the record we want
+	const auto next = std::upper_bound( blocks.begin(), blocks.end(), trace_time_ns,
+		[ this ]( uint64_t time_ns, uint32_t index ) { return time_ns < block_index_[ index ].block.first_time_ns; } );
+	if ( next == blocks.begin() )
+		return false;
+
+	const MyPoseTraceIndexEntry &entry = block_index_[ *( next - 1 ) ];
+	MyPoseBlockDecoder decoder( entry.block, mapping_ + entry.offset + sizeof( MyPoseTraceBlockHeader ), position_resolution_m_ );
+
+	// Decode up to the trace time. The block's first record is at or before it, so we always get at least one.
+	if ( !decoder.Next( record ) )
+		return false;
+
+	MyPoseTraceRecord next_record;
+	while ( decoder.PeekTime() <= trace_time_ns && decoder.Next( next_record ) )
+	{
+		record = next_record;
+	}
+
+	return true;
+}
@@ -0,0 +1,89 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "openvr_driver.h"
+#include "pose_trace.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Plays back the source poses of a recorded pose trace (see pose_trace.h) against the steady clock.
+// Raw and compressed traces both work. The file is memory mapped and indexed once on open. After that, looking up a
+// pose is a binary search (plus decoding part of one block, for a compressed trace) that doesn't allocate or change
+// any state, so the pump and vrserver's main thread can both do it at once.
+//-----------------------------------------------------------------------------
+class MyPoseTraceReplay
+{
+public:
+	MyPoseTraceReplay();
+	~MyPoseTraceReplay();
+
+	// Maps and indexes a trace. Playback starts from the beginning of the trace at start_time, running speed times
+	// as fast as it was recorded, and either wrapping around or holding the last pose when it reaches the end.
+	bool Open( const char *path, double speed, bool loop, std::chrono::steady_clock::time_point start_time );
+	void Close();
+
+	bool IsOpen() const { return mapping_ != nullptr; }
+
+	// The track recorded for the tracker with this serial number, or MyTrackerStateTable::k_unInvalidSlot if there isn't one
+	uint32_t FindTrack( const char *serial_number ) const;
+
+	// The serial number a track was recorded for, or nullptr if there's no such track
+	const char *GetSerialNumber( uint32_t track ) const;
+
+	// How long the trace runs for, at the speed it was recorded
+	std::chrono::nanoseconds GetDuration() const { return std::chrono::nanoseconds( trace_end_ns_ - trace_start_ns_ ); }
+
+	// Fills in the pose, validity and tracking result of the track's pose at time now.
+	// Before the track's first pose, the pose is left invalid.
+	void GetPose( uint32_t track, std::chrono::steady_clock::time_point now, vr::DriverPose_t &pose ) const;
+
+private:
+	// Build the per-track index for each kind of trace. Return false if the trace isn't one we can play.
+	bool MyIndexRawTrace();
+	bool MyIndexCompressedTrace();
+
+	// Rebuilds the block index of a compressed trace that has none, because recording never stopped cleanly, by walking
+	// the blocks from the start of the file. Stops at the first block that's cut short or doesn't look like one.
+	void MyRecoverBlockIndex( uint32_t samples_per_block );
+
+	// Where now falls in the trace, in trace time
+	uint64_t MyGetTraceTime( std::chrono::steady_clock::time_point now ) const;
+
+	// The last record in the track at or before the trace time. Returns false if there isn't one.
+	bool MyFindRawRecord( uint32_t track, uint64_t trace_time_ns, MyPoseTraceRecord &record ) const;
+	bool MyFindCompressedRecord( uint32_t track, uint64_t trace_time_ns, MyPoseTraceRecord &record ) const;
+
+	const uint8_t *mapping_;
+	size_t mapping_size_;
+
+	// Serial numbers by slot, from whichever header the trace has
+	const char ( *serial_numbers_ )[ my_pose_trace_max_serial_length ];
+
+	// Set for a raw trace
+	const MyPoseTraceRecord *records_;
+
+	// Set for a compressed trace. Points into the mapping, or at recovered_block_index_ if the trace has no index.
+	const MyPoseTraceIndexEntry *block_index_;
+	std::vector< MyPoseTraceIndexEntry > recovered_block_index_;
+	double position_resolution_m_;
+
+	// Each track's source records (raw trace) or blocks of source records (compressed trace), in time order
+	std::vector< uint32_t > tracks_[ MyTrackerStateTable::k_unMaxSlots ];
+
+	// Time of the first and last records in the trace
+	uint64_t trace_start_ns_;
+	uint64_t trace_end_ns_;
+
+	double speed_;
+	bool loop_;
+	std::chrono::steady_clock::time_point start_time_;
+
+#if defined( _WIN32 )
+	void *file_handle_;
+	void *mapping_handle_;
+#endif
+};
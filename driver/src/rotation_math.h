@@ -0,0 +1,33 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cmath>
+
+#include "openvr_driver.h"
+
+// Rotation helpers vrmath doesn't have, in double precision, for code on the pose pump's hot path
+
+// v rotated by unit quaternion q. Two cross products, rather than the two quaternion products of q * v * conj(q).
+inline vr::HmdVector3d_t MyRotate( const vr::HmdQuaternion_t &q, const vr::HmdVector3d_t &v )
+{
+	// t = 2 * cross(q.xyz, v); v' = v + w * t + cross(q.xyz, t)
+	const double tx = 2.0 * ( q.y * v.v[ 2 ] - q.z * v.v[ 1 ] );
+	const double ty = 2.0 * ( q.z * v.v[ 0 ] - q.x * v.v[ 2 ] );
+	const double tz = 2.0 * ( q.x * v.v[ 1 ] - q.y * v.v[ 0 ] );
+
+	return { { v.v[ 0 ] + q.w * tx + ( q.y * tz - q.z * ty ), v.v[ 1 ] + q.w * ty + ( q.z * tx - q.x * tz ),
+		v.v[ 2 ] + q.w * tz + ( q.x * ty - q.y * tx ) } };
+}
+
+// The angle between unit quaternions a and b, in radians, from 0 to pi. Worked out from the rotation between them
+// with atan2, which unlike acos of their dot product stays accurate for the tiny angles we mostly measure.
+inline double MyAngleBetween( const vr::HmdQuaternion_t &a, const vr::HmdQuaternion_t &b )
+{
+	// conj(b) * a
+	const double w = b.w * a.w + b.x * a.x + b.y * a.y + b.z * a.z;
+	const double x = b.w * a.x - a.w * b.x - ( b.y * a.z - b.z * a.y );
+	const double y = b.w * a.y - a.w * b.y - ( b.z * a.x - b.x * a.z );
+	const double z = b.w * a.z - a.w * b.z - ( b.x * a.y - b.y * a.x );
+
+	return 2.0 * std::atan2( std::sqrt( x * x + y * y + z * z ), std::fabs( w ) );
+}
@@ -0,0 +1,210 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "source_fusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "rotation_math.h"
+#include "vrmath.h"
+
+// How many samples of a source's offset we need before it's allowed to stand in for the primary
+static const uint32_t my_min_offset_samples = 30;
+
+// Once we've that many, offsets keep following at this rate per sample, in case a mount slips
+static const double my_offset_smoothing = 0.01;
+
+// How much a rotation is trusted from a source that's lost sight of whatever it tracks position by, and only has its
+// IMU to go on, next to one that's properly tracked
+static const double my_imu_only_rotation_weight = 0.2;
+
+static void MyGetPose( const vr::TrackedDevicePose_t &raw_pose, vr::HmdVector3d_t &position, vr::HmdQuaternion_t &rotation )
+{
+	const vr::HmdMatrix34_t &matrix = raw_pose.mDeviceToAbsoluteTracking;
+	position = { { matrix.m[ 0 ][ 3 ], matrix.m[ 1 ][ 3 ], matrix.m[ 2 ][ 3 ] } };
+	rotation = HmdQuaternion_FromMatrix( matrix );
+}
+
+// How far a source's position and rotation are to be trusted, going by how it's tracked
+static void MyGetConfidence( const vr::TrackedDevicePose_t &raw_pose, double &position_weight, double &rotation_weight )
+{
+	position_weight = 0.0;
+	rotation_weight = 0.0;
+
+	if ( !raw_pose.bPoseIsValid )
+		return;
+
+	switch ( raw_pose.eTrackingResult )
+	{
+	case vr::TrackingResult_Running_OK:
+		position_weight = 1.0;
+		rotation_weight = 1.0;
+		break;
+	case vr::TrackingResult_Running_OutOfRange:
+	case vr::TrackingResult_Calibrating_OutOfRange:
+	case vr::TrackingResult_Fallback_RotationOnly:
+		rotation_weight = my_imu_only_rotation_weight;
+		break;
+	default:
+		break;
+	}
+}
+
+MySourceFusion::MySourceFusion()
+{
+	for ( Source &source : sources_ )
+	{
+		source.device_index = vr::k_unTrackedDeviceIndexInvalid;
+		source.offset_position = {};
+		source.offset_rotation = { 1.0, 0.0, 0.0, 0.0 };
+		source.num_offset_samples = 0;
+	}
+
+	num_sources_ = 0;
+}
+
+void MySourceFusion::SetSources( const vr::TrackedDeviceIndex_t *device_indices, uint32_t num_sources )
+{
+	num_sources = std::min( num_sources, k_unMaxSources );
+	const bool is_new_primary = num_sources == 0 || num_sources_ == 0 || device_indices[ 0 ] != sources_[ 0 ].device_index;
+
+	for ( uint32_t index = 0; index < num_sources; index++ )
+	{
+		Source &source = sources_[ index ];
+		if ( is_new_primary || source.device_index != device_indices[ index ] || index >= num_sources_ )
+		{
+			source.device_index = device_indices[ index ];
+			source.offset_position = {};
+			source.offset_rotation = { 1.0, 0.0, 0.0, 0.0 };
+			source.num_offset_samples = 0;
+		}
+	}
+
+	num_sources_ = num_sources;
+}
+
+vr::TrackedDeviceIndex_t MySourceFusion::GetMaxDeviceIndex() const
+{
+	vr::TrackedDeviceIndex_t max_device_index = 0;
+	for ( uint32_t index = 0; index < num_sources_; index++ )
+		max_device_index = std::max( max_device_index, sources_[ index ].device_index );
+
+	return max_device_index;
+}
+
+void MySourceFusion::Fuse( const vr::TrackedDevicePose_t *raw_poses, vr::DriverPose_t &pose )
+{
+	const vr::TrackedDevicePose_t &primary_pose = raw_poses[ sources_[ 0 ].device_index ];
+	const bool is_primary_tracked = primary_pose.bPoseIsValid && primary_pose.eTrackingResult == vr::TrackingResult_Running_OK;
+
+	double position_sum[ 3 ] = {};
+	double rotation_sum[ 4 ] = {};
+	double total_position_weight = 0.0;
+	double total_rotation_weight = 0.0;
+
+	// Where the sources that only have rotation to go on put us, in case none has position either
+	double fallback_position_sum[ 3 ] = {};
+
+	for ( uint32_t index = 0; index < num_sources_; index++ )
+	{
+		Source &source = sources_[ index ];
+		const vr::TrackedDevicePose_t &raw_pose = raw_poses[ source.device_index ];
+
+		double position_weight, rotation_weight;
+		MyGetConfidence( raw_pose, position_weight, rotation_weight );
+
+		if ( index > 0 )
+		{
+			// Offsets are only learned from a properly tracked pair, and a source can't stand in until it has one
+			if ( is_primary_tracked && position_weight > 0.0 )
+				LearnOffset( source, raw_pose, primary_pose );
+
+			if ( source.num_offset_samples < my_min_offset_samples )
+				continue;
+		}
+
+		if ( rotation_weight == 0.0 )
+			continue;
+
+		// Where this source puts the primary
+		vr::HmdVector3d_t source_position;
+		vr::HmdQuaternion_t source_rotation;
+		MyGetPose( raw_pose, source_position, source_rotation );
+
+		const vr::HmdVector3d_t offset = MyRotate( source_rotation, source.offset_position );
+		const double position[ 3 ] = { source_position.v[ 0 ] + offset.v[ 0 ], source_position.v[ 1 ] + offset.v[ 1 ], source_position.v[ 2 ] + offset.v[ 2 ] };
+		vr::HmdQuaternion_t rotation = source_rotation * source.offset_rotation;
+
+		// q and -q are the same rotation, so line them all up the same way round before adding them
+		if ( total_rotation_weight > 0.0 &&
+			 rotation.w * rotation_sum[ 0 ] + rotation.x * rotation_sum[ 1 ] + rotation.y * rotation_sum[ 2 ] + rotation.z * rotation_sum[ 3 ] < 0.0 )
+			rotation = { -rotation.w, -rotation.x, -rotation.y, -rotation.z };
+
+		rotation_sum[ 0 ] += rotation.w * rotation_weight;
+		rotation_sum[ 1 ] += rotation.x * rotation_weight;
+		rotation_sum[ 2 ] += rotation.y * rotation_weight;
+		rotation_sum[ 3 ] += rotation.z * rotation_weight;
+		total_rotation_weight += rotation_weight;
+
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			position_sum[ axis ] += position[ axis ] * position_weight;
+			fallback_position_sum[ axis ] += position[ axis ] * rotation_weight;
+		}
+		total_position_weight += position_weight;
+	}
+
+	if ( total_rotation_weight == 0.0 )
+	{
+		// Nothing to go on at all: we're as lost as the primary is
+		pose.poseIsValid = false;
+		pose.result = primary_pose.eTrackingResult;
+		return;
+	}
+
+	// Valid either way, but without a properly tracked source the position is only a guess, so we say it's out of range
+	pose.poseIsValid = true;
+	pose.result = total_position_weight > 0.0 ? vr::TrackingResult_Running_OK : vr::TrackingResult_Running_OutOfRange;
+
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		pose.vecPosition[ axis ] =
+			total_position_weight > 0.0 ? position_sum[ axis ] / total_position_weight : fallback_position_sum[ axis ] / total_rotation_weight;
+	}
+
+	const double length = std::sqrt( rotation_sum[ 0 ] * rotation_sum[ 0 ] + rotation_sum[ 1 ] * rotation_sum[ 1 ] + rotation_sum[ 2 ] * rotation_sum[ 2 ] +
+									 rotation_sum[ 3 ] * rotation_sum[ 3 ] );
+	pose.qRotation = { rotation_sum[ 0 ] / length, rotation_sum[ 1 ] / length, rotation_sum[ 2 ] / length, rotation_sum[ 3 ] / length };
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Averages in one more sample of where the primary is in source's frame. A plain average to begin with,
+// then a slow moving one.
+//-----------------------------------------------------------------------------
+void MySourceFusion::LearnOffset( Source &source, const vr::TrackedDevicePose_t &source_pose, const vr::TrackedDevicePose_t &primary_pose )
+{
+	vr::HmdVector3d_t source_position, primary_position;
+	vr::HmdQuaternion_t source_rotation, primary_rotation;
+	MyGetPose( source_pose, source_position, source_rotation );
+	MyGetPose( primary_pose, primary_position, primary_rotation );
+
+	const vr::HmdVector3d_t offset_position = MyRotate( -source_rotation, { { primary_position.v[ 0 ] - source_position.v[ 0 ],
+																			  primary_position.v[ 1 ] - source_position.v[ 1 ],
+																			  primary_position.v[ 2 ] - source_position.v[ 2 ] } } );
+	vr::HmdQuaternion_t offset_rotation = -source_rotation * primary_rotation;
+
+	source.num_offset_samples++;
+	const double alpha = std::max( 1.0 / source.num_offset_samples, my_offset_smoothing );
+
+	for ( int axis = 0; axis < 3; axis++ )
+		source.offset_position.v[ axis ] += ( offset_position.v[ axis ] - source.offset_position.v[ axis ] ) * alpha;
+
+	// Rotations are averaged by lerping and renormalizing, which is close enough for samples this close together
+	const vr::HmdQuaternion_t &q = source.offset_rotation;
+	if ( q.w * offset_rotation.w + q.x * offset_rotation.x + q.y * offset_rotation.y + q.z * offset_rotation.z < 0.0 )
+		offset_rotation = { -offset_rotation.w, -offset_rotation.x, -offset_rotation.y, -offset_rotation.z };
+
+	vr::HmdQuaternion_t averaged = { q.w + ( offset_rotation.w - q.w ) * alpha, q.x + ( offset_rotation.x - q.x ) * alpha,
+		q.y + ( offset_rotation.y - q.y ) * alpha, q.z + ( offset_rotation.z - q.z ) * alpha };
+	const double length = std::sqrt( averaged.w * averaged.w + averaged.x * averaged.x + averaged.y * averaged.y + averaged.z * averaged.z );
+	source.offset_rotation = { averaged.w / length, averaged.x / length, averaged.y / length, averaged.z / length };
+}
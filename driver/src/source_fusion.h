@@ -0,0 +1,53 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "openvr_driver.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Fuses the poses of several real trackers mounted rigidly together into the pose of one, so a mount
+// with two pucks on it only drops out when both do. The first source is the primary, and the pose is its pose.
+// The others stand in for it through the offset from each to the primary, learned while both are tracked.
+// Sources are averaged, each weighted by how well it's tracked: position only comes from sources that are properly
+// tracked, while rotation also comes, less trusted, from ones that only have their IMU to go on. As one drops out,
+// the rest carry on without it.
+// The offsets it learns move on with every fused pose, and it's only fused while building a tracker's source pose on
+// the pose pump, so it keeps them unlocked.
+//-----------------------------------------------------------------------------
+class MySourceFusion
+{
+public:
+	static constexpr uint32_t k_unMaxSources = 4;
+
+	MySourceFusion();
+
+	// Which devices to fuse, primary first. A source's offset is forgotten when its device changes, or the primary does.
+	void SetSources( const vr::TrackedDeviceIndex_t *device_indices, uint32_t num_sources );
+
+	uint32_t GetNumSources() const { return num_sources_; }
+
+	// The highest device index of any source, so the caller knows how many raw poses to read
+	vr::TrackedDeviceIndex_t GetMaxDeviceIndex() const;
+
+	// Fuses the sources' poses from raw_poses, indexed by device, into pose's validity, result, position and rotation.
+	// Learns the offsets of whatever sources are tracked alongside the primary along the way.
+	void Fuse( const vr::TrackedDevicePose_t *raw_poses, vr::DriverPose_t &pose );
+
+private:
+	struct Source
+	{
+		vr::TrackedDeviceIndex_t device_index;
+
+		// The primary's pose in this source's frame, and how many samples it's been averaged over
+		vr::HmdVector3d_t offset_position;
+		vr::HmdQuaternion_t offset_rotation;
+		uint32_t num_offset_samples;
+	};
+
+	void LearnOffset( Source &source, const vr::TrackedDevicePose_t &source_pose, const vr::TrackedDevicePose_t &primary_pose );
+
+	std::array< Source, k_unMaxSources > sources_;
+	uint32_t num_sources_;
+};
@@ -0,0 +1,230 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "telemetry_segment.h"
+
+#include <cstdio>
+#include <cstring>
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "driverlog.h"
+
+// How many times ReadSlot retries a slot that's being written before giving up
+static const int my_read_slot_attempts = 16;
+
+static uint64_t MyToNanoseconds( std::chrono::steady_clock::time_point time )
+{
+	return std::chrono::duration_cast< std::chrono::nanoseconds >( time.time_since_epoch() ).count();
+}
+
+MyTelemetrySegment::MyTelemetrySegment()
+{
+	header_ = nullptr;
+	slots_ = nullptr;
+#if defined( _WIN32 )
+	mapping_handle_ = nullptr;
+#else
+	shm_fd_ = -1;
+#endif
+}
+
+MyTelemetrySegment::~MyTelemetrySegment()
+{
+	Close();
+}
+
+size_t MyTelemetrySegment::GetSegmentSize()
+{
+	return sizeof( MyTelemetryHeader ) + sizeof( MyTelemetrySlot ) * MyTrackerStateTable::k_unMaxSlots;
+}
+
+bool MyTelemetrySegment::Open()
+{
+	if ( IsOpen() )
+		return true;
+
+	const size_t segment_size = GetSegmentSize();
+	void *mapping = nullptr;
+
+#if defined( _WIN32 )
+	mapping_handle_ = CreateFileMappingA( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)segment_size, "Local\\" MY_TELEMETRY_SEGMENT_NAME );
+	if ( mapping_handle_ == nullptr )
+	{
+		DriverLog( "Failed to create telemetry segment (error %u)", (uint32_t)GetLastError() );
+		return false;
+	}
+
+	mapping = MapViewOfFile( mapping_handle_, FILE_MAP_ALL_ACCESS, 0, 0, segment_size );
+	if ( mapping == nullptr )
+	{
+		DriverLog( "Failed to map telemetry segment (error %u)", (uint32_t)GetLastError() );
+		CloseHandle( mapping_handle_ );
+		mapping_handle_ = nullptr;
+		return false;
+	}
+#else
+	shm_fd_ = shm_open( "/" MY_TELEMETRY_SEGMENT_NAME, O_CREAT | O_RDWR, 0644 );
+	if ( shm_fd_ < 0 )
+	{
+		DriverLog( "Failed to create telemetry segment" );
+		return false;
+	}
+
+	if ( ftruncate( shm_fd_, (off_t)segment_size ) != 0 ||
+		 ( mapping = mmap( nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd_, 0 ) ) == MAP_FAILED )
+	{
+		DriverLog( "Failed to map telemetry segment" );
+		close( shm_fd_ );
+		shm_fd_ = -1;
+		shm_unlink( "/" MY_TELEMETRY_SEGMENT_NAME );
+		return false;
+	}
+#endif
+
+	// The segment may be left over from a previous run, so start from a clean slate.
+	// Readers ignore it until the magic number is back.
+	header_ = static_cast< MyTelemetryHeader * >( mapping );
+	header_->magic.store( 0, std::memory_order_relaxed );
+	memset( static_cast< char * >( mapping ) + sizeof( MyTelemetryHeader ), 0, segment_size - sizeof( MyTelemetryHeader ) );
+
+	header_->version = my_telemetry_version;
+	header_->header_size = sizeof( MyTelemetryHeader );
+	header_->slot_size = sizeof( MyTelemetrySlot );
+	header_->num_slots = MyTrackerStateTable::k_unMaxSlots;
+	header_->reserved = 0;
+
+	slots_ = reinterpret_cast< MyTelemetrySlot * >( static_cast< char * >( mapping ) + sizeof( MyTelemetryHeader ) );
+	for ( uint32_t slot = 0; slot < MyTrackerStateTable::k_unMaxSlots; slot++ )
+	{
+		slots_[ slot ].data.device_index = vr::k_unTrackedDeviceIndexInvalid;
+	}
+
+	header_->magic.store( my_telemetry_magic, std::memory_order_release );
+
+	DriverLog( "Publishing telemetry to shared memory segment %s", MY_TELEMETRY_SEGMENT_NAME );
+	return true;
+}
+
+void MyTelemetrySegment::Close()
+{
+	if ( !IsOpen() )
+		return;
+
+	// Let anyone still reading know we've gone
+	header_->magic.store( 0, std::memory_order_release );
+
+#if defined( _WIN32 )
+	UnmapViewOfFile( header_ );
+	CloseHandle( mapping_handle_ );
+	mapping_handle_ = nullptr;
+#else
+	munmap( header_, GetSegmentSize() );
+	close( shm_fd_ );
+	shm_fd_ = -1;
+	shm_unlink( "/" MY_TELEMETRY_SEGMENT_NAME );
+#endif
+
+	header_ = nullptr;
+	slots_ = nullptr;
+}
+
+MyTelemetrySlotData *MyTelemetrySegment::MyBeginWrite( uint32_t slot )
+{
+	std::atomic< uint32_t > &sequence = slots_[ slot ].sequence;
+
+	// Odd while we're writing. The fence keeps our writes to the data from moving ahead of it.
+	sequence.store( sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+
+	return &slots_[ slot ].data;
+}
+
+void MyTelemetrySegment::MyEndWrite( uint32_t slot )
+{
+	std::atomic< uint32_t > &sequence = slots_[ slot ].sequence;
+	sequence.store( sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+void MyTelemetrySegment::BeginSlot( uint32_t slot, const char *serial_number, vr::TrackedDeviceIndex_t device_index )
+{
+	if ( !IsOpen() || slot >= MyTrackerStateTable::k_unMaxSlots )
+		return;
+
+	MyTelemetrySlotData *data = MyBeginWrite( slot );
+	memset( data, 0, sizeof( *data ) );
+	snprintf( data->serial_number, sizeof( data->serial_number ), "%s", serial_number );
+	data->device_index = device_index;
+	data->rotation[ 0 ] = 1.0;
+	MyEndWrite( slot );
+}
+
+void MyTelemetrySegment::EndSlot( uint32_t slot )
+{
+	if ( !IsOpen() || slot >= MyTrackerStateTable::k_unMaxSlots )
+		return;
+
+	// Keep the last state around for post-mortems, just mark the tracker as gone
+	MyTelemetrySlotData *data = MyBeginWrite( slot );
+	data->device_index = vr::k_unTrackedDeviceIndexInvalid;
+	data->tracking_state = MyTrackingState_Inactive;
+	MyEndWrite( slot );
+}
+
+void MyTelemetrySegment::Publish( uint32_t slot, const vr::DriverPose_t &submitted_pose, bool source_is_valid,
+	const MyTrackerStats &stats, std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point good_pose_time )
+{
+	if ( !IsOpen() || slot >= MyTrackerStateTable::k_unMaxSlots )
+		return;
+
+	MyTelemetrySlotData *data = MyBeginWrite( slot );
+
+	data->update_time_ns = MyToNanoseconds( now );
+	data->good_pose_time_ns = MyToNanoseconds( good_pose_time );
+
+	data->position[ 0 ] = submitted_pose.vecPosition[ 0 ];
+	data->position[ 1 ] = submitted_pose.vecPosition[ 1 ];
+	data->position[ 2 ] = submitted_pose.vecPosition[ 2 ];
+	data->rotation[ 0 ] = submitted_pose.qRotation.w;
+	data->rotation[ 1 ] = submitted_pose.qRotation.x;
+	data->rotation[ 2 ] = submitted_pose.qRotation.y;
+	data->rotation[ 3 ] = submitted_pose.qRotation.z;
+
+	data->source_is_valid = source_is_valid ? 1 : 0;
+	data->tracking_state = stats.state;
+	data->motion_class = stats.motion_class;
+
+	data->num_submissions = stats.num_submissions;
+	data->num_dropouts = stats.num_dropouts;
+	data->num_rejected_outliers = stats.num_rejected_outliers;
+	data->total_lock_duration_us = stats.total_lock_duration_us;
+	data->max_lock_duration_us = stats.max_lock_duration_us;
+	memcpy( data->update_interval_histogram, stats.update_interval_histogram, sizeof( data->update_interval_histogram ) );
+
+	MyEndWrite( slot );
+}
+
+bool MyTelemetrySegment::ReadSlot( const MyTelemetrySlot &slot, MyTelemetrySlotData &data )
+{
+	for ( int attempt = 0; attempt < my_read_slot_attempts; attempt++ )
+	{
+		const uint32_t sequence_before = slot.sequence.load( std::memory_order_acquire );
+		if ( sequence_before & 1 )
+			continue;
+
+		memcpy( &data, &slot.data, sizeof( data ) );
+
+		// Keeps the copy from moving past the second read of the sequence
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if ( slot.sequence.load( std::memory_order_relaxed ) == sequence_before )
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,116 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "openvr_driver.h"
+#include "tracker_state_table.h"
+
+// Name of the shared-memory segment. On Windows it's opened as "Local\simpletrackers_telemetry",
+// elsewhere as the POSIX shared memory object "/simpletrackers_telemetry".
+#define MY_TELEMETRY_SEGMENT_NAME "simpletrackers_telemetry"
+
+// 'STTL'. Only set once the header is filled in, so a reader that sees it can trust the rest of the header.
+static const uint32_t my_telemetry_magic = 0x4C545453;
+
+// Bumped whenever the layout below changes in a way readers need to know about.
+static const uint32_t my_telemetry_version = 1;
+
+struct alignas( MY_CACHE_LINE_SIZE ) MyTelemetryHeader
+{
+	std::atomic< uint32_t > magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t slot_size;  // Stride of the slot array that follows the header
+	uint32_t num_slots;
+	uint32_t reserved;
+};
+
+// One tracker's live state. Times are steady clock nanoseconds, so only differences between them mean anything.
+struct MyTelemetrySlotData
+{
+	vr::TrackedDeviceIndex_t device_index; // k_unTrackedDeviceIndexInvalid while the tracker isn't active
+	char serial_number[ 32 ];
+
+	uint64_t update_time_ns;    // When the pump last updated this tracker
+	uint64_t good_pose_time_ns; // When the source last gave us a valid pose
+
+	// The pose we last submitted
+	double position[ 3 ];
+	double rotation[ 4 ]; // w, x, y, z
+
+	uint8_t source_is_valid;
+	uint8_t tracking_state; // MyTrackingState
+	uint8_t motion_class;   // MyMotionClass
+	uint8_t reserved;
+
+	uint64_t num_submissions;
+	uint64_t num_dropouts;
+	uint64_t num_rejected_outliers;
+	uint64_t total_lock_duration_us;
+	uint64_t max_lock_duration_us;
+
+	// Counts of time between updates, bucketed by my_update_interval_bucket_bounds_us
+	uint64_t update_interval_histogram[ my_num_update_interval_buckets ];
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: A slot is guarded by a seqlock. The writer makes sequence odd, writes data, then makes it even again.
+// A reader copies data between two reads of sequence, and keeps the copy only if both reads were the same even
+// number. Readers never block the writer, so a monitor can poll at any rate without the pump noticing.
+//-----------------------------------------------------------------------------
+struct alignas( MY_CACHE_LINE_SIZE ) MyTelemetrySlot
+{
+	std::atomic< uint32_t > sequence;
+	MyTelemetrySlotData data;
+};
+
+static_assert( std::atomic< uint32_t >::is_always_lock_free, "Seqlocks are shared between processes, so must be lock free" );
+
+//-----------------------------------------------------------------------------
+// Purpose: Publishes per-tracker live state into a named shared-memory segment, for external monitors and the
+// config UI to read without any calls into vrserver. The segment is a MyTelemetryHeader followed by
+// MyTrackerStateTable::k_unMaxSlots slots, indexed by state table slot.
+//-----------------------------------------------------------------------------
+class MyTelemetrySegment
+{
+public:
+	MyTelemetrySegment();
+	~MyTelemetrySegment();
+
+	// Creates and maps the segment. Returns false if it couldn't, in which case publishing does nothing.
+	bool Open();
+	void Close();
+
+	bool IsOpen() const { return slots_ != nullptr; }
+
+	// Called on vrserver's main thread, while the pump isn't updating this slot (before AddTracker, after RemoveTracker)
+	void BeginSlot( uint32_t slot, const char *serial_number, vr::TrackedDeviceIndex_t device_index );
+	void EndSlot( uint32_t slot );
+
+	// Called by the pose pump only, after each update of a tracker
+	void Publish( uint32_t slot, const vr::DriverPose_t &submitted_pose, bool source_is_valid, const MyTrackerStats &stats,
+		std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point good_pose_time );
+
+	// Takes a consistent copy of a slot, as a reader in another process would. Returns false if the writer
+	// kept getting in the way.
+	static bool ReadSlot( const MyTelemetrySlot &slot, MyTelemetrySlotData &data );
+
+	static size_t GetSegmentSize();
+
+private:
+	MyTelemetrySlotData *MyBeginWrite( uint32_t slot );
+	void MyEndWrite( uint32_t slot );
+
+	MyTelemetryHeader *header_;
+	MyTelemetrySlot *slots_;
+
+#if defined( _WIN32 )
+	void *mapping_handle_;
+#else
+	int shm_fd_;
+#endif
+};
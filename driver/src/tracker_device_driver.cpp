@@ -1,7 +1,15 @@
 //============ Copyright (c) Valve Corporation, All rights reserved. ============
 #include "tracker_device_driver.h"
 
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
 #include "driverlog.h"
+#include "pose_pump.h"
+#include "rotation_math.h"
 #include "vrmath.h"
 
 
@@ -15,14 +23,204 @@ static const char *my_tracker_main_settings_section = "driver_simpletrackers";
 // These are the keys we want to retrieve the values for in the settings
 static const char *my_tracker_settings_key_model_number = "mytracker_model_number";
 
-MyTrackerDeviceDriver::MyTrackerDeviceDriver( unsigned int my_tracker_id )
+// Which of our input components are scalars. The rest are booleans.
+static const bool my_component_is_scalar[ MyComponent_MAX ] = {
+	false, // MyComponent_a_touch
+	false, // MyComponent_a_click
+	true,  // MyComponent_trigger_value
+	false, // MyComponent_trigger_click
+};
+
+// Highest fixed update rate set_rate accepts. Anything faster is more than vrserver wants from us.
+static const uint32_t my_max_update_rate_hz = 1000;
+
+// Room for each of the tracking system name and serial number in an IMU stream's path. The pump builds the path on
+// the stack, so it never touches the heap. Anything longer than this doesn't fit, and we won't find its stream.
+static const uint32_t my_imu_path_part_size = 128;
+
+// Layout of a packed MyPoseConfig
+static const uint64_t my_pose_config_target_mask = 0xFF;
+static const uint64_t my_pose_config_no_target = 0xFF;
+static const uint64_t my_pose_config_locking_bit = 1ull << 8;
+static const uint64_t my_pose_config_force_locked_bit = 1ull << 9;
+static const uint64_t my_pose_config_replaying_bit = 1ull << 10;
+static const uint64_t my_pose_config_resampling_bit = 1ull << 11;
+static const uint64_t my_pose_config_imu_bit = 1ull << 12;
+static const int my_pose_config_rate_shift = 16;
+static const uint64_t my_pose_config_rate_mask = 0xFFFF;
+static const int my_pose_config_resample_delay_shift = 32;
+static const uint64_t my_pose_config_resample_delay_mask = 0xFFFF;
+static const int my_pose_config_body_joint_shift = 48;
+static const uint64_t my_pose_config_body_joint_mask = 0xF;
+
+static_assert( MyBodyJoint_None <= my_pose_config_body_joint_mask, "Body joints don't fit in a packed MyPoseConfig" );
+
+// Layout of our packed fusion targets: one device index per byte, 0xFF for none
+static const uint64_t my_no_fusion_targets = ~0ull;
+static const uint64_t my_fusion_target_mask = 0xFF;
+static const uint32_t my_max_fusion_targets = MySourceFusion::k_unMaxSources - 1;
+
+// Parses a list of device indices to fuse with our proxy target, like "5,7", or "none". Returns false if it isn't one.
+static bool MyParseFusionTargets( const char *list, uint64_t &packed )
+{
+	packed = my_no_fusion_targets;
+	if ( *list == 0 || strcmp( list, "none" ) == 0 )
+		return true;
+
+	uint32_t num_targets = 0;
+	for ( const char *cursor = list;; cursor++ )
+	{
+		char *end = nullptr;
+		const long target_index = strtol( cursor, &end, 10 );
+		if ( end == cursor || target_index < 0 || target_index >= (long)vr::k_unMaxTrackedDeviceCount || num_targets >= my_max_fusion_targets )
+			return false;
+
+		packed &= ~( my_fusion_target_mask << ( 8 * num_targets ) );
+		packed |= (uint64_t)target_index << ( 8 * num_targets );
+		num_targets++;
+
+		cursor = end;
+		if ( *cursor == 0 )
+			return true;
+		if ( *cursor != ',' )
+			return false;
+	}
+}
+
+bool MyMountOffset::Parse( const char *text, MyMountOffset &offset )
+{
+	offset.is_identity = true;
+	offset.translation = {};
+	offset.rotation = HmdQuaternion_Identity;
+
+	if ( *text == 0 || strcmp( text, "none" ) == 0 )
+		return true;
+
+	double x, y, z, yaw, pitch, roll;
+	int num_chars = 0;
+	if ( sscanf( text, "%lf , %lf , %lf , %lf , %lf , %lf%n", &x, &y, &z, &yaw, &pitch, &roll, &num_chars ) != 6 || text[ num_chars ] != 0 )
+		return false;
+
+	// The only trig the offset ever needs, done once here. Each angle is turned into its own rotation, so they're
+	// applied in the order we say, whatever order vrmath would combine them in.
+	const vr::HmdQuaternion_t yaw_rotation = HmdQuaternion_FromEulerAngles( 0.0, 0.0, DEG_TO_RAD( yaw ) );
+	const vr::HmdQuaternion_t pitch_rotation = HmdQuaternion_FromEulerAngles( 0.0, DEG_TO_RAD( pitch ), 0.0 );
+	const vr::HmdQuaternion_t roll_rotation = HmdQuaternion_FromEulerAngles( DEG_TO_RAD( roll ), 0.0, 0.0 );
+
+	offset.translation = { { x, y, z } };
+	offset.rotation = yaw_rotation * pitch_rotation * roll_rotation;
+	offset.is_identity = x == 0.0 && y == 0.0 && z == 0.0 && yaw == 0.0 && pitch == 0.0 && roll == 0.0;
+	return true;
+}
+
+void MyMountOffset::Apply( vr::DriverPose_t &pose ) const
 {
-	// Set a member to keep track of whether we've activated yet or not
-	is_active_ = false;
-	has_last_known_good_pose_ = false;
-	pose_locking_enabled_ = false;
-	proxy_mode_enabled_ = false;
-	target_device_index_ = vr::k_unTrackedDeviceIndexInvalid; // k_unTrackedDeviceIndexInvalid means no device
+	if ( is_identity )
+		return;
+
+	const vr::HmdVector3d_t offset = MyRotate( pose.qRotation, translation );
+	pose.vecPosition[ 0 ] += offset.v[ 0 ];
+	pose.vecPosition[ 1 ] += offset.v[ 1 ];
+	pose.vecPosition[ 2 ] += offset.v[ 2 ];
+	pose.qRotation = pose.qRotation * rotation;
+}
+
+void MyMountOffset::ApplyToImuSample( vr::ImuSample_t &sample ) const
+{
+	if ( is_identity )
+		return;
+
+	// The pose turns by rotation on its right, so its own axes are rotation's inverse of the device's
+	sample.vAccel = MyRotate( -rotation, sample.vAccel );
+	sample.vGyro = MyRotate( -rotation, sample.vGyro );
+}
+
+// Longest resampling delay, in ms. Anything longer is more lag than it's worth, and wouldn't fit in our config.
+static const float my_max_resample_delay_ms = 50.f;
+
+uint64_t MyPoseConfig::Pack() const
+{
+	uint64_t packed = target_device_index < vr::k_unMaxTrackedDeviceCount ? target_device_index : my_pose_config_no_target;
+	if ( pose_locking_enabled )
+		packed |= my_pose_config_locking_bit;
+	if ( is_force_locked )
+		packed |= my_pose_config_force_locked_bit;
+	if ( is_replaying )
+		packed |= my_pose_config_replaying_bit;
+	if ( is_resampling )
+		packed |= my_pose_config_resampling_bit;
+	if ( is_using_imu )
+		packed |= my_pose_config_imu_bit;
+	packed |= ( update_rate_hz & my_pose_config_rate_mask ) << my_pose_config_rate_shift;
+	packed |= ( resample_delay_us & my_pose_config_resample_delay_mask ) << my_pose_config_resample_delay_shift;
+	packed |= ( (uint64_t)body_joint & my_pose_config_body_joint_mask ) << my_pose_config_body_joint_shift;
+	return packed;
+}
+
+MyPoseConfig MyPoseConfig::Unpack( uint64_t packed )
+{
+	MyPoseConfig config;
+	const uint64_t target = packed & my_pose_config_target_mask;
+	config.target_device_index = target == my_pose_config_no_target ? vr::k_unTrackedDeviceIndexInvalid : (vr::TrackedDeviceIndex_t)target;
+	config.pose_locking_enabled = ( packed & my_pose_config_locking_bit ) != 0;
+	config.is_force_locked = ( packed & my_pose_config_force_locked_bit ) != 0;
+	config.is_replaying = ( packed & my_pose_config_replaying_bit ) != 0;
+	config.is_resampling = ( packed & my_pose_config_resampling_bit ) != 0;
+	config.is_using_imu = ( packed & my_pose_config_imu_bit ) != 0;
+	config.update_rate_hz = (uint32_t)( ( packed >> my_pose_config_rate_shift ) & my_pose_config_rate_mask );
+	config.resample_delay_us = (uint32_t)( ( packed >> my_pose_config_resample_delay_shift ) & my_pose_config_resample_delay_mask );
+	config.body_joint = (MyBodyJoint)( ( packed >> my_pose_config_body_joint_shift ) & my_pose_config_body_joint_mask );
+	return config;
+}
+
+// Names for our stats, as they appear in DebugRequest responses
+static const char *const my_tracking_state_names[ MyTrackingState_MAX ] = {
+	"inactive",
+	"tracking",
+	"locked",
+	"lost",
+	"partly_locked",
+};
+
+static const char *const my_motion_class_names[ MyMotionClass_MAX ] = {
+	"static",
+	"slow",
+	"fast",
+};
+
+MyTrackerDeviceDriver::MyTrackerDeviceDriver( unsigned int my_tracker_id, MyPosePump &pose_pump, MyDeviceIndexTable &device_index_table )
+	: pose_pump_( pose_pump ), device_index_table_( device_index_table ), tracker_states_( pose_pump.GetTrackerStates() ),
+	  // Our slot in the state table keeps track of whether we've activated yet or not, and starts out inactive
+	  state_slot_( tracker_states_.AllocateSlot() ), telemetry_( pose_pump.GetTelemetry() ), pose_recorder_( pose_pump.GetRecorder() ),
+	  pose_replay_( pose_pump.GetReplay() ), pose_pipeline_( tracker_states_, state_slot_ )
+{
+	replay_track_ = MyTrackerStateTable::k_unInvalidSlot;
+	// No proxy target, no locking, no resampling, no IMU, no body joint and the governor choosing our rate, until our
+	// settings say otherwise
+	pose_config_ = MyPoseConfig{ vr::k_unTrackedDeviceIndexInvalid, false, false, false, 0, false, 0, false, MyBodyJoint_None }.Pack();
+
+	fusion_targets_ = my_no_fusion_targets;
+
+	// Until we've submitted anything, GetPose has an invalid pose to give, with the valid quaternions every pose needs
+	submitted_pose_ = {};
+	submitted_pose_.qWorldFromDriverRotation.w = 1.0;
+	submitted_pose_.qDriverFromHeadRotation.w = 1.0;
+	submitted_pose_.qRotation.w = 1.0;
+	submitted_pose_.result = vr::TrackingResult_Uninitialized;
+	submitted_pose_.deviceIsConnected = true;
+	submitted_pose_sequence_ = 0;
+
+	MyMountOffset::Parse( "none", mount_offset_ );
+	shared_mount_offset_ = mount_offset_;
+	mount_offset_sequence_ = 0;
+	mount_offset_copied_sequence_ = 0;
+
+	imu_buffer_ = vr::k_ulInvalidIOBufferHandle;
+	imu_device_index_ = vr::k_unTrackedDeviceIndexInvalid;
+
+	// Our inputs start released. Nothing is sent until we've activated and have handles to send to.
+	input_values_.fill( 0.f );
+	dirty_input_mask_ = 0;
 
 	my_tracker_id_ = my_tracker_id;
 
@@ -36,6 +234,14 @@ MyTrackerDeviceDriver::MyTrackerDeviceDriver( unsigned int my_tracker_id )
 	// IServerTrackedDeviceProvider
 	my_device_serial_number_ = my_device_model_number_ + std::to_string( my_tracker_id );
 
+	// The settings key holding our proxy target, e.g., "proxy_target_for_MyTrackerModelNumber10".
+	// Built once here, rather than every time our settings are reloaded.
+	proxy_settings_key_ = "proxy_target_for_" + my_device_serial_number_;
+	imu_settings_key_ = "use_imu_for_" + my_device_serial_number_;
+	body_joint_settings_key_ = "body_joint_for_" + my_device_serial_number_;
+	fusion_settings_key_ = "fusion_targets_for_" + my_device_serial_number_;
+	mount_offset_settings_key_ = "mount_offset_for_" + my_device_serial_number_;
+
 	// Here's an example of how to use our logging wrapper around IVRDriverLog
 	// In SteamVR logs (SteamVR Hamburger Menu > Developer Settings > Web console) drivers have a prefix of
 	// "<driver_name>:". You can search this in the top search bar to find the info that you've logged.
@@ -49,15 +255,19 @@ MyTrackerDeviceDriver::MyTrackerDeviceDriver( unsigned int my_tracker_id )
 //-----------------------------------------------------------------------------
 vr::EVRInitError MyTrackerDeviceDriver::Activate( uint32_t unObjectId )
 {
-	// Set an member to keep track of whether we've activated yet or not
-	is_active_ = true;
+	// Set our slot in the state table to keep track of whether we've activated yet or not
+	tracker_states_.ExchangeIsActive( state_slot_, true );
 
 	// Let's keep track of our device index. It'll be useful later.
-	my_device_index_ = unObjectId;
+	tracker_states_.SetDeviceIndex( state_slot_, unObjectId );
+
+	// Events for our device index come straight to us from now on
+	if ( unObjectId < vr::k_unMaxTrackedDeviceCount )
+		device_index_table_[ unObjectId ] = this;
 
 	// Properties are stored in containers, usually one container per device index. We need to get this container to set
 	// The properties we want, so we call this to retrieve a handle to it.
-	vr::PropertyContainerHandle_t container = vr::VRProperties()->TrackedDeviceToPropertyContainer( my_device_index_ );
+	vr::PropertyContainerHandle_t container = vr::VRProperties()->TrackedDeviceToPropertyContainer( unObjectId );
 
 	// Let's begin setting up the properties now we've got our container.
 	// A list of properties available is contained in vr::ETrackedDeviceProperty.
@@ -67,24 +277,16 @@ vr::EVRInitError MyTrackerDeviceDriver::Activate( uint32_t unObjectId )
 
 	// --- Our new code to read settings ---
 	// Let's get the settings to see if we should enable pose locking for this device
-	const char* settings_section = "PoseLockDriver";
-	const char* settings_key = "enabled_trackers";
-	char enabled_trackers_buffer[1024];
-	vr::VRSettings()->GetString(settings_section, settings_key, enabled_trackers_buffer, sizeof(enabled_trackers_buffer));
+	MyReloadSettings();
+	// --- End of our new code ---
 
-	// Check if our serial number is in the list.
-	// This is a simple substring search. A more robust solution would be to parse the comma-separated list.
-	if (std::string(enabled_trackers_buffer).find(my_device_serial_number_) != std::string::npos)
+	// If the pump is replaying a recorded session that has a track for us, play that back instead of our usual source
+	replay_track_ = pose_replay_.FindTrack( my_device_serial_number_.c_str() );
+	if ( replay_track_ != MyTrackerStateTable::k_unInvalidSlot )
 	{
-		pose_locking_enabled_ = true;
-		DriverLog("Pose locking ENABLED for tracker %s", my_device_serial_number_.c_str());
+		MyChangePoseConfig( []( MyPoseConfig &config ) { config.is_replaying = true; } );
+		DriverLog( "Tracker %s is replaying its recorded poses", my_device_serial_number_.c_str() );
 	}
-	else
-	{
-		pose_locking_enabled_ = false;
-		DriverLog("Pose locking DISABLED for tracker %s", my_device_serial_number_.c_str());
-	}
-	// --- End of our new code ---
 
 
 	// Now let's set up our inputs
@@ -116,7 +318,14 @@ vr::EVRInitError MyTrackerDeviceDriver::Activate( uint32_t unObjectId )
 	vr::VRDriverInput()->CreateBooleanComponent(
 		container, "/input/trigger/click", &input_handles_[ MyComponent_trigger_click ] );
 
-	my_pose_update_thread_ = std::thread( &MyTrackerDeviceDriver::MyPoseUpdateThread, this );
+	// Send the initial state of every component on our first frame
+	dirty_input_mask_ = ( 1u << MyComponent_MAX ) - 1;
+
+	// Claim our telemetry slot before the pump starts publishing to it
+	telemetry_.BeginSlot( state_slot_, my_device_serial_number_.c_str(), unObjectId );
+
+	// Ask the pose pump to start updating our pose
+	pose_pump_.AddTracker( this );
 
 	// We've activated everything successfully!
 	// Let's tell SteamVR that by saying we don't have any errors.
@@ -141,52 +350,143 @@ void *MyTrackerDeviceDriver::GetComponent( const char *pchComponentNameAndVersio
 void MyTrackerDeviceDriver::DebugRequest(
 	const char *pchRequest, char *pchResponseBuffer, uint32_t unResponseBufferSize )
 {
-	if ( unResponseBufferSize >= 1 )
-		pchResponseBuffer[ 0 ] = 0;
+	if ( unResponseBufferSize < 1 )
+		return;
+
+	pchResponseBuffer[ 0 ] = 0;
+
+	// "stats" returns a JSON snapshot of our pose pump counters. Anything else is a command.
+	if ( strcmp( pchRequest, "stats" ) == 0 )
+	{
+		MyWriteStats( pchResponseBuffer, unResponseBufferSize );
+	}
+	else
+	{
+		MyRunCommand( pchRequest, pchResponseBuffer, unResponseBufferSize );
+	}
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: This is never called by vrserver in recent OpenVR versions,
-// but is useful for giving data to vr::VRServerDriverHost::TrackedDevicePoseUpdated.
+// Purpose: This is never called by vrserver in recent OpenVR versions. Our poses are given to
+// vr::VRServerDriverHost::TrackedDevicePoseUpdated by the pose pump instead, and this returns the last of them.
 //-----------------------------------------------------------------------------
 vr::DriverPose_t MyTrackerDeviceDriver::GetPose()
 {
-	// First, initialize the struct that we'll be submitting to the runtime to tell it we've updated our pose.
-	vr::DriverPose_t pose = { 0 };
+	// Poses are built by the pump, so we give back the last one it submitted rather than building one on this thread.
+	// The pump only holds the sequence odd for as long as it takes to copy a pose, so we won't be retrying for long.
+	vr::DriverPose_t pose;
+	for ( ;; )
+	{
+		const uint32_t sequence = submitted_pose_sequence_.load( std::memory_order_acquire );
+		if ( ( sequence & 1 ) == 0 )
+		{
+			memcpy( &pose, &submitted_pose_, sizeof( pose ) );
+
+			// Keeps the copy from moving past the second read of the sequence
+			std::atomic_thread_fence( std::memory_order_acquire );
+			if ( submitted_pose_sequence_.load( std::memory_order_relaxed ) == sequence )
+				return pose;
+		}
+
+		std::this_thread::yield();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Publishes a pose we've just submitted for GetPose. Only ever called from the pump, so there's only one writer.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyTrackerDeviceDriver::MyPublishSubmittedPose( const vr::DriverPose_t &pose )
+{
+	// Odd while we're writing. The fence keeps our writes to the pose from moving ahead of it.
+	submitted_pose_sequence_.store( submitted_pose_sequence_.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+
+	memcpy( &submitted_pose_, &pose, sizeof( submitted_pose_ ) );
+
+	submitted_pose_sequence_.store( submitted_pose_sequence_.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lets the pose pump know whether we'd be any use to anyone while nobody's wearing the HMD.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+bool MyTrackerDeviceDriver::MyIsFollowingHmd() const
+{
+	const MyPoseConfig config = MyPoseConfig::Unpack( pose_config_.load( std::memory_order_acquire ) );
+	return config.target_device_index == vr::k_unTrackedDeviceIndexInvalid && !config.is_replaying;
+}
 
+//-----------------------------------------------------------------------------
+// Purpose: Builds our current pose in place, so the pose pump doesn't need to copy it around.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyTrackerDeviceDriver::MyFillPose( vr::DriverPose_t &pose, const MyPoseConfig &config, std::chrono::steady_clock::time_point now )
+{
 	// These need to be set to be valid quaternions. The device won't appear otherwise.
 	pose.qWorldFromDriverRotation.w = 1.f;
 	pose.qDriverFromHeadRotation.w = 1.f;
 
 	pose.deviceIsConnected = true; // Assume the device is always connected
 
-	if (proxy_mode_enabled_ && target_device_index_ != vr::k_unTrackedDeviceIndexInvalid)
+	const vr::TrackedDeviceIndex_t target_device_index = config.target_device_index;
+
+	if (config.is_replaying && replay_track_ != MyTrackerStateTable::k_unInvalidSlot)
+	{
+		// --- REPLAY MODE ---
+		// Play back whatever the source gave us at this point in the recorded session
+		pose_replay_.GetPose(replay_track_, now, pose);
+	}
+	else if (target_device_index != vr::k_unTrackedDeviceIndexInvalid)
 	{
 		// --- PROXY MODE --- 
-		// Get the poses of all tracked devices
-		vr::TrackedDevicePose_t all_poses[vr::k_unMaxTrackedDeviceCount];
-		vr::VRServerDriverHost()->GetRawTrackedDevicePoses(0, all_poses, vr::k_unMaxTrackedDeviceCount);
+		const uint64_t fusion_targets = fusion_targets_.load( std::memory_order_acquire );
+		if ( fusion_targets != my_no_fusion_targets )
+		{
+			// Fused with the other devices on the same mount, our target first
+			std::array< vr::TrackedDeviceIndex_t, MySourceFusion::k_unMaxSources > source_devices;
+			uint32_t num_sources = 0;
+			source_devices[ num_sources++ ] = target_device_index;
+			for ( uint32_t target = 0; target < my_max_fusion_targets; target++ )
+			{
+				const uint64_t fusion_target = ( fusion_targets >> ( 8 * target ) ) & my_fusion_target_mask;
+				if ( fusion_target != my_fusion_target_mask )
+					source_devices[ num_sources++ ] = (vr::TrackedDeviceIndex_t)fusion_target;
+			}
 
-		// Get the pose of our target device
-		const vr::TrackedDevicePose_t& target_pose = all_poses[target_device_index_];
+			source_fusion_.SetSources( source_devices.data(), num_sources );
+			vr::VRServerDriverHost()->GetRawTrackedDevicePoses( 0, raw_poses_.data(), source_fusion_.GetMaxDeviceIndex() + 1 );
+			source_fusion_.Fuse( raw_poses_.data(), pose );
+		}
+		else
+		{
+			// Get the poses of tracked devices, up to and including our target
+			vr::VRServerDriverHost()->GetRawTrackedDevicePoses(0, raw_poses_.data(), target_device_index + 1);
 
-		// Copy the target's state
-		pose.poseIsValid = target_pose.bPoseIsValid;
-		pose.result = target_pose.eTrackingResult;
+			// Get the pose of our target device
+			const vr::TrackedDevicePose_t& target_pose = raw_poses_[target_device_index];
 
-		// Copy the target's position and orientation
-		pose.vecPosition[0] = target_pose.mDeviceToAbsoluteTracking.m[0][3];
-		pose.vecPosition[1] = target_pose.mDeviceToAbsoluteTracking.m[1][3];
-		pose.vecPosition[2] = target_pose.mDeviceToAbsoluteTracking.m[2][3];
+			// Copy the target's state
+			pose.poseIsValid = target_pose.bPoseIsValid;
+			pose.result = target_pose.eTrackingResult;
 
-		pose.qRotation = HmdQuaternion_FromMatrix(target_pose.mDeviceToAbsoluteTracking);
+			// Copy the target's position and orientation
+			pose.vecPosition[0] = target_pose.mDeviceToAbsoluteTracking.m[0][3];
+			pose.vecPosition[1] = target_pose.mDeviceToAbsoluteTracking.m[1][3];
+			pose.vecPosition[2] = target_pose.mDeviceToAbsoluteTracking.m[2][3];
+
+			pose.qRotation = HmdQuaternion_FromMatrix(target_pose.mDeviceToAbsoluteTracking);
+		}
+
+		// From the device to whatever it's mounted on
+		MyGetMountOffset().Apply( pose );
 	}
 	else
 	{
 		// --- DEFAULT (HMD-TRACKING) MODE ---
 		// Get the HMD pose
-		vr::TrackedDevicePose_t hmd_pose;
-		vr::VRServerDriverHost()->GetRawTrackedDevicePoses(0.f, &hmd_pose, 1);
+		vr::VRServerDriverHost()->GetRawTrackedDevicePoses(0.f, raw_poses_.data(), 1);
+		const vr::TrackedDevicePose_t& hmd_pose = raw_poses_[vr::k_unTrackedDeviceIndex_Hmd];
 
 		if (hmd_pose.bPoseIsValid)
 		{
@@ -221,84 +521,159 @@ vr::DriverPose_t MyTrackerDeviceDriver::GetPose()
 			pose.result = vr::TrackingResult_Uninitialized;
 		}
 	}
-
-	return pose;
 }
 
-void MyTrackerDeviceDriver::MyPoseUpdateThread()
+//-----------------------------------------------------------------------------
+// Purpose: This is called by the pose pump whenever we're due an update.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+std::chrono::nanoseconds MyTrackerDeviceDriver::MyPoseUpdate( std::chrono::steady_clock::time_point now )
 {
-	while ( is_active_ )
+	// Everything this update does is decided by one snapshot of our config, however it's changed meanwhile
+	const MyPoseConfig config = MyPoseConfig::Unpack( pose_config_.load( std::memory_order_acquire ) );
+
+	tracker_states_.RecordUpdate( state_slot_, now );
+
+	// Get the pose from the device. MyFillPose() would now read from your actual hardware.
+	// We assume it sets pose.poseIsValid correctly based on the hardware's tracking state.
+	// The pose is built straight into the pipeline, which decides what we submit.
+	vr::DriverPose_t &current_pose = pose_pipeline_.GetSourcePose();
+	MyFillPose( current_pose, config, now );
+	pose_recorder_.Record( state_slot_, MyPoseTraceRecordKind_Source, current_pose, now );
+
+	// Whatever the IMU has read since last time goes in ahead of the pose, so the pipeline is up to date with it
+	MyReadImu( config );
+
+	// As does where the body model reckons we are, in case we turn out to be lost
+	MyBodyModel &body_model = pose_pump_.GetBodyModel();
+	vr::HmdVector3d_t inferred_position;
+	vr::HmdQuaternion_t inferred_rotation;
+	if ( config.body_joint != MyBodyJoint_None && body_model.GetEstimate( config.body_joint, inferred_position, inferred_rotation ) )
+		pose_pipeline_.InferPose( inferred_position, inferred_rotation );
+
+	// A fixed rate set with set_rate overrides the governor
+	MyPipelineConfig pipeline_config;
+	pipeline_config.pose_locking_enabled = config.pose_locking_enabled;
+	pipeline_config.is_force_locked = config.is_force_locked;
+	pipeline_config.fixed_update_period =
+		config.update_rate_hz != 0 ? std::chrono::nanoseconds( 1000000000 / config.update_rate_hz ) : std::chrono::nanoseconds::zero();
+	pipeline_config.is_resampling = config.is_resampling;
+	pipeline_config.resample_delay = std::chrono::microseconds( config.resample_delay_us );
+
+	const vr::DriverPose_t *submitted_pose = pose_pipeline_.Update( pipeline_config, now );
+	if ( submitted_pose != nullptr )
 	{
-		// --- Read proxy settings --- 
-		const char* settings_section = "PoseLockProxy";
-		// Construct the key for this specific tracker, e.g., "proxy_target_for_MyTrackerModelNumber10"
-		std::string key = "proxy_target_for_" + my_device_serial_number_;
+		vr::VRServerDriverHost()->TrackedDevicePoseUpdated( tracker_states_.GetDeviceIndex( state_slot_ ), *submitted_pose, sizeof( vr::DriverPose_t ) );
+		tracker_states_.AddSubmission( state_slot_ );
+		MyPublishSubmittedPose( *submitted_pose );
+		pose_recorder_.Record( state_slot_, MyPoseTraceRecordKind_Submitted, *submitted_pose, now );
+	}
 
-		// Read the target device index from settings. Default to -1 (invalid) if not found.
-		vr::EVRSettingsError eError = vr::VRSettingsError_None;
-		int32_t target_index = vr::VRSettings()->GetInt32(settings_section, key.c_str(), &eError);
+	// Only a pose that's wholly fresh tells the body model where we are. Otherwise it carries on with its own estimate.
+	if ( config.body_joint != MyBodyJoint_None )
+	{
+		const vr::DriverPose_t &observed_pose = submitted_pose != nullptr ? *submitted_pose : current_pose;
+		body_model.Observe( config.body_joint, { { observed_pose.vecPosition[ 0 ], observed_pose.vecPosition[ 1 ], observed_pose.vecPosition[ 2 ] } },
+			observed_pose.qRotation, pose_pipeline_.GetTrackingState() == MyTrackingState_Tracking, now );
+	}
 
-		if (eError != vr::VRSettingsError_None)
-		{
-			target_index = -1;
-		}
+	// Let anyone watching know what we did. If we had nothing to submit, show them the source pose instead.
+	if ( telemetry_.IsOpen() )
+	{
+		MyTrackerStats stats;
+		tracker_states_.GetStats( state_slot_, stats );
+		telemetry_.Publish( state_slot_, submitted_pose != nullptr ? *submitted_pose : current_pose, current_pose.poseIsValid != 0, stats, now,
+			tracker_states_.GetGoodPoseTime( state_slot_ ) );
+	}
 
-		if (target_index != -1)
-		{
-			// A valid target is set, so enable proxy mode
-			proxy_mode_enabled_ = true;
-			target_device_index_ = (uint32_t)target_index;
-		}
-		else
-		{
-			// No target is set for this tracker, so disable proxy mode
-			proxy_mode_enabled_ = false;
-			target_device_index_ = vr::k_unTrackedDeviceIndexInvalid;
-		}
+	// Our fixed rate if we have one. Otherwise static trackers are updated at a trickle, moving ones as fast as their
+	// motion needs.
+	return pose_pipeline_.GetUpdatePeriod();
+}
 
-		// --- Original Pose Locking Logic ---
-		if (pose_locking_enabled_)
+//-----------------------------------------------------------------------------
+// Purpose: Reads everything our proxy target's IMU has sent since we last looked, and feeds it to the pipeline.
+// The stream is opened the first time we need it, and closed once we don't, or the target changes.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyTrackerDeviceDriver::MyReadImu( const MyPoseConfig &config )
+{
+	// Replayed poses have no IMU to go with them
+	const vr::TrackedDeviceIndex_t device_index =
+		config.is_using_imu && !config.is_replaying ? config.target_device_index : vr::k_unTrackedDeviceIndexInvalid;
+
+	if ( device_index != imu_device_index_ )
+	{
+		MyCloseImu();
+		imu_device_index_ = device_index;
+
+		if ( device_index != vr::k_unTrackedDeviceIndexInvalid )
 		{
-			// --- POSE LOCKING LOGIC (for real hardware) ---
-			
-			// Get the pose from the device. GetPose() would now read from your actual hardware.
-			// We assume it sets pose.poseIsValid correctly based on the hardware's tracking state.
-			vr::DriverPose_t current_pose = GetPose();
-
-			// Check if the pose is valid
-			if ( current_pose.poseIsValid )
+			// Devices with IMUs publish their samples at /devices/<tracking system>/<serial number>/imu.
+			// A property that's missing or too long reads as empty, so we just fail to open the stream.
+			const vr::PropertyContainerHandle_t container = vr::VRProperties()->TrackedDeviceToPropertyContainer( device_index );
+			char tracking_system_name[ my_imu_path_part_size ];
+			char serial_number[ my_imu_path_part_size ];
+			vr::VRProperties()->GetStringProperty( container, vr::Prop_TrackingSystemName_String, tracking_system_name, sizeof( tracking_system_name ) );
+			vr::VRProperties()->GetStringProperty( container, vr::Prop_SerialNumber_String, serial_number, sizeof( serial_number ) );
+
+			char path[ 2 * my_imu_path_part_size + 16 ];
+			snprintf( path, sizeof( path ), "/devices/%s/%s/imu", tracking_system_name, serial_number );
+
+			if ( vr::VRIOBuffer()->Open( path, vr::IOBufferMode_Read, sizeof( vr::ImuSample_t ), 0, &imu_buffer_ ) != vr::IOBuffer_Success )
 			{
-				// It's valid, so we should update our last known good pose
-				last_known_good_pose_ = current_pose;
-				has_last_known_good_pose_ = true;
+				imu_buffer_ = vr::k_ulInvalidIOBufferHandle;
+				DriverLog( "Tracker %s couldn't open IMU stream %s", my_device_serial_number_.c_str(), path );
 			}
-
-			// If we have a last known good pose, send it to SteamVR
-			if ( has_last_known_good_pose_ )
+			else
 			{
-				// We need to make sure to mark it as valid before sending
-				last_known_good_pose_.poseIsValid = true;
-				vr::VRServerDriverHost()->TrackedDevicePoseUpdated( my_device_index_, last_known_good_pose_, sizeof( vr::DriverPose_t ) );
+				DriverLog( "Tracker %s is reading IMU stream %s", my_device_serial_number_.c_str(), path );
 			}
 		}
-		else
+	}
+
+	if ( imu_buffer_ == vr::k_ulInvalidIOBufferHandle )
+		return;
+
+	const MyMountOffset &mount_offset = MyGetMountOffset();
+
+	// A full read means there may be more waiting
+	uint32_t bytes_read = 0;
+	do
+	{
+		if ( vr::VRIOBuffer()->Read( imu_buffer_, imu_samples_.data(), sizeof( imu_samples_ ), &bytes_read ) != vr::IOBuffer_Success )
+			break;
+
+		// Our pose has had the mount offset applied, so the samples need it too
+		const uint32_t num_samples = bytes_read / sizeof( vr::ImuSample_t );
+		for ( uint32_t sample = 0; sample < num_samples; sample++ )
 		{
-			// --- DEFAULT LOGIC ---
-			// Pose locking is disabled, so just send the latest pose directly.
-			vr::VRServerDriverHost()->TrackedDevicePoseUpdated( my_device_index_, GetPose(), sizeof( vr::DriverPose_t ) );
+			mount_offset.ApplyToImuSample( imu_samples_[ sample ] );
+			pose_pipeline_.AddImuSample( imu_samples_[ sample ] );
 		}
+	} while ( bytes_read == sizeof( imu_samples_ ) );
+}
 
-
-		// Update our pose every five milliseconds.
-		// In reality, you should update the pose whenever you have new data from your device.
-		std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+//-----------------------------------------------------------------------------
+// Purpose: Stops reading our IMU stream, if we were, and has the pipeline forget what it knew from it.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyTrackerDeviceDriver::MyCloseImu()
+{
+	if ( imu_buffer_ != vr::k_ulInvalidIOBufferHandle )
+	{
+		vr::VRIOBuffer()->Close( imu_buffer_ );
+		imu_buffer_ = vr::k_ulInvalidIOBufferHandle;
 	}
+
+	imu_device_index_ = vr::k_unTrackedDeviceIndexInvalid;
+	pose_pipeline_.ResetImu();
 }
 
 //-----------------------------------------------------------------------------
 // Purpose: This is called by vrserver when the device should enter standby mode.
 // The device should be put into whatever low power mode it has.
-// We don't really have anything to do here, so let's just log something.
+// Our pose updates are parked by the provider's pose pump, so let's just log something.
 //-----------------------------------------------------------------------------
 void MyTrackerDeviceDriver::EnterStandby()
 {
@@ -312,16 +687,24 @@ void MyTrackerDeviceDriver::EnterStandby()
 //-----------------------------------------------------------------------------
 void MyTrackerDeviceDriver::Deactivate()
 {
-	// Let's join our pose thread that's running
-	// by first checking then setting is_active_ to false to break out
-	// of the while loop, if it's running, then call .join() on the thread
-	if ( is_active_.exchange( false ) )
+	// Let's take ourselves off the pose pump, if we were on it.
+	// Once RemoveTracker returns, the pump is no longer touching this device.
+	if ( tracker_states_.ExchangeIsActive( state_slot_, false ) )
 	{
-		my_pose_update_thread_.join();
+		pose_pump_.RemoveTracker( this );
+		telemetry_.EndSlot( state_slot_ );
+
+		// The pump's done with us, so our IMU stream is ours to close
+		MyCloseImu();
 	}
 
+	// Stop events being routed to us, in case our device index goes to someone else
+	const vr::TrackedDeviceIndex_t device_index = tracker_states_.GetDeviceIndex( state_slot_ );
+	if ( device_index < vr::k_unMaxTrackedDeviceCount && device_index_table_[ device_index ] == this )
+		device_index_table_[ device_index ] = nullptr;
+
 	// unassign our controller index (we don't want to be calling vrserver anymore after Deactivate() has been called
-	my_device_index_ = vr::k_unTrackedDeviceIndexInvalid;
+	tracker_states_.SetDeviceIndex( state_slot_, vr::k_unTrackedDeviceIndexInvalid );
 }
 
 
@@ -331,12 +714,40 @@ void MyTrackerDeviceDriver::Deactivate()
 //-----------------------------------------------------------------------------
 void MyTrackerDeviceDriver::MyRunFrame()
 {
-	// update our inputs here
-	vr::VRDriverInput()->UpdateBooleanComponent( input_handles_[ MyComponent_a_click ], false, 0 );
-	vr::VRDriverInput()->UpdateBooleanComponent( input_handles_[ MyComponent_a_touch ], false, 0 );
+	// Nothing's changed since we last told vrserver, so there's nothing to send
+	if ( dirty_input_mask_ == 0 )
+		return;
 
-	vr::VRDriverInput()->UpdateBooleanComponent( input_handles_[ MyComponent_trigger_click ], false, 0 );
-	vr::VRDriverInput()->UpdateScalarComponent( input_handles_[ MyComponent_trigger_value ], 0.f, 0 );
+	// update our inputs here, only sending the components whose values have changed
+	for ( int component = 0; component < MyComponent_MAX; component++ )
+	{
+		if ( ( dirty_input_mask_ & ( 1u << component ) ) == 0 )
+			continue;
+
+		if ( my_component_is_scalar[ component ] )
+		{
+			vr::VRDriverInput()->UpdateScalarComponent( input_handles_[ component ], input_values_[ component ], 0 );
+		}
+		else
+		{
+			vr::VRDriverInput()->UpdateBooleanComponent( input_handles_[ component ], input_values_[ component ] != 0.f, 0 );
+		}
+	}
+
+	dirty_input_mask_ = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sets the value of one of our input components. It's sent to vrserver on the next MyRunFrame, if it changed.
+// Booleans are 0 or 1. Must be called from vrserver's main thread, like MyRunFrame.
+//-----------------------------------------------------------------------------
+void MyTrackerDeviceDriver::MySetInputValue( MyComponent component, float value )
+{
+	if ( input_values_[ component ] != value )
+	{
+		input_values_[ component ] = value;
+		dirty_input_mask_ |= 1u << component;
+	}
 }
 
 
@@ -344,11 +755,392 @@ void MyTrackerDeviceDriver::MyRunFrame()
 // Purpose: This is called by our IServerTrackedDeviceProvider when it pops an event off the event queue.
 // It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
 //-----------------------------------------------------------------------------
-void MyTrackerDeviceDriver::MyProcessEvent( const vr::VREvent_t &vrevent )
+void MyTrackerDeviceDriver::MyProcessEvent( const vr::VREvent_t & /* vrevent */ )
 {
+	// Only events for our own device index are routed here.
 	// Our tracker doesn't have any events it wants to process.
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: This is called on activation, and by our IServerTrackedDeviceProvider when our settings have changed.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyTrackerDeviceDriver::MyReloadSettings()
+{
+	const char* settings_section = "PoseLockDriver";
+	const char* settings_key = "enabled_trackers";
+	char enabled_trackers_buffer[1024];
+	vr::VRSettings()->GetString(settings_section, settings_key, enabled_trackers_buffer, sizeof(enabled_trackers_buffer));
+
+	// Check if our serial number is in the list.
+	// This is a simple substring search. A more robust solution would be to parse the comma-separated list.
+	const bool pose_locking_enabled = std::string(enabled_trackers_buffer).find(my_device_serial_number_) != std::string::npos;
+	if (pose_locking_enabled)
+	{
+		DriverLog("Pose locking ENABLED for tracker %s", my_device_serial_number_.c_str());
+	}
+	else
+	{
+		DriverLog("Pose locking DISABLED for tracker %s", my_device_serial_number_.c_str());
+	}
+
+	// --- Read proxy settings ---
+	// Read the target device index from settings. Default to -1 (invalid) if not found.
+	vr::EVRSettingsError eError = vr::VRSettingsError_None;
+	int32_t target_index = vr::VRSettings()->GetInt32("PoseLockProxy", proxy_settings_key_.c_str(), &eError);
+
+	vr::TrackedDeviceIndex_t target_device_index = vr::k_unTrackedDeviceIndexInvalid;
+	if (eError == vr::VRSettingsError_None && target_index >= 0 && target_index < (int32_t)vr::k_unMaxTrackedDeviceCount)
+	{
+		// A valid target is set, so enable proxy mode
+		target_device_index = (vr::TrackedDeviceIndex_t)target_index;
+	}
+
+	// --- Read resampling settings ---
+	// A delay of zero or more turns resampling on. It's off if the setting is missing or negative.
+	eError = vr::VRSettingsError_None;
+	const float resample_delay_ms = vr::VRSettings()->GetFloat( settings_section, "resample_delay_ms", &eError );
+	const bool is_resampling = eError == vr::VRSettingsError_None && resample_delay_ms >= 0.f;
+	const uint32_t resample_delay_us = is_resampling ? (uint32_t)( std::min( resample_delay_ms, my_max_resample_delay_ms ) * 1000.f ) : 0;
+
+	// --- Read IMU settings ---
+	// Dead reckoning from the proxy target's IMU is off unless it's turned on for us
+	eError = vr::VRSettingsError_None;
+	const bool is_using_imu = vr::VRSettings()->GetBool( "PoseLockProxy", imu_settings_key_.c_str(), &eError ) && eError == vr::VRSettingsError_None;
+
+	// --- Read body model settings ---
+	// No joint, unless we're given one by name, e.g. "left_foot"
+	eError = vr::VRSettingsError_None;
+	char body_joint_buffer[ 32 ] = {};
+	vr::VRSettings()->GetString( "PoseLockProxy", body_joint_settings_key_.c_str(), body_joint_buffer, sizeof( body_joint_buffer ), &eError );
+	const MyBodyJoint body_joint = eError == vr::VRSettingsError_None ? MyParseBodyJoint( body_joint_buffer ) : MyBodyJoint_None;
+
+	// --- Read fusion settings ---
+	// Devices to fuse with our proxy target, e.g. "5,7". None if it's missing or isn't a list of them.
+	eError = vr::VRSettingsError_None;
+	char fusion_targets_buffer[ 64 ] = {};
+	vr::VRSettings()->GetString( "PoseLockProxy", fusion_settings_key_.c_str(), fusion_targets_buffer, sizeof( fusion_targets_buffer ), &eError );
+	uint64_t fusion_targets = my_no_fusion_targets;
+	if ( eError == vr::VRSettingsError_None && !MyParseFusionTargets( fusion_targets_buffer, fusion_targets ) )
+	{
+		DriverLog( "Tracker %s has bad fusion targets \"%s\"", my_device_serial_number_.c_str(), fusion_targets_buffer );
+		fusion_targets = my_no_fusion_targets;
+	}
+	fusion_targets_.store( fusion_targets, std::memory_order_release );
+
+	// --- Read mount offset settings ---
+	// No offset, unless we're given one like "0,-0.1,0.05,90,0,0"
+	eError = vr::VRSettingsError_None;
+	char mount_offset_buffer[ 128 ] = {};
+	vr::VRSettings()->GetString( "PoseLockProxy", mount_offset_settings_key_.c_str(), mount_offset_buffer, sizeof( mount_offset_buffer ), &eError );
+	MyMountOffset mount_offset;
+	if ( eError != vr::VRSettingsError_None || !MyMountOffset::Parse( mount_offset_buffer, mount_offset ) )
+	{
+		if ( eError == vr::VRSettingsError_None )
+			DriverLog( "Tracker %s has bad mount offset \"%s\"", my_device_serial_number_.c_str(), mount_offset_buffer );
+
+		MyMountOffset::Parse( "none", mount_offset );
+	}
+	MySetMountOffset( mount_offset );
+
+	// Settings only own locking, the proxy target, resampling, the IMU and the body joint. A force lock or fixed rate
+	// set by command is left alone.
+	MyChangePoseConfig( [ & ]( MyPoseConfig &config ) {
+		config.pose_locking_enabled = pose_locking_enabled;
+		config.target_device_index = target_device_index;
+		config.is_resampling = is_resampling;
+		config.resample_delay_us = resample_delay_us;
+		config.is_using_imu = is_using_imu;
+		config.body_joint = body_joint;
+	} );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Applies a change to our pose config as a single atomic swap, retrying if someone else got in first.
+//-----------------------------------------------------------------------------
+template < class Change >
+void MyTrackerDeviceDriver::MyChangePoseConfig( Change change )
+{
+	uint64_t packed = pose_config_.load( std::memory_order_relaxed );
+	for ( ;; )
+	{
+		MyPoseConfig config = MyPoseConfig::Unpack( packed );
+		change( config );
+		if ( pose_config_.compare_exchange_weak( packed, config.Pack(), std::memory_order_release, std::memory_order_relaxed ) )
+			return;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Hands a new mount offset to the pump. Only ever called from vrserver's main thread, so there's only one writer.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyTrackerDeviceDriver::MySetMountOffset( const MyMountOffset &offset )
+{
+	// Odd while we're writing. The fence keeps our writes to the offset from moving ahead of it.
+	mount_offset_sequence_.store( mount_offset_sequence_.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+
+	shared_mount_offset_ = offset;
+
+	mount_offset_sequence_.store( mount_offset_sequence_.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The pump's copy of our mount offset, brought up to date if it's changed. If we catch it mid-change, we
+// carry on with the old one for this update, and try again next time.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+const MyMountOffset &MyTrackerDeviceDriver::MyGetMountOffset()
+{
+	const uint32_t sequence = mount_offset_sequence_.load( std::memory_order_acquire );
+	if ( sequence != mount_offset_copied_sequence_ && ( sequence & 1 ) == 0 )
+	{
+		const MyMountOffset offset = shared_mount_offset_;
+
+		// Keeps the copy from moving past the second read of the sequence
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if ( mount_offset_sequence_.load( std::memory_order_relaxed ) == sequence )
+		{
+			mount_offset_ = offset;
+			mount_offset_copied_sequence_ = sequence;
+		}
+	}
+
+	return mount_offset_;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs a command sent to us through DebugRequest. Commands change our pose config directly, so they take
+// effect on our next pose update without going through VRSettings. Commands are:
+//   set_proxy <device index>   proxy another tracker, or -1 to go back to following the HMD
+//   set_lock_mode <on|off>     submit our last known good pose in place of invalid ones
+//   force_lock                 hold our current pose, even while the source is valid
+//   release_lock               stop holding it
+//   set_rate <hz|auto>         update at a fixed rate, or let the motion rate governor decide
+//   set_source <replay|live>   play our poses back from the replay trace, or go back to the HMD or proxy target
+//   set_resample <ms|off>      submit fresh poses on an even grid, interpolated this far behind the source
+//   set_imu <on|off>           while locking, carry on with the proxy target's IMU instead of holding
+//   set_body_joint <name|none> the joint we're worn on, e.g. left_foot, so the body model can place us when we're lost
+//   set_fusion <list|none>     fuse other devices on the same mount with our proxy target, e.g. set_fusion 5,7
+//   set_offset <offset|none>   report our proxy target's pose moved by x,y,z,yaw,pitch,roll, in m and degrees
+// Settings changes still apply on top, and replace whatever set_proxy, set_lock_mode, set_resample, set_imu,
+// set_body_joint, set_fusion and set_offset last set.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyTrackerDeviceDriver::MyRunCommand( const char *pchRequest, char *pchResponseBuffer, uint32_t unResponseBufferSize )
+{
+	// The argument's the rest of the line, so it can have spaces in it, like "set_offset 0, 0, 0.1, 0, 0, 0"
+	char command[ 32 ] = {};
+	char argument[ 128 ] = {};
+	const int num_fields = sscanf( pchRequest, "%31s %127[^\n]", command, argument );
+
+	// Less any trailing whitespace, which would otherwise be taken as part of it
+	size_t argument_length = strlen( argument );
+	while ( argument_length > 0 && isspace( (unsigned char)argument[ argument_length - 1 ] ) )
+		argument[ --argument_length ] = 0;
+
+	const char *error = nullptr;
+
+	if ( num_fields >= 1 && strcmp( command, "set_proxy" ) == 0 )
+	{
+		char *end = nullptr;
+		const long target_index = strtol( argument, &end, 10 );
+		if ( num_fields < 2 || *end != 0 || target_index < -1 || target_index >= (long)vr::k_unMaxTrackedDeviceCount )
+		{
+			error = "set_proxy needs a device index, or -1";
+		}
+		else
+		{
+			MyChangePoseConfig( [ & ]( MyPoseConfig &config ) {
+				config.target_device_index = target_index < 0 ? vr::k_unTrackedDeviceIndexInvalid : (vr::TrackedDeviceIndex_t)target_index;
+			} );
+		}
+	}
+	else if ( num_fields >= 1 && strcmp( command, "set_lock_mode" ) == 0 )
+	{
+		if ( num_fields < 2 || ( strcmp( argument, "on" ) != 0 && strcmp( argument, "off" ) != 0 ) )
+		{
+			error = "set_lock_mode needs on or off";
+		}
+		else
+		{
+			const bool pose_locking_enabled = strcmp( argument, "on" ) == 0;
+			MyChangePoseConfig( [ & ]( MyPoseConfig &config ) { config.pose_locking_enabled = pose_locking_enabled; } );
+		}
+	}
+	else if ( num_fields >= 1 && strcmp( command, "set_source" ) == 0 )
+	{
+		if ( num_fields < 2 || ( strcmp( argument, "replay" ) != 0 && strcmp( argument, "live" ) != 0 ) )
+		{
+			error = "set_source needs replay or live";
+		}
+		else if ( strcmp( argument, "replay" ) == 0 && replay_track_ == MyTrackerStateTable::k_unInvalidSlot )
+		{
+			error = "no replay track for this tracker";
+		}
+		else
+		{
+			const bool is_replaying = strcmp( argument, "replay" ) == 0;
+			MyChangePoseConfig( [ & ]( MyPoseConfig &config ) { config.is_replaying = is_replaying; } );
+		}
+	}
+	else if ( num_fields >= 1 && strcmp( command, "force_lock" ) == 0 )
+	{
+		MyChangePoseConfig( []( MyPoseConfig &config ) { config.is_force_locked = true; } );
+	}
+	else if ( num_fields >= 1 && strcmp( command, "release_lock" ) == 0 )
+	{
+		MyChangePoseConfig( []( MyPoseConfig &config ) { config.is_force_locked = false; } );
+	}
+	else if ( num_fields >= 1 && strcmp( command, "set_rate" ) == 0 )
+	{
+		char *end = nullptr;
+		const long rate_hz = num_fields < 2 || strcmp( argument, "auto" ) == 0 ? 0 : strtol( argument, &end, 10 );
+		if ( num_fields < 2 || ( end != nullptr && *end != 0 ) || rate_hz < 0 || rate_hz > (long)my_max_update_rate_hz )
+		{
+			error = "set_rate needs a rate in Hz, up to 1000, or auto";
+		}
+		else
+		{
+			MyChangePoseConfig( [ & ]( MyPoseConfig &config ) { config.update_rate_hz = (uint32_t)rate_hz; } );
+		}
+	}
+	else if ( num_fields >= 1 && strcmp( command, "set_resample" ) == 0 )
+	{
+		char *end = nullptr;
+		const bool is_resampling = num_fields >= 2 && strcmp( argument, "off" ) != 0;
+		const float delay_ms = is_resampling ? strtof( argument, &end ) : 0.f;
+		// Written so NaN fails the range check too
+		if ( num_fields < 2 || ( end != nullptr && *end != 0 ) || !( delay_ms >= 0.f && delay_ms <= my_max_resample_delay_ms ) )
+		{
+			error = "set_resample needs a delay in ms, up to 50, or off";
+		}
+		else
+		{
+			MyChangePoseConfig( [ & ]( MyPoseConfig &config ) {
+				config.is_resampling = is_resampling;
+				config.resample_delay_us = (uint32_t)( delay_ms * 1000.f );
+			} );
+		}
+	}
+	else if ( num_fields >= 1 && strcmp( command, "set_imu" ) == 0 )
+	{
+		if ( num_fields < 2 || ( strcmp( argument, "on" ) != 0 && strcmp( argument, "off" ) != 0 ) )
+		{
+			error = "set_imu needs on or off";
+		}
+		else
+		{
+			const bool is_using_imu = strcmp( argument, "on" ) == 0;
+			MyChangePoseConfig( [ & ]( MyPoseConfig &config ) { config.is_using_imu = is_using_imu; } );
+		}
+	}
+	else if ( num_fields >= 1 && strcmp( command, "set_body_joint" ) == 0 )
+	{
+		const MyBodyJoint body_joint = num_fields < 2 ? MyBodyJoint_None : MyParseBodyJoint( argument );
+		if ( num_fields < 2 || ( body_joint == MyBodyJoint_None && strcmp( argument, "none" ) != 0 ) )
+		{
+			error = "set_body_joint needs a joint, like waist or left_foot, or none";
+		}
+		else
+		{
+			MyChangePoseConfig( [ & ]( MyPoseConfig &config ) { config.body_joint = body_joint; } );
+		}
+	}
+	else if ( num_fields >= 1 && strcmp( command, "set_fusion" ) == 0 )
+	{
+		uint64_t fusion_targets = my_no_fusion_targets;
+		if ( num_fields < 2 || !MyParseFusionTargets( argument, fusion_targets ) )
+		{
+			error = "set_fusion needs a list of up to 3 device indices, like 5,7, or none";
+		}
+		else
+		{
+			fusion_targets_.store( fusion_targets, std::memory_order_release );
+		}
+	}
+	else if ( num_fields >= 1 && strcmp( command, "set_offset" ) == 0 )
+	{
+		MyMountOffset mount_offset;
+		if ( num_fields < 2 || !MyMountOffset::Parse( argument, mount_offset ) )
+		{
+			error = "set_offset needs x,y,z,yaw,pitch,roll in m and degrees, or none";
+		}
+		else
+		{
+			MySetMountOffset( mount_offset );
+		}
+	}
+	else
+	{
+		error = "unknown request";
+	}
+
+	if ( error != nullptr )
+	{
+		snprintf( pchResponseBuffer, unResponseBufferSize, "{\"error\":\"%s\"}", error );
+		return;
+	}
+
+	DriverLog( "Tracker %s ran command: %s", my_device_serial_number_.c_str(), pchRequest );
+	snprintf( pchResponseBuffer, unResponseBufferSize, "{\"ok\":true}" );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes our runtime stats into a DebugRequest response as compact JSON. If it doesn't all fit, the response
+// is an error instead, since a cut-off object wouldn't parse.
+// The counters are read from the pump's state table without waiting on the pump, so this is safe at any time.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyTrackerDeviceDriver::MyWriteStats( char *pchResponseBuffer, uint32_t unResponseBufferSize ) const
+{
+	MyTrackerStats stats;
+	tracker_states_.GetStats( state_slot_, stats );
+
+	// A tracker that's been deactivated keeps its counters, but isn't doing anything
+	const MyTrackingState state = tracker_states_.IsActive( state_slot_ ) ? stats.state : MyTrackingState_Inactive;
+
+	int written = snprintf( pchResponseBuffer, unResponseBufferSize,
+		"{\"serial\":\"%s\",\"state\":\"%s\",\"motion\":\"%s\",\"submissions\":%llu,\"dropouts\":%llu,"
+		"\"lock_total_us\":%llu,\"lock_max_us\":%llu,\"rejected_outliers\":%llu,\"update_interval_hist\":[",
+		my_device_serial_number_.c_str(), my_tracking_state_names[ state ],
+		my_motion_class_names[ stats.motion_class ],
+		(unsigned long long)stats.num_submissions, (unsigned long long)stats.num_dropouts,
+		(unsigned long long)stats.total_lock_duration_us, (unsigned long long)stats.max_lock_duration_us,
+		(unsigned long long)stats.num_rejected_outliers );
+
+	// snprintf returns how much it would have written, so anything at or past the end means it was cut short
+	const auto is_truncated = [ & ]( int length ) { return length < 0 || (uint32_t)length >= unResponseBufferSize; };
+
+	// One entry per bucket, as [upper bound in us, count]. The last bucket's bound is 0, meaning unbounded.
+	for ( uint32_t bucket = 0; bucket < my_num_update_interval_buckets && !is_truncated( written ); bucket++ )
+	{
+		const uint32_t bound_us = bucket < my_num_update_interval_buckets - 1 ? my_update_interval_bucket_bounds_us[ bucket ] : 0;
+		const int entry = snprintf( pchResponseBuffer + written, unResponseBufferSize - written, "%s[%u,%llu]", bucket == 0 ? "" : ",",
+			bound_us, (unsigned long long)stats.update_interval_histogram[ bucket ] );
+		written = entry < 0 ? entry : written + entry;
+	}
+
+	if ( !is_truncated( written ) )
+	{
+		const int end = snprintf( pchResponseBuffer + written, unResponseBufferSize - written, "]}" );
+		written = end < 0 ? end : written + end;
+	}
+
+	if ( is_truncated( written ) )
+		snprintf( pchResponseBuffer, unResponseBufferSize, "{\"error\":\"buffer too small\"}" );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Our IServerTrackedDeviceProvider needs our device index to route events to us.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+vr::TrackedDeviceIndex_t MyTrackerDeviceDriver::MyGetDeviceIndex() const
+{
+	return tracker_states_.GetDeviceIndex( state_slot_ );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Our IServerTrackedDeviceProvider needs our serial number to add us to vrserver.
 // It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
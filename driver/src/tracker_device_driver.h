@@ -6,7 +6,22 @@
 
 #include "openvr_driver.h"
 #include <atomic>
-#include <thread>
+#include <chrono>
+
+#include "body_model.h"
+#include "pose_pipeline.h"
+#include "pose_recorder.h"
+#include "pose_trace_replay.h"
+#include "source_fusion.h"
+#include "telemetry_segment.h"
+#include "tracker_state_table.h"
+
+class MyPosePump;
+class MyTrackerDeviceDriver;
+
+// Maps a device index to the tracker that owns it, so each event is handed straight to its device. Trackers fill in
+// their own entry as they activate, and clear it as they deactivate. Only touched on vrserver's main thread.
+typedef std::array< MyTrackerDeviceDriver *, vr::k_unMaxTrackedDeviceCount > MyDeviceIndexTable;
 
 enum MyComponent
 {
@@ -19,6 +34,66 @@ enum MyComponent
 	MyComponent_MAX
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: How a tracker builds and submits its pose. Changed from vrserver's main thread (settings and
+// DebugRequest commands), and read by the pose pump once per update, so it's packed into a single 64-bit word
+// that can be swapped atomically. The pump never sees half of a change.
+//-----------------------------------------------------------------------------
+struct MyPoseConfig
+{
+	// Device index of the real tracker we're proxying, or k_unTrackedDeviceIndexInvalid to follow the HMD
+	vr::TrackedDeviceIndex_t target_device_index;
+
+	// Submit our last known good pose in place of invalid ones
+	bool pose_locking_enabled;
+
+	// Hold our last known good pose even while the source is valid
+	bool is_force_locked;
+
+	// Play our poses back from the pump's replay trace, instead of following the HMD or a proxy target
+	bool is_replaying;
+
+	// Fixed pose update rate, or 0 to let the motion rate governor decide
+	uint32_t update_rate_hz;
+
+	// Submit fresh poses on an even grid, interpolated from the source's samples resample_delay_us in the past
+	bool is_resampling;
+	uint32_t resample_delay_us;
+
+	// While locking, carry on what we can't trust in our proxy target's pose with its IMU, read through IVRIOBuffer
+	bool is_using_imu;
+
+	// The joint we're worn on, or MyBodyJoint_None. While locking, we're put where the body model reckons we must be,
+	// and we let the model know where we are while we're tracking.
+	MyBodyJoint body_joint;
+
+	uint64_t Pack() const;
+	static MyPoseConfig Unpack( uint64_t packed );
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: A rigid offset from the device we proxy to the point we report, e.g. from a puck to the joint it's strapped
+// to. Worked out once when it's set, so applying it each update is a rotation and an add, with no trig.
+//-----------------------------------------------------------------------------
+struct MyMountOffset
+{
+	bool is_identity;
+	vr::HmdVector3d_t translation; // In the device's own frame, in m
+	vr::HmdQuaternion_t rotation;
+
+	// From "x,y,z,yaw,pitch,roll": a translation in m, then rotations in degrees about the device's y, x and z axes,
+	// in that order. "none" is the identity. Returns false if it's neither.
+	static bool Parse( const char *text, MyMountOffset &offset );
+
+	// Moves pose from the device to the point we report
+	void Apply( vr::DriverPose_t &pose ) const;
+
+	// Turns an IMU sample from the device's frame into the one Apply leaves the pose's rotation in, so dead reckoning
+	// from a moved pose turns the right way. The rotation is all that's applied; the lever arm the translation adds to
+	// the accelerometer's reading is left out, since reckoned position only bridges brief losses anyway.
+	void ApplyToImuSample( vr::ImuSample_t &sample ) const;
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: Represents a single tracked device in the system.
 // What this device actually is (controller, hmd) depends on the
@@ -27,7 +102,7 @@ enum MyComponent
 class MyTrackerDeviceDriver : public vr::ITrackedDeviceServerDriver
 {
 public:
-	MyTrackerDeviceDriver( unsigned int my_tracker_id );
+	MyTrackerDeviceDriver( unsigned int my_tracker_id, MyPosePump &pose_pump, MyDeviceIndexTable &device_index_table );
 
 	vr::EVRInitError Activate( uint32_t unObjectId ) override;
 
@@ -44,35 +119,123 @@ public:
 	// ----- Functions we declare ourselves below -----
 
 	const std::string &MyGetSerialNumber();
+	vr::TrackedDeviceIndex_t MyGetDeviceIndex() const;
+	uint32_t MyGetStateSlot() const { return state_slot_; }
+
+	// Whether our poses come from the HMD, rather than a proxy target or a replay. Safe to call from any thread.
+	bool MyIsFollowingHmd() const;
 
 	void MyRunFrame();
+	void MySetInputValue( MyComponent component, float value );
 	void MyProcessEvent( const vr::VREvent_t &vrevent );
+	void MyReloadSettings();
+
+	// Called by the pose pump when this tracker is due an update. Returns how long until it wants the next one.
+	std::chrono::nanoseconds MyPoseUpdate( std::chrono::steady_clock::time_point now );
+
+	// Hands a copy of a pose we've just submitted to GetPose. Only called from the pump.
+	void MyPublishSubmittedPose( const vr::DriverPose_t &pose );
+
+	// Feeds our proxy target's new IMU samples to the pipeline, opening and closing its IMU stream as the config says
+	void MyReadImu( const MyPoseConfig &config );
+	void MyCloseImu();
+
+	void MyWriteStats( char *pchResponseBuffer, uint32_t unResponseBufferSize ) const;
 
-	void MyPoseUpdateThread();
+	// Mount offsets are set on vrserver's main thread, and picked up by the pump on its next update
+	void MySetMountOffset( const MyMountOffset &offset );
+
+	// Runs a DebugRequest command, e.g. "set_proxy 3", writing a JSON result into the response buffer
+	void MyRunCommand( const char *pchRequest, char *pchResponseBuffer, uint32_t unResponseBufferSize );
 
 private:
-	unsigned int my_tracker_id_;
+	// Builds our source pose in place. Only ever called from the pump, through MyPoseUpdate: it reads vrserver's poses
+	// into our scratch space, and moves our source fusion's learned offsets along, neither of which is safe to share.
+	void MyFillPose( vr::DriverPose_t &pose, const MyPoseConfig &config, std::chrono::steady_clock::time_point now );
 
-	std::atomic< vr::TrackedDeviceIndex_t > my_device_index_;
+	// The pump's copy of our mount offset, brought up to date first if it's changed. The pump is its only reader, so
+	// only the pump may call this.
+	const MyMountOffset &MyGetMountOffset();
+
+	unsigned int my_tracker_id_;
 
 	std::string my_device_model_number_;
 	std::string my_device_serial_number_;
+	std::string proxy_settings_key_;
+	std::string imu_settings_key_;
+	std::string body_joint_settings_key_;
+	std::string fusion_settings_key_;
+	std::string mount_offset_settings_key_;
 
 	std::array< vr::VRInputComponentHandle_t, MyComponent_MAX > input_handles_;
 
-	std::atomic< bool > is_active_;
-	std::thread my_pose_update_thread_;
+	// The values we want each input component to have, and a bit per component that's changed since we last sent it
+	std::array< float, MyComponent_MAX > input_values_;
+	uint32_t dirty_input_mask_;
+
+	// The pump that schedules our pose updates, shared by all trackers
+	MyPosePump &pose_pump_;
+
+	// The provider's event routing table, which we keep our entry in up to date
+	MyDeviceIndexTable &device_index_table_;
+
+	// Our device index, active flag and hot pose state live in the pump's state table, in this slot
+	MyTrackerStateTable &tracker_states_;
+	uint32_t state_slot_;
+
+	// Where we publish our live state for external monitors, also in our state slot
+	MyTelemetrySegment &telemetry_;
+
+	// Records the poses we read and submit, when recording is turned on
+	MyPoseRecorder &pose_recorder_;
+
+	// Our track in the pump's replay trace, if there is one
+	const MyPoseTraceReplay &pose_replay_;
+	uint32_t replay_track_;
+
+	// Turns the poses we read into the poses we submit, locking and all
+	MyPosePipeline pose_pipeline_;
+
+	// Scratch space for the raw poses we read from vrserver each update
+	std::array< vr::TrackedDevicePose_t, vr::k_unMaxTrackedDeviceCount > raw_poses_;
+
+	// The IMU stream we're reading, and the device it's for, or k_unTrackedDeviceIndexInvalid for none. Opened and
+	// read by the pump, so only the pump touches them while we're on it. A stream that wouldn't open is left
+	// invalid, and not tried again until the device changes.
+	vr::IOBufferHandle_t imu_buffer_;
+	vr::TrackedDeviceIndex_t imu_device_index_;
+
+	// Scratch space for the IMU samples we read each update. Anything more than fits is read in another go.
+	std::array< vr::ImuSample_t, 128 > imu_samples_;
+
+	// Other devices mounted with our proxy target, fused with it into our pose: a byte each, 0xFF for none. Set from
+	// vrserver's main thread and read by the pump once per update, on its own, since it doesn't fit in our config.
+	// Swapping in new ones only means relearning their offsets, so the two being out of step for an update is harmless.
+	std::atomic< uint64_t > fusion_targets_;
+
+	// Fuses our proxy target with those devices. It learns as it goes, so like the rest of our pose state, only the
+	// pump may touch it.
+	MySourceFusion source_fusion_;
 
-	// Our new members for pose locking
-	vr::DriverPose_t last_known_good_pose_;
-	std::atomic< bool > has_last_known_good_pose_;
+	// The last pose we submitted, for GetPose. vrserver calls that on its own thread, so rather than building a pose
+	// there with the pump's scratch space, the pump publishes a copy of each pose it submits under a seqlock: it makes
+	// the sequence odd, writes the copy, then makes it even again. GetPose retries until it reads the copy while the
+	// sequence is even and unchanged throughout.
+	std::atomic< uint32_t > submitted_pose_sequence_;
+	vr::DriverPose_t submitted_pose_;
 
-	// A flag to control whether pose locking is enabled for this device
-	bool pose_locking_enabled_;
+	// Our mount offset, applied to proxied poses. It's too big to swap atomically, so it's set under a seqlock: the
+	// writer makes the sequence odd, writes the shared copy, then makes it even again. Whenever the sequence has moved
+	// on, the pump copies it into its own, keeping the copy only if the sequence was even and unchanged throughout.
+	// mount_offset_ and mount_offset_copied_sequence_ are the pump's alone.
+	std::atomic< uint32_t > mount_offset_sequence_;
+	MyMountOffset shared_mount_offset_;
+	MyMountOffset mount_offset_;
+	uint32_t mount_offset_copied_sequence_;
 
-	// A flag to control whether we are in proxy mode, tracking another device
-	bool proxy_mode_enabled_;
+	// Our MyPoseConfig, packed. Changes are made with MyChangePoseConfig, so concurrent ones can't undo each other.
+	std::atomic< uint64_t > pose_config_;
 
-	// The device index of the real tracker we are currently proxying
-	uint32_t target_device_index_;
+	template < class Change >
+	void MyChangePoseConfig( Change change );
 };
\ No newline at end of file
@@ -0,0 +1,143 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "tracker_state_table.h"
+
+#include <cmath>
+
+#include "rotation_math.h"
+
+MyTrackerStateTable::MyTrackerStateTable()
+{
+	for ( uint32_t slot = 0; slot < k_unMaxSlots; slot++ )
+	{
+		pump_.position_x[ slot ] = pump_.position_y[ slot ] = pump_.position_z[ slot ] = 0.0;
+		pump_.rotation_w[ slot ] = 1.0;
+		pump_.rotation_x[ slot ] = pump_.rotation_y[ slot ] = pump_.rotation_z[ slot ] = 0.0;
+		pump_.velocity_x[ slot ] = pump_.velocity_y[ slot ] = pump_.velocity_z[ slot ] = 0.0;
+		pump_.angular_speed[ slot ] = 0.0;
+		pump_.good_pose_time[ slot ] = std::chrono::steady_clock::time_point();
+		pump_.last_update_time[ slot ] = std::chrono::steady_clock::time_point();
+		pump_.lock_start_time[ slot ] = std::chrono::steady_clock::time_point();
+		pump_.flags[ slot ] = 0;
+
+		stats_.num_submissions[ slot ] = 0;
+		stats_.num_dropouts[ slot ] = 0;
+		stats_.num_rejected_outliers[ slot ] = 0;
+		stats_.total_lock_duration_us[ slot ] = 0;
+		stats_.max_lock_duration_us[ slot ] = 0;
+		for ( uint32_t bucket = 0; bucket < my_num_update_interval_buckets; bucket++ )
+			stats_.update_interval_histogram[ slot ][ bucket ] = 0;
+		stats_.state[ slot ] = MyTrackingState_Inactive;
+		stats_.motion_class[ slot ] = 0;
+
+		main_.device_index[ slot ] = vr::k_unTrackedDeviceIndexInvalid;
+		main_.is_active[ slot ] = false;
+		main_.is_scheduled[ slot ] = false;
+	}
+
+	main_.num_allocated_slots = 0;
+}
+
+uint32_t MyTrackerStateTable::AllocateSlot()
+{
+	if ( main_.num_allocated_slots >= k_unMaxSlots )
+		return k_unInvalidSlot;
+
+	return main_.num_allocated_slots++;
+}
+
+void MyTrackerStateTable::StoreGoodPose( uint32_t slot, const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point now )
+{
+	PumpBlock &pump = pump_;
+
+	if ( pump.flags[ slot ] & MyTrackerStateFlag_HasGoodPose )
+	{
+		const double dt = std::chrono::duration< double >( now - pump.good_pose_time[ slot ] ).count();
+		if ( dt > 0.0 )
+		{
+			pump.velocity_x[ slot ] = ( pose.vecPosition[ 0 ] - pump.position_x[ slot ] ) / dt;
+			pump.velocity_y[ slot ] = ( pose.vecPosition[ 1 ] - pump.position_y[ slot ] ) / dt;
+			pump.velocity_z[ slot ] = ( pose.vecPosition[ 2 ] - pump.position_z[ slot ] ) / dt;
+
+			const vr::HmdQuaternion_t last_rotation = { pump.rotation_w[ slot ], pump.rotation_x[ slot ], pump.rotation_y[ slot ], pump.rotation_z[ slot ] };
+			pump.angular_speed[ slot ] = MyAngleBetween( pose.qRotation, last_rotation ) / dt;
+
+			pump.flags[ slot ] |= MyTrackerStateFlag_HasVelocity;
+		}
+	}
+
+	pump.position_x[ slot ] = pose.vecPosition[ 0 ];
+	pump.position_y[ slot ] = pose.vecPosition[ 1 ];
+	pump.position_z[ slot ] = pose.vecPosition[ 2 ];
+	pump.rotation_w[ slot ] = pose.qRotation.w;
+	pump.rotation_x[ slot ] = pose.qRotation.x;
+	pump.rotation_y[ slot ] = pose.qRotation.y;
+	pump.rotation_z[ slot ] = pose.qRotation.z;
+	pump.good_pose_time[ slot ] = now;
+	pump.flags[ slot ] |= MyTrackerStateFlag_HasGoodPose;
+}
+
+void MyTrackerStateTable::SetPoseIsValid( uint32_t slot, bool is_valid )
+{
+	if ( is_valid )
+		pump_.flags[ slot ] |= MyTrackerStateFlag_PoseIsValid;
+	else
+		pump_.flags[ slot ] &= ~MyTrackerStateFlag_PoseIsValid;
+}
+
+double MyTrackerStateTable::GetLinearSpeed( uint32_t slot ) const
+{
+	return std::sqrt( pump_.velocity_x[ slot ] * pump_.velocity_x[ slot ] + pump_.velocity_y[ slot ] * pump_.velocity_y[ slot ] +
+					  pump_.velocity_z[ slot ] * pump_.velocity_z[ slot ] );
+}
+
+void MyTrackerStateTable::RecordUpdate( uint32_t slot, std::chrono::steady_clock::time_point now )
+{
+	if ( pump_.flags[ slot ] & MyTrackerStateFlag_HasUpdated )
+	{
+		const int64_t interval_us = std::chrono::duration_cast< std::chrono::microseconds >( now - pump_.last_update_time[ slot ] ).count();
+
+		uint32_t bucket = 0;
+		while ( bucket < my_num_update_interval_buckets - 1 && interval_us > my_update_interval_bucket_bounds_us[ bucket ] )
+			bucket++;
+
+		MyIncrement( stats_.update_interval_histogram[ slot ][ bucket ] );
+	}
+
+	pump_.last_update_time[ slot ] = now;
+	pump_.flags[ slot ] |= MyTrackerStateFlag_HasUpdated;
+}
+
+void MyTrackerStateTable::BeginLock( uint32_t slot, std::chrono::steady_clock::time_point now )
+{
+	if ( pump_.flags[ slot ] & MyTrackerStateFlag_IsLocked )
+		return;
+
+	pump_.lock_start_time[ slot ] = now;
+	pump_.flags[ slot ] |= MyTrackerStateFlag_IsLocked;
+}
+
+void MyTrackerStateTable::EndLock( uint32_t slot, std::chrono::steady_clock::time_point now )
+{
+	if ( ( pump_.flags[ slot ] & MyTrackerStateFlag_IsLocked ) == 0 )
+		return;
+
+	pump_.flags[ slot ] &= ~MyTrackerStateFlag_IsLocked;
+
+	const uint64_t duration_us = std::chrono::duration_cast< std::chrono::microseconds >( now - pump_.lock_start_time[ slot ] ).count();
+	stats_.total_lock_duration_us[ slot ].store( stats_.total_lock_duration_us[ slot ].load( std::memory_order_relaxed ) + duration_us, std::memory_order_relaxed );
+	if ( duration_us > stats_.max_lock_duration_us[ slot ].load( std::memory_order_relaxed ) )
+		stats_.max_lock_duration_us[ slot ].store( duration_us, std::memory_order_relaxed );
+}
+
+void MyTrackerStateTable::GetStats( uint32_t slot, MyTrackerStats &stats ) const
+{
+	stats.state = static_cast< MyTrackingState >( stats_.state[ slot ].load( std::memory_order_relaxed ) );
+	stats.motion_class = stats_.motion_class[ slot ].load( std::memory_order_relaxed );
+	stats.num_submissions = stats_.num_submissions[ slot ].load( std::memory_order_relaxed );
+	stats.num_dropouts = stats_.num_dropouts[ slot ].load( std::memory_order_relaxed );
+	stats.num_rejected_outliers = stats_.num_rejected_outliers[ slot ].load( std::memory_order_relaxed );
+	stats.total_lock_duration_us = stats_.total_lock_duration_us[ slot ].load( std::memory_order_relaxed );
+	stats.max_lock_duration_us = stats_.max_lock_duration_us[ slot ].load( std::memory_order_relaxed );
+	for ( uint32_t bucket = 0; bucket < my_num_update_interval_buckets; bucket++ )
+		stats.update_interval_histogram[ bucket ] = stats_.update_interval_histogram[ slot ][ bucket ].load( std::memory_order_relaxed );
+}
@@ -0,0 +1,166 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "openvr_driver.h"
+
+// Assumed size of a cache line. Blocks written by different threads start on their own line.
+#define MY_CACHE_LINE_SIZE 64
+
+enum MyTrackerStateFlags : uint8_t
+{
+	MyTrackerStateFlag_PoseIsValid = 1 << 0,      // The most recent source pose was valid
+	MyTrackerStateFlag_HasGoodPose = 1 << 1,      // We have a last known good pose to fall back on
+	MyTrackerStateFlag_HasVelocity = 1 << 2,      // We've seen two good poses, so velocities are meaningful
+	MyTrackerStateFlag_HasUpdated = 1 << 3,       // The pump has updated this slot at least once
+	MyTrackerStateFlag_IsLocked = 1 << 4,         // We're holding all or part of our last known good pose in place of an invalid one
+};
+
+// What a tracker is currently submitting, as reported in its stats
+enum MyTrackingState : uint8_t
+{
+	MyTrackingState_Inactive,     // Not activated, or not updated by the pump yet
+	MyTrackingState_Tracking,     // Submitting fresh, valid poses
+	MyTrackingState_Locked,       // Source pose is invalid, and we're holding our last known good pose
+	MyTrackingState_Lost,         // Source pose is invalid, and we have nothing to hold
+	MyTrackingState_PartlyLocked, // Only one of the source pose's position and rotation is good: it's live, the other is held
+
+	MyTrackingState_MAX
+};
+
+// Upper bounds, in microseconds, of the buckets the time between a tracker's pose updates is counted into.
+// The final bucket catches everything longer.
+static const uint32_t my_update_interval_bucket_bounds_us[] = { 1500, 3000, 6000, 12000, 25000, 50000 };
+static const uint32_t my_num_update_interval_buckets = sizeof( my_update_interval_bucket_bounds_us ) / sizeof( my_update_interval_bucket_bounds_us[ 0 ] ) + 1;
+
+// A copy of one tracker's stats, taken without stopping the pump
+struct MyTrackerStats
+{
+	MyTrackingState state;
+	uint8_t motion_class;
+	uint64_t num_submissions;
+	uint64_t num_dropouts;
+	uint64_t num_rejected_outliers;
+	uint64_t total_lock_duration_us;
+	uint64_t max_lock_duration_us;
+	uint64_t update_interval_histogram[ my_num_update_interval_buckets ];
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Hot per-tracker state for all of our trackers, laid out as a structure of arrays indexed by slot,
+// so the pose pump streams through contiguous memory instead of hopping between tracker objects.
+// State is grouped by the thread that writes it, and each group starts on its own cache line, so the pump's
+// writes never share a line with the ones vrserver's main thread makes.
+//-----------------------------------------------------------------------------
+class alignas( MY_CACHE_LINE_SIZE ) MyTrackerStateTable
+{
+public:
+	static const uint32_t k_unMaxSlots = vr::k_unMaxTrackedDeviceCount;
+	static const uint32_t k_unInvalidSlot = 0xFFFFFFFF;
+
+	MyTrackerStateTable();
+
+	// Called on vrserver's main thread as trackers are created. Returns k_unInvalidSlot if the table is full.
+	uint32_t AllocateSlot();
+
+	// ----- Written by the pose pump only -----
+
+	// Records a new good pose for a slot, and works out its velocity from the previous good pose.
+	void StoreGoodPose( uint32_t slot, const vr::DriverPose_t &pose, std::chrono::steady_clock::time_point now );
+
+	void SetPoseIsValid( uint32_t slot, bool is_valid );
+
+	bool HasFlags( uint32_t slot, uint8_t flags ) const { return ( pump_.flags[ slot ] & flags ) == flags; }
+	double GetLinearSpeed( uint32_t slot ) const;
+	double GetAngularSpeed( uint32_t slot ) const { return pump_.angular_speed[ slot ]; }
+	std::chrono::steady_clock::time_point GetGoodPoseTime( uint32_t slot ) const { return pump_.good_pose_time[ slot ]; }
+
+	// Counts an update into the slot's update interval histogram, measured from its previous update
+	void RecordUpdate( uint32_t slot, std::chrono::steady_clock::time_point now );
+
+	// Starts or ends holding a last known good pose. Ending a lock adds its duration to the slot's stats.
+	void BeginLock( uint32_t slot, std::chrono::steady_clock::time_point now );
+	void EndLock( uint32_t slot, std::chrono::steady_clock::time_point now );
+
+	void AddSubmission( uint32_t slot ) { MyIncrement( stats_.num_submissions[ slot ] ); }
+	void AddDropout( uint32_t slot ) { MyIncrement( stats_.num_dropouts[ slot ] ); }
+	void AddRejectedOutlier( uint32_t slot ) { MyIncrement( stats_.num_rejected_outliers[ slot ] ); }
+	void SetTrackingState( uint32_t slot, MyTrackingState state ) { stats_.state[ slot ].store( state, std::memory_order_relaxed ); }
+	void SetMotionClass( uint32_t slot, uint8_t motion_class ) { stats_.motion_class[ slot ].store( motion_class, std::memory_order_relaxed ); }
+
+	// ----- Readable from any thread -----
+
+	// Wait-free copy of a slot's stats. Each counter is read atomically, but the pump may move on between them.
+	void GetStats( uint32_t slot, MyTrackerStats &stats ) const;
+
+	// ----- Written by vrserver's main thread only -----
+
+	void SetDeviceIndex( uint32_t slot, vr::TrackedDeviceIndex_t device_index ) { main_.device_index[ slot ].store( device_index, std::memory_order_release ); }
+	vr::TrackedDeviceIndex_t GetDeviceIndex( uint32_t slot ) const { return main_.device_index[ slot ].load( std::memory_order_acquire ); }
+
+	// Sets the active flag, returning what it was before
+	bool ExchangeIsActive( uint32_t slot, bool is_active ) { return main_.is_active[ slot ].exchange( is_active ); }
+	bool IsActive( uint32_t slot ) const { return main_.is_active[ slot ].load( std::memory_order_acquire ); }
+
+	// Whether the pose pump should be updating a slot. The pump checks it before every update, so clearing it takes a
+	// tracker off the pump without waiting for the pump to finish a pass. Sequentially consistent, for the pump's
+	// handshake with RemoveTracker.
+	void SetIsScheduled( uint32_t slot, bool is_scheduled ) { main_.is_scheduled[ slot ].store( is_scheduled ); }
+	bool IsScheduled( uint32_t slot ) const { return main_.is_scheduled[ slot ].load(); }
+
+private:
+	struct alignas( MY_CACHE_LINE_SIZE ) PumpBlock
+	{
+		// Last known good pose
+		double position_x[ k_unMaxSlots ];
+		double position_y[ k_unMaxSlots ];
+		double position_z[ k_unMaxSlots ];
+		double rotation_w[ k_unMaxSlots ];
+		double rotation_x[ k_unMaxSlots ];
+		double rotation_y[ k_unMaxSlots ];
+		double rotation_z[ k_unMaxSlots ];
+
+		// Velocity between the last two good poses, in m/s and rad/s
+		double velocity_x[ k_unMaxSlots ];
+		double velocity_y[ k_unMaxSlots ];
+		double velocity_z[ k_unMaxSlots ];
+		double angular_speed[ k_unMaxSlots ];
+
+		std::chrono::steady_clock::time_point good_pose_time[ k_unMaxSlots ];
+
+		std::chrono::steady_clock::time_point last_update_time[ k_unMaxSlots ];
+		std::chrono::steady_clock::time_point lock_start_time[ k_unMaxSlots ];
+
+		uint8_t flags[ k_unMaxSlots ];
+	};
+
+	// Only the pump writes these, so it can bump them with a plain load and store instead of a locked read-modify-write
+	struct alignas( MY_CACHE_LINE_SIZE ) StatsBlock
+	{
+		std::atomic< uint64_t > num_submissions[ k_unMaxSlots ];
+		std::atomic< uint64_t > num_dropouts[ k_unMaxSlots ];
+		std::atomic< uint64_t > num_rejected_outliers[ k_unMaxSlots ];
+		std::atomic< uint64_t > total_lock_duration_us[ k_unMaxSlots ];
+		std::atomic< uint64_t > max_lock_duration_us[ k_unMaxSlots ];
+		std::atomic< uint64_t > update_interval_histogram[ k_unMaxSlots ][ my_num_update_interval_buckets ];
+		std::atomic< uint8_t > state[ k_unMaxSlots ];
+		std::atomic< uint8_t > motion_class[ k_unMaxSlots ];
+	};
+
+	struct alignas( MY_CACHE_LINE_SIZE ) MainThreadBlock
+	{
+		std::atomic< vr::TrackedDeviceIndex_t > device_index[ k_unMaxSlots ];
+		std::atomic< bool > is_active[ k_unMaxSlots ];
+		std::atomic< bool > is_scheduled[ k_unMaxSlots ];
+		uint32_t num_allocated_slots;
+	};
+
+	static void MyIncrement( std::atomic< uint64_t > &counter ) { counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed ); }
+
+	PumpBlock pump_;
+	StatsBlock stats_;
+	MainThreadBlock main_;
+};
@@ -0,0 +1,250 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_evaluation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+#include "pose_pipeline.h"
+#include "rotation_math.h"
+
+// The angle between two unit quaternions, as w, x, y, z
+static double MyRotationAngle( const double a[ 4 ], const double b[ 4 ] )
+{
+	return MyAngleBetween( { a[ 0 ], a[ 1 ], a[ 2 ], a[ 3 ] }, { b[ 0 ], b[ 1 ], b[ 2 ], b[ 3 ] } );
+}
+
+static double MyDistance( const double a[ 3 ], const double b[ 3 ] )
+{
+	const double dx = a[ 0 ] - b[ 0 ], dy = a[ 1 ] - b[ 1 ], dz = a[ 2 ] - b[ 2 ];
+	return std::sqrt( dx * dx + dy * dy + dz * dz );
+}
+
+void MyPoseErrorMetrics::Add( const MyPoseErrorMetrics &other )
+{
+	duration_s += other.duration_s;
+	num_updates += other.num_updates;
+	num_truth_samples += other.num_truth_samples;
+	num_scored += other.num_scored;
+	sum_pose_age_s += other.sum_pose_age_s;
+	max_pose_age_s = std::max( max_pose_age_s, other.max_pose_age_s );
+	sum_squared_position_error_m += other.sum_squared_position_error_m;
+	max_position_error_m = std::max( max_position_error_m, other.max_position_error_m );
+	sum_squared_rotation_error_rad += other.sum_squared_rotation_error_rad;
+	max_rotation_error_rad = std::max( max_rotation_error_rad, other.max_rotation_error_rad );
+	num_steps += other.num_steps;
+	sum_squared_step_error_m += other.sum_squared_step_error_m;
+	num_reacquisitions += other.num_reacquisitions;
+	sum_snap_m += other.sum_snap_m;
+	max_snap_m = std::max( max_snap_m, other.max_snap_m );
+	sum_snap_rad += other.sum_snap_rad;
+	max_snap_rad = std::max( max_snap_rad, other.max_snap_rad );
+}
+
+double MyPoseErrorMetrics::GetPositionRmse() const
+{
+	return num_scored > 0 ? std::sqrt( sum_squared_position_error_m / num_scored ) : 0.0;
+}
+
+double MyPoseErrorMetrics::GetRotationRmse() const
+{
+	return num_scored > 0 ? std::sqrt( sum_squared_rotation_error_rad / num_scored ) : 0.0;
+}
+
+double MyPoseErrorMetrics::GetMeanSnapDistance() const
+{
+	return num_reacquisitions > 0 ? sum_snap_m / num_reacquisitions : 0.0;
+}
+
+double MyPoseErrorMetrics::GetMeanSnapAngle() const
+{
+	return num_reacquisitions > 0 ? sum_snap_rad / num_reacquisitions : 0.0;
+}
+
+double MyPoseErrorMetrics::GetMeanPoseAge() const
+{
+	return num_scored > 0 ? sum_pose_age_s / num_scored : 0.0;
+}
+
+double MyPoseErrorMetrics::GetJudder() const
+{
+	return num_steps > 0 ? std::sqrt( sum_squared_step_error_m / num_steps ) : 0.0;
+}
+
+double MyPoseErrorMetrics::GetUpdateRate() const
+{
+	return duration_s > 0.0 ? num_updates / duration_s : 0.0;
+}
+
+double MyPoseErrorMetrics::GetCoverage() const
+{
+	return num_truth_samples > 0 ? (double)num_scored / num_truth_samples : 0.0;
+}
+
+void MyEvaluatePipeline( const MyPoseTrack &truth, const MyPoseTrack &source, const MyPipelineRunSettings &settings, MyPoseErrorMetrics &metrics )
+{
+	if ( truth.records.empty() )
+		return;
+
+	// The pipeline keeps its state in a state table slot, just as it does in the driver
+	std::unique_ptr< MyTrackerStateTable > tracker_states = std::make_unique< MyTrackerStateTable >();
+	MyPosePipeline pipeline( *tracker_states, tracker_states->AllocateSlot() );
+	pipeline.SetRateGovernorParams( settings.governor );
+
+	// Pipeline time is on an arbitrary clock, which scenario time zero lines up with
+	const std::chrono::steady_clock::time_point start_time( std::chrono::seconds( 1 ) );
+
+	MyPoseErrorMetrics run = {};
+	run.duration_s = ( truth.records.back().time_ns - truth.records.front().time_ns ) / 1e9;
+
+	// What we're showing: the last pose submitted, and when it came fresh from the source.
+	// Once shown, a pose is remembered after it goes, so we can tell how far the next one jumps from it.
+	bool has_shown_pose = false;
+	bool is_showing_pose = false;
+	bool is_reacquiring = false;
+	double shown_position[ 3 ] = {};
+	double shown_rotation[ 4 ] = { 1.0, 0.0, 0.0, 0.0 };
+	uint64_t shown_time_ns = 0;
+
+	// Where the last fresh pose was, and where the ground truth was at the time, for measuring the next step
+	bool has_step_start = false;
+	double step_start_position[ 3 ] = {};
+	double step_start_truth_position[ 3 ] = {};
+
+	MyPipelineConfig config = {};
+	config.pose_locking_enabled = settings.pose_locking_enabled;
+	config.fixed_update_period =
+		settings.update_rate_hz != 0 ? std::chrono::nanoseconds( 1000000000 / settings.update_rate_hz ) : std::chrono::nanoseconds::zero();
+	config.is_resampling = settings.resample_delay_ms >= 0.0;
+	config.resample_delay = std::chrono::nanoseconds( (int64_t)( std::max( settings.resample_delay_ms, 0.0 ) * 1e6 ) );
+
+	uint64_t update_time_ns = truth.records.front().time_ns;
+	size_t imu_cursor = 0;
+
+	for ( const MyPoseTraceRecord &truth_record : truth.records )
+	{
+		// Make every update the pump would have made by now
+		while ( update_time_ns <= truth_record.time_ns )
+		{
+			vr::DriverPose_t &source_pose = pipeline.GetSourcePose();
+			source_pose.qWorldFromDriverRotation.w = 1.f;
+			source_pose.qDriverFromHeadRotation.w = 1.f;
+			source_pose.deviceIsConnected = true;
+
+			const MyPoseTraceRecord *source_record = MyFindPoseRecord( source, update_time_ns );
+			if ( source_record != nullptr )
+			{
+				MyPoseFromTraceRecord( *source_record, source_pose );
+			}
+			else
+			{
+				source_pose.poseIsValid = false;
+				source_pose.result = vr::TrackingResult_Uninitialized;
+			}
+
+			// Everything the IMU has read by now arrives ahead of the update, as the driver reads it
+			while ( settings.use_imu && imu_cursor < source.imu_samples.size() && source.imu_samples[ imu_cursor ].fSampleTime * 1e9 <= update_time_ns )
+				pipeline.AddImuSample( source.imu_samples[ imu_cursor++ ] );
+
+			const bool source_is_valid = source_pose.poseIsValid;
+			const vr::DriverPose_t *submitted_pose = pipeline.Update( config, start_time + std::chrono::nanoseconds( update_time_ns ) );
+			run.num_updates++;
+
+			if ( !source_is_valid && has_shown_pose )
+				is_reacquiring = true;
+
+			if ( submitted_pose != nullptr && submitted_pose->poseIsValid )
+			{
+				const double position[ 3 ] = { submitted_pose->vecPosition[ 0 ], submitted_pose->vecPosition[ 1 ], submitted_pose->vecPosition[ 2 ] };
+				const double rotation[ 4 ] = { submitted_pose->qRotation.w, submitted_pose->qRotation.x, submitted_pose->qRotation.y,
+					submitted_pose->qRotation.z };
+
+				if ( source_is_valid )
+				{
+					// The first fresh pose after the source went away: how far do we jump from what we were showing?
+					if ( is_reacquiring )
+					{
+						const double snap_m = MyDistance( position, shown_position );
+						const double snap_rad = MyRotationAngle( rotation, shown_rotation );
+
+						run.num_reacquisitions++;
+						run.sum_snap_m += snap_m;
+						run.max_snap_m = std::max( run.max_snap_m, snap_m );
+						run.sum_snap_rad += snap_rad;
+						run.max_snap_rad = std::max( run.max_snap_rad, snap_rad );
+					}
+
+					const MyPoseTraceRecord *step_truth_record = MyFindPoseRecord( truth, update_time_ns );
+					if ( step_truth_record != nullptr && step_truth_record->pose_is_valid )
+					{
+						const double truth_position[ 3 ] = { step_truth_record->position[ 0 ], step_truth_record->position[ 1 ],
+							step_truth_record->position[ 2 ] };
+
+						if ( has_step_start )
+						{
+							double squared_step_error = 0.0;
+							for ( int axis = 0; axis < 3; axis++ )
+							{
+								const double error = ( position[ axis ] - step_start_position[ axis ] ) - ( truth_position[ axis ] - step_start_truth_position[ axis ] );
+								squared_step_error += error * error;
+							}
+
+							run.num_steps++;
+							run.sum_squared_step_error_m += squared_step_error;
+						}
+
+						std::copy( position, position + 3, step_start_position );
+						std::copy( truth_position, truth_position + 3, step_start_truth_position );
+						has_step_start = true;
+					}
+
+					// A resampled pose is from resample_delay ago, whenever the source took its samples
+					is_reacquiring = false;
+					shown_time_ns = config.is_resampling ? update_time_ns - std::min< uint64_t >( config.resample_delay.count(), update_time_ns )
+														 : source_record->time_ns;
+				}
+
+				std::copy( position, position + 3, shown_position );
+				std::copy( rotation, rotation + 4, shown_rotation );
+				has_shown_pose = true;
+				is_showing_pose = true;
+			}
+			else
+			{
+				is_showing_pose = false;
+			}
+
+			// Steps are only measured between fresh poses that follow each other
+			if ( !source_is_valid )
+				has_step_start = false;
+
+			// Next update when the pump would make it
+			update_time_ns += std::max< int64_t >( pipeline.GetUpdatePeriod().count(), 1 );
+		}
+
+		if ( !truth_record.pose_is_valid )
+			continue;
+
+		run.num_truth_samples++;
+		if ( !is_showing_pose )
+			continue;
+
+		const double truth_position[ 3 ] = { truth_record.position[ 0 ], truth_record.position[ 1 ], truth_record.position[ 2 ] };
+		const double truth_rotation[ 4 ] = { truth_record.rotation[ 0 ], truth_record.rotation[ 1 ], truth_record.rotation[ 2 ], truth_record.rotation[ 3 ] };
+
+		const double position_error_m = MyDistance( shown_position, truth_position );
+		const double rotation_error_rad = MyRotationAngle( shown_rotation, truth_rotation );
+		const double pose_age_s = ( truth_record.time_ns - shown_time_ns ) / 1e9;
+
+		run.num_scored++;
+		run.sum_squared_position_error_m += position_error_m * position_error_m;
+		run.max_position_error_m = std::max( run.max_position_error_m, position_error_m );
+		run.sum_squared_rotation_error_rad += rotation_error_rad * rotation_error_rad;
+		run.max_rotation_error_rad = std::max( run.max_rotation_error_rad, rotation_error_rad );
+		run.sum_pose_age_s += pose_age_s;
+		run.max_pose_age_s = std::max( run.max_pose_age_s, pose_age_s );
+	}
+
+	metrics.Add( run );
+}
@@ -0,0 +1,67 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstdint>
+
+#include "motion_rate_governor.h"
+#include "pose_scenario.h"
+
+// How the pipeline is run over a scenario
+struct MyPipelineRunSettings
+{
+	bool pose_locking_enabled;
+	uint32_t update_rate_hz; // A fixed update rate, or 0 to let the pipeline choose, as the driver does
+	double resample_delay_ms; // Negative to submit source poses as they come
+	bool use_imu;             // Feed the pipeline the source's IMU samples, if it has any
+	MyMotionRateGovernorParams governor;
+};
+
+// How far the poses we were showing were from ground truth, accumulated over one or more runs.
+// Scored at every ground truth sample, against whatever pose was last submitted, since that's what the user sees.
+struct MyPoseErrorMetrics
+{
+	double duration_s;
+	uint64_t num_updates;
+	uint64_t num_truth_samples; // Samples where the ground truth pose was valid
+	uint64_t num_scored;        // ...and we were showing a valid pose to compare with it
+
+	// How old the pose we were showing was: how long since the source sample it came from was taken
+	double sum_pose_age_s;
+	double max_pose_age_s;
+
+	double sum_squared_position_error_m;
+	double max_position_error_m;
+	double sum_squared_rotation_error_rad;
+	double max_rotation_error_rad;
+
+	// How unevenly the pose moved from one update to the next: the difference between each step it took between
+	// updates showing fresh poses and the step the ground truth took over the same time
+	uint64_t num_steps;
+	double sum_squared_step_error_m;
+
+	// How far the submitted pose jumped when the source came back after being invalid
+	uint64_t num_reacquisitions;
+	double sum_snap_m;
+	double max_snap_m;
+	double sum_snap_rad;
+	double max_snap_rad;
+
+	void Add( const MyPoseErrorMetrics &other );
+
+	double GetPositionRmse() const;
+	double GetRotationRmse() const;
+	double GetMeanSnapDistance() const;
+	double GetMeanSnapAngle() const;
+	double GetMeanPoseAge() const;
+	double GetJudder() const;
+
+	// Updates per second, per tracker
+	double GetUpdateRate() const;
+
+	// Fraction of the time there was something to track that we submitted a valid pose
+	double GetCoverage() const;
+};
+
+// Runs the driver's pose pipeline over the source track, scheduled the way the pose pump would schedule it,
+// and scores what it submits against the truth track. Adds the results to metrics.
+void MyEvaluatePipeline( const MyPoseTrack &truth, const MyPoseTrack &source, const MyPipelineRunSettings &settings, MyPoseErrorMetrics &metrics );
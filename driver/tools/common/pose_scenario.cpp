@@ -0,0 +1,453 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_scenario.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#include "pose_trace_replay.h"
+#include "vrmath.h"
+
+// Step used to work out velocities from the synthetic motion
+static const double my_velocity_step_s = 0.0001;
+
+// Step used to work out what an IMU would read from a track. Records only keep floats, so much shorter and the
+// rounding in the positions swamps the acceleration.
+static const uint64_t my_imu_step_ns = 10000000;
+
+// Gravity, as an accelerometer at rest reads it: straight up
+static const double my_gravity_mps2 = 9.80665;
+
+// A stretch of time some corruption is applied over, from start to end
+struct MyCorruptionWindow
+{
+	uint64_t start_ns;
+	uint64_t end_ns;
+	double offset[ 3 ]; // Teleport direction, unused otherwise
+};
+
+const MyPoseTraceRecord *MyFindPoseRecord( const MyPoseTrack &track, uint64_t time_ns )
+{
+	const auto next = std::upper_bound( track.records.begin(), track.records.end(), time_ns,
+		[]( uint64_t time, const MyPoseTraceRecord &record ) { return time < record.time_ns; } );
+	if ( next == track.records.begin() )
+		return nullptr;
+
+	return &*( next - 1 );
+}
+
+static vr::HmdQuaternion_t MyAxisAngle( double x, double y, double z, double angle )
+{
+	const double s = std::sin( angle * 0.5 );
+	return { std::cos( angle * 0.5 ), x * s, y * s, z * s };
+}
+
+// Where one body part is at time t while walking. Walking is along -z, with y up.
+static void MyGetWalkingPose( const MyWalkingMotionParams &params, int body_part, double t, double position[ 3 ], vr::HmdQuaternion_t &rotation )
+{
+	const double gait_frequency = params.step_frequency_hz * 0.5; // One full cycle of each foot
+	const double stride_length = params.walking_speed_mps / gait_frequency;
+	const double progress = params.walking_speed_mps * t;
+
+	// Left side first, then right, half a cycle apart
+	const double side = ( body_part == 1 || body_part == 3 ) ? -1.0 : 1.0;
+	const double cycle = gait_frequency * t + ( side > 0.0 ? 0.5 : 0.0 );
+
+	switch ( body_part )
+	{
+		case 0: // Hips: bob twice per cycle, and twist a little with each stride
+		{
+			position[ 0 ] = 0.0;
+			position[ 1 ] = 0.95 + 0.02 * std::cos( 2.0 * M_PI * params.step_frequency_hz * t );
+			position[ 2 ] = -progress;
+			rotation = MyAxisAngle( 0.0, 1.0, 0.0, 0.1 * std::sin( 2.0 * M_PI * gait_frequency * t ) );
+			break;
+		}
+
+		case 1:
+		case 2: // Feet: planted for 60% of the cycle, then swing a stride forward, lifting and pitching as they go
+		{
+			const double swing_fraction = 0.4;
+			const double completed_strides = std::floor( cycle );
+			const double phase = cycle - completed_strides;
+
+			double stride_progress = 1.0;
+			double lift = 0.0;
+			if ( phase < swing_fraction )
+			{
+				stride_progress = 0.5 - 0.5 * std::cos( M_PI * phase / swing_fraction );
+				lift = std::sin( M_PI * phase / swing_fraction );
+			}
+
+			position[ 0 ] = side * 0.1;
+			position[ 1 ] = 0.05 + 0.1 * lift;
+			position[ 2 ] = -( completed_strides + stride_progress ) * stride_length;
+			rotation = MyAxisAngle( 1.0, 0.0, 0.0, 0.4 * lift );
+			break;
+		}
+
+		default: // Wrists: swing from the shoulder, opposite to the foot on the same side
+		{
+			const double arm_length = 0.6;
+			const double swing = DEG_TO_RAD( params.arm_swing_deg ) * std::sin( 2.0 * M_PI * ( cycle + 0.5 ) );
+
+			position[ 0 ] = side * 0.2;
+			position[ 1 ] = 1.4 - arm_length * std::cos( swing );
+			position[ 2 ] = -progress - arm_length * std::sin( swing );
+			rotation = MyAxisAngle( 1.0, 0.0, 0.0, swing );
+			break;
+		}
+	}
+}
+
+void MyGenerateWalkingMotion( const MyWalkingMotionParams &params, std::vector< MyPoseTrack > &tracks )
+{
+	static const char *const body_parts[] = { "synthetic_hips", "synthetic_left_foot", "synthetic_right_foot", "synthetic_left_wrist",
+		"synthetic_right_wrist" };
+
+	const uint64_t num_samples = (uint64_t)( params.duration_s * params.rate_hz ) + 1;
+
+	tracks.clear();
+	for ( int body_part = 0; body_part < 5; body_part++ )
+	{
+		MyPoseTrack track;
+		track.serial_number = body_parts[ body_part ];
+		track.records.resize( num_samples );
+
+		for ( uint64_t sample = 0; sample < num_samples; sample++ )
+		{
+			const double t = sample / params.rate_hz;
+
+			MyPoseTraceRecord &record = track.records[ sample ];
+			record = {};
+			record.time_ns = (uint64_t)std::llround( t * 1e9 );
+			record.slot = (uint8_t)body_part;
+			record.kind = MyPoseTraceRecordKind_Source;
+			record.pose_is_valid = 1;
+			record.tracking_result = vr::TrackingResult_Running_OK;
+
+			double position[ 3 ], before[ 3 ], after[ 3 ];
+			vr::HmdQuaternion_t rotation, rotation_before, rotation_after;
+			MyGetWalkingPose( params, body_part, t, position, rotation );
+			MyGetWalkingPose( params, body_part, t - my_velocity_step_s, before, rotation_before );
+			MyGetWalkingPose( params, body_part, t + my_velocity_step_s, after, rotation_after );
+
+			// Angular velocity from the rotation between the two neighbouring poses, which is small enough to treat
+			// its vector part as half the rotation vector
+			vr::HmdQuaternion_t delta = rotation_after * -rotation_before;
+			if ( delta.w < 0.0 )
+				delta = { -delta.w, -delta.x, -delta.y, -delta.z };
+			const double delta_components[ 3 ] = { delta.x, delta.y, delta.z };
+
+			for ( int axis = 0; axis < 3; axis++ )
+			{
+				record.position[ axis ] = (float)position[ axis ];
+				record.velocity[ axis ] = (float)( ( after[ axis ] - before[ axis ] ) / ( 2.0 * my_velocity_step_s ) );
+				record.angular_velocity[ axis ] = (float)( delta_components[ axis ] / my_velocity_step_s );
+			}
+			record.rotation[ 0 ] = (float)rotation.w;
+			record.rotation[ 1 ] = (float)rotation.x;
+			record.rotation[ 2 ] = (float)rotation.y;
+			record.rotation[ 3 ] = (float)rotation.z;
+		}
+
+		tracks.push_back( std::move( track ) );
+	}
+}
+
+bool MyLoadTraceTracks( const char *path, double rate_hz, std::vector< MyPoseTrack > &tracks )
+{
+	// The replay runs on whatever clock we give it, so play it on one that starts at an arbitrary point
+	const std::chrono::steady_clock::time_point start_time( std::chrono::seconds( 1 ) );
+
+	MyPoseTraceReplay replay;
+	if ( !replay.Open( path, 1.0, false, start_time ) )
+		return false;
+
+	const uint64_t num_samples = (uint64_t)( std::chrono::duration< double >( replay.GetDuration() ).count() * rate_hz ) + 1;
+
+	tracks.clear();
+	for ( uint32_t track = 0; track < MyTrackerStateTable::k_unMaxSlots; track++ )
+	{
+		const char *serial_number = replay.GetSerialNumber( track );
+		if ( serial_number == nullptr )
+			continue;
+
+		MyPoseTrack loaded;
+		loaded.serial_number = serial_number;
+		loaded.records.resize( num_samples );
+
+		vr::DriverPose_t pose = {};
+		for ( uint64_t sample = 0; sample < num_samples; sample++ )
+		{
+			const uint64_t time_ns = (uint64_t)std::llround( sample / rate_hz * 1e9 );
+			replay.GetPose( track, start_time + std::chrono::nanoseconds( time_ns ), pose );
+
+			MyPoseTraceRecord &record = loaded.records[ sample ];
+			record = {};
+			record.time_ns = time_ns;
+			record.slot = (uint8_t)tracks.size();
+			record.kind = MyPoseTraceRecordKind_Source;
+			MyPoseToTraceRecord( pose, record );
+		}
+
+		tracks.push_back( std::move( loaded ) );
+	}
+
+	return true;
+}
+
+bool MyWriteTraceTracks( const char *path, const std::vector< MyPoseTrack > &tracks )
+{
+	if ( tracks.size() > MyTrackerStateTable::k_unMaxSlots )
+		return false;
+
+	FILE *file = fopen( path, "wb" );
+	if ( file == nullptr )
+		return false;
+
+	MyPoseTraceHeader header = {};
+	memcpy( header.magic, my_pose_trace_magic, sizeof( header.magic ) );
+	header.version = my_pose_trace_version;
+	header.header_size = sizeof( MyPoseTraceHeader );
+	header.record_size = sizeof( MyPoseTraceRecord );
+	header.num_slots = MyTrackerStateTable::k_unMaxSlots;
+	header.session_start_unix_ns =
+		std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::system_clock::now().time_since_epoch() ).count();
+	for ( size_t track = 0; track < tracks.size(); track++ )
+		snprintf( header.serial_numbers[ track ], sizeof( header.serial_numbers[ track ] ), "%s", tracks[ track ].serial_number.c_str() );
+
+	// Interleave the tracks in time order, the way the recorder would have written them
+	std::vector< MyPoseTraceRecord > records;
+	for ( size_t track = 0; track < tracks.size(); track++ )
+	{
+		for ( MyPoseTraceRecord record : tracks[ track ].records )
+		{
+			record.slot = (uint8_t)track;
+			record.kind = MyPoseTraceRecordKind_Source;
+			records.push_back( record );
+		}
+	}
+	std::stable_sort( records.begin(), records.end(),
+		[]( const MyPoseTraceRecord &a, const MyPoseTraceRecord &b ) { return a.time_ns < b.time_ns; } );
+
+	const bool written = fwrite( &header, sizeof( header ), 1, file ) == 1 &&
+						 fwrite( records.data(), sizeof( MyPoseTraceRecord ), records.size(), file ) == records.size();
+	return fclose( file ) == 0 && written;
+}
+
+// Lays out random windows of one kind of corruption over [0, end_ns)
+static void MyGenerateWindows( const MyCorruptionStats &stats, uint64_t end_ns, std::mt19937_64 &random, std::vector< MyCorruptionWindow > &windows )
+{
+	windows.clear();
+	if ( stats.rate_hz <= 0.0 || stats.mean_duration_ms <= 0.0 )
+		return;
+
+	std::exponential_distribution< double > gap_s( stats.rate_hz );
+	std::exponential_distribution< double > duration_s( 1000.0 / stats.mean_duration_ms );
+	std::normal_distribution< double > direction;
+
+	for ( double t = gap_s( random ); t * 1e9 < end_ns; t += gap_s( random ) )
+	{
+		MyCorruptionWindow window;
+		window.start_ns = (uint64_t)( t * 1e9 );
+		window.end_ns = window.start_ns + (uint64_t)( duration_s( random ) * 1e9 );
+
+		// A uniformly random direction
+		double length = 0.0;
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			window.offset[ axis ] = direction( random );
+			length += window.offset[ axis ] * window.offset[ axis ];
+		}
+		length = std::sqrt( std::max( length, 1e-12 ) );
+		for ( int axis = 0; axis < 3; axis++ )
+			window.offset[ axis ] /= length;
+
+		windows.push_back( window );
+
+		// Events don't overlap: the next one can only start after this one's over
+		t = std::max( t, window.end_ns * 1e-9 );
+	}
+}
+
+// The window covering time_ns, if any. cursor carries on from where the last call left off, so times must only go up.
+static const MyCorruptionWindow *MyFindWindow( const std::vector< MyCorruptionWindow > &windows, size_t &cursor, uint64_t time_ns )
+{
+	while ( cursor < windows.size() && windows[ cursor ].end_ns <= time_ns )
+		cursor++;
+
+	if ( cursor < windows.size() && windows[ cursor ].start_ns <= time_ns )
+		return &windows[ cursor ];
+
+	return nullptr;
+}
+
+// What an IMU carried along track would read, worked out from the track's own poses
+static void MyGenerateImuSamples( const MyPoseTrack &track, const MyImuParams &params, std::mt19937_64 &random, std::vector< vr::ImuSample_t > &samples )
+{
+	samples.clear();
+	if ( params.rate_hz <= 0.0 || track.records.size() < 2 )
+		return;
+
+	std::normal_distribution< double > gyro_noise( 0.0, params.gyro_noise_rad_s ), gyro_bias( 0.0, params.gyro_bias_rad_s );
+	std::normal_distribution< double > accel_noise( 0.0, params.accel_noise_mps2 ), accel_bias( 0.0, params.accel_bias_mps2 );
+
+	double gyro_offset[ 3 ], accel_offset[ 3 ];
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		gyro_offset[ axis ] = gyro_bias( random );
+		accel_offset[ axis ] = accel_bias( random );
+	}
+
+	const uint64_t start_ns = track.records.front().time_ns + my_imu_step_ns;
+	const uint64_t end_ns = track.records.back().time_ns - std::min( my_imu_step_ns, track.records.back().time_ns );
+	const double step_s = my_imu_step_ns / 1e9;
+
+	for ( double time_ns = (double)start_ns; time_ns <= (double)end_ns; time_ns += 1e9 / params.rate_hz )
+	{
+		const uint64_t t = (uint64_t)time_ns;
+		const MyPoseTraceRecord &before = *MyFindPoseRecord( track, t - my_imu_step_ns );
+		const MyPoseTraceRecord &now = *MyFindPoseRecord( track, t );
+		const MyPoseTraceRecord &after = *MyFindPoseRecord( track, t + my_imu_step_ns );
+
+		const vr::HmdQuaternion_t rotation = { now.rotation[ 0 ], now.rotation[ 1 ], now.rotation[ 2 ], now.rotation[ 3 ] };
+		const vr::HmdQuaternion_t rotation_before = { before.rotation[ 0 ], before.rotation[ 1 ], before.rotation[ 2 ], before.rotation[ 3 ] };
+		const vr::HmdQuaternion_t rotation_after = { after.rotation[ 0 ], after.rotation[ 1 ], after.rotation[ 2 ], after.rotation[ 3 ] };
+
+		// The gyro reads in the tracker's own frame, so the turn is the one from before to after as seen from before.
+		// It's small enough to treat its vector part as half the rotation vector.
+		vr::HmdQuaternion_t turn = -rotation_before * rotation_after;
+		if ( turn.w < 0.0 )
+			turn = { -turn.w, -turn.x, -turn.y, -turn.z };
+
+		// The accelerometer reads how we're accelerating, plus gravity, turned into the tracker's own frame
+		double acceleration[ 3 ];
+		for ( int axis = 0; axis < 3; axis++ )
+			acceleration[ axis ] = ( (double)after.position[ axis ] - 2.0 * now.position[ axis ] + before.position[ axis ] ) / ( step_s * step_s );
+		acceleration[ 1 ] += my_gravity_mps2;
+
+		const vr::HmdQuaternion_t world_acceleration = { 0.0, acceleration[ 0 ], acceleration[ 1 ], acceleration[ 2 ] };
+		const vr::HmdQuaternion_t local_acceleration = -rotation * world_acceleration * rotation;
+
+		vr::ImuSample_t sample = {};
+		sample.fSampleTime = time_ns / 1e9;
+		sample.vGyro.v[ 0 ] = turn.x / step_s + gyro_offset[ 0 ] + gyro_noise( random );
+		sample.vGyro.v[ 1 ] = turn.y / step_s + gyro_offset[ 1 ] + gyro_noise( random );
+		sample.vGyro.v[ 2 ] = turn.z / step_s + gyro_offset[ 2 ] + gyro_noise( random );
+		sample.vAccel.v[ 0 ] = local_acceleration.x + accel_offset[ 0 ] + accel_noise( random );
+		sample.vAccel.v[ 1 ] = local_acceleration.y + accel_offset[ 1 ] + accel_noise( random );
+		sample.vAccel.v[ 2 ] = local_acceleration.z + accel_offset[ 2 ] + accel_noise( random );
+		samples.push_back( sample );
+	}
+}
+
+static void MyMarkLost( MyPoseTraceRecord &record )
+{
+	record.pose_is_valid = 0;
+	record.tracking_result = vr::TrackingResult_Running_OutOfRange;
+}
+
+void MyCorruptTracks( const std::vector< MyPoseTrack > &truth, const MyCorruptionParams &params, std::vector< MyPoseTrack > &source )
+{
+	source.clear();
+
+	for ( size_t track = 0; track < truth.size(); track++ )
+	{
+		const MyPoseTrack &clean = truth[ track ];
+
+		MyPoseTrack corrupted;
+		corrupted.serial_number = clean.serial_number;
+		corrupted.records.reserve( clean.records.size() );
+
+		// Each track gets its own sequence, so adding a track doesn't change what happens to the others
+		std::mt19937_64 random( params.seed * 0x9E3779B97F4A7C15ull + track );
+		std::uniform_real_distribution< double > uniform;
+
+		const uint64_t end_ns = clean.records.empty() ? 0 : clean.records.back().time_ns + 1;
+		std::vector< MyCorruptionWindow > dropouts, flicker, teleports, latency_spikes, position_losses;
+		MyGenerateWindows( params.dropouts, end_ns, random, dropouts );
+		MyGenerateWindows( params.flicker, end_ns, random, flicker );
+		MyGenerateWindows( params.teleports, end_ns, random, teleports );
+		MyGenerateWindows( params.latency_spikes, end_ns, random, latency_spikes );
+		MyGenerateWindows( params.position_losses, end_ns, random, position_losses );
+
+		size_t dropout_cursor = 0, flicker_cursor = 0, teleport_cursor = 0, latency_cursor = 0, position_loss_cursor = 0;
+		const uint64_t latency_ns = (uint64_t)( params.latency_spike_ms * 1e6 );
+
+		// Where the position was when the current position loss started, to drift away from
+		const MyCorruptionWindow *position_loss = nullptr;
+		float position_loss_start[ 3 ] = {};
+
+		// When the tracker takes its own samples. It has its own sequence too, so the timing doesn't change what
+		// corruption we get.
+		std::mt19937_64 timing_random( params.seed * 0xC2B2AE3D27D4EB4Full + track );
+		const double sample_period_ns = params.source_rate_hz > 0.0 ? 1e9 / params.source_rate_hz : 0.0;
+		double next_sample_ns = clean.records.empty() ? 0.0 : (double)clean.records.front().time_ns;
+
+		for ( const MyPoseTraceRecord &truth_record : clean.records )
+		{
+			const uint64_t time_ns = truth_record.time_ns;
+			MyPoseTraceRecord record = truth_record;
+
+			// Draw for every sample, so the flicker pattern doesn't depend on the other kinds of corruption
+			const bool flickered_out = uniform( random ) < params.flicker_invalid_fraction;
+
+			// Between the tracker's samples, the source still has the last one
+			if ( (double)time_ns < next_sample_ns )
+				continue;
+
+			next_sample_ns += sample_period_ns * ( 1.0 + params.source_jitter_fraction * ( 2.0 * uniform( timing_random ) - 1.0 ) );
+
+			if ( MyFindWindow( latency_spikes, latency_cursor, time_ns ) != nullptr )
+			{
+				// What the tracker saw latency_ns ago, arriving now
+				const MyPoseTraceRecord *late = time_ns >= latency_ns ? MyFindPoseRecord( clean, time_ns - latency_ns ) : nullptr;
+				if ( late != nullptr )
+					record = *late;
+				else
+					MyMarkLost( record );
+
+				record.time_ns = time_ns;
+			}
+
+			if ( const MyCorruptionWindow *teleport = MyFindWindow( teleports, teleport_cursor, time_ns ) )
+			{
+				for ( int axis = 0; axis < 3; axis++ )
+					record.position[ axis ] += (float)( teleport->offset[ axis ] * params.teleport_distance_m );
+			}
+
+			if ( const MyCorruptionWindow *window = MyFindWindow( position_losses, position_loss_cursor, time_ns ) )
+			{
+				if ( window != position_loss )
+				{
+					position_loss = window;
+					std::copy( record.position, record.position + 3, position_loss_start );
+				}
+
+				const double drift_m = params.position_drift_mps * ( time_ns - window->start_ns ) / 1e9;
+				for ( int axis = 0; axis < 3; axis++ )
+					record.position[ axis ] = position_loss_start[ axis ] + (float)( window->offset[ axis ] * drift_m );
+
+				record.tracking_result = vr::TrackingResult_Running_OutOfRange;
+			}
+
+			if ( MyFindWindow( flicker, flicker_cursor, time_ns ) != nullptr && flickered_out )
+				MyMarkLost( record );
+
+			if ( MyFindWindow( dropouts, dropout_cursor, time_ns ) != nullptr )
+				MyMarkLost( record );
+
+			corrupted.records.push_back( record );
+		}
+
+		// The IMU's noise has a sequence of its own too
+		std::mt19937_64 imu_random( params.seed * 0x165667B19E3779F9ull + track );
+		MyGenerateImuSamples( clean, params.imu, imu_random, corrupted.imu_samples );
+
+		source.push_back( std::move( corrupted ) );
+	}
+}
@@ -0,0 +1,97 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pose_trace.h"
+
+// One tracker's poses through a scenario, in time order. Times are from the start of the scenario.
+struct MyPoseTrack
+{
+	std::string serial_number;
+	std::vector< MyPoseTraceRecord > records;
+
+	// What the tracker's IMU read through the scenario, in the tracker's own frame, if it has one
+	std::vector< vr::ImuSample_t > imu_samples;
+};
+
+// The last record at or before time_ns, or nullptr if the track hasn't started yet
+const MyPoseTraceRecord *MyFindPoseRecord( const MyPoseTrack &track, uint64_t time_ns );
+
+// Synthetic full-body walking: hips, feet and wrists, sampled at rate_hz
+struct MyWalkingMotionParams
+{
+	double duration_s;
+	double rate_hz;
+	double walking_speed_mps;
+	double step_frequency_hz; // Steps per second, counting both feet
+	double arm_swing_deg;     // Either side of hanging straight down
+};
+
+void MyGenerateWalkingMotion( const MyWalkingMotionParams &params, std::vector< MyPoseTrack > &tracks );
+
+// Samples every track of a recorded trace (raw or compressed) at rate_hz, exactly as the driver's replay would see it.
+// Returns false if the trace couldn't be opened.
+bool MyLoadTraceTracks( const char *path, double rate_hz, std::vector< MyPoseTrack > &tracks );
+
+// Writes tracks out as a raw trace of source records, in the slot order they're in, so the driver can replay them
+bool MyWriteTraceTracks( const char *path, const std::vector< MyPoseTrack > &tracks );
+
+// Events of one kind of corruption arrive at random, rate_hz on average, each lasting an exponentially distributed
+// time with a mean of mean_duration_ms. A rate of zero turns that kind off.
+struct MyCorruptionStats
+{
+	double rate_hz;
+	double mean_duration_ms;
+};
+
+// The IMU a tracker carries, read rate_hz times a second. Every reading is off by gaussian noise with the given
+// standard deviation, on top of a bias per axis that's drawn once per track, also with the given standard deviation.
+// A rate of zero means the tracker has no IMU.
+struct MyImuParams
+{
+	double rate_hz;
+	double gyro_noise_rad_s;
+	double gyro_bias_rad_s;
+	double accel_noise_mps2;
+	double accel_bias_mps2;
+};
+
+struct MyCorruptionParams
+{
+	uint64_t seed;
+
+	// The pose goes invalid, as if the tracker were occluded
+	MyCorruptionStats dropouts;
+
+	// The pose flickers between valid and invalid, each sample independently invalid with flicker_invalid_fraction
+	MyCorruptionStats flicker;
+	double flicker_invalid_fraction;
+
+	// The pose jumps teleport_distance_m away in a random direction, while still claiming to be valid
+	MyCorruptionStats teleports;
+	double teleport_distance_m;
+
+	// The pose arrives latency_spike_ms late, but still valid
+	MyCorruptionStats latency_spikes;
+	double latency_spike_ms;
+
+	// The tracker loses sight of whatever it tracks position by, and carries on with its IMU: still valid, and the
+	// rotation's still right, but the tracking result says it's out of range and the position drifts off at
+	// position_drift_mps in a random direction
+	MyCorruptionStats position_losses;
+	double position_drift_mps;
+
+	// How often the tracker takes its own samples, which the source holds on to in between. Each interval is off
+	// by up to source_jitter_fraction of the period, either way. A rate of zero keeps every ground truth sample.
+	double source_rate_hz;
+	double source_jitter_fraction;
+
+	// The IMU keeps reading right through all of the above
+	MyImuParams imu;
+};
+
+// Builds the source the driver sees from the ground truth, track by track
+void MyCorruptTracks( const std::vector< MyPoseTrack > &truth, const MyCorruptionParams &params, std::vector< MyPoseTrack > &source );
@@ -0,0 +1,123 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "scenario_options.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+void MySetDefaultScenarioBuildOptions( MyScenarioBuildOptions &options )
+{
+	options.sample_rate_hz = 1000.0;
+	options.walking = { 60.0, 0.0, 1.2, 1.8, 25.0 };
+	options.corruption.seed = 1;
+	options.corruption.dropouts = { 0.2, 150.0 };
+	options.corruption.flicker = { 0.1, 300.0 };
+	options.corruption.flicker_invalid_fraction = 0.5;
+	options.corruption.teleports = { 0.05, 20.0 };
+	options.corruption.teleport_distance_m = 0.5;
+	options.corruption.latency_spikes = { 0.1, 200.0 };
+	options.corruption.latency_spike_ms = 50.0;
+	options.corruption.position_losses = { 0.1, 500.0 };
+	options.corruption.position_drift_mps = 0.5;
+	options.corruption.source_rate_hz = 0.0;
+	options.corruption.source_jitter_fraction = 0.0;
+	options.corruption.imu = { 500.0, 0.007, 0.005, 0.05, 0.05 };
+}
+
+bool MyParseScenarioBuildOption( const char *name, const char *value, MyScenarioBuildOptions &options )
+{
+	const double number = atof( value );
+
+	if ( strcmp( name, "--walk-seconds" ) == 0 )
+		options.walking.duration_s = number;
+	else if ( strcmp( name, "--walk-speed" ) == 0 )
+		options.walking.walking_speed_mps = number;
+	else if ( strcmp( name, "--step-rate" ) == 0 )
+		options.walking.step_frequency_hz = number;
+	else if ( strcmp( name, "--arm-swing" ) == 0 )
+		options.walking.arm_swing_deg = number;
+	else if ( strcmp( name, "--sample-rate" ) == 0 )
+		options.sample_rate_hz = number;
+	else if ( strcmp( name, "--seed" ) == 0 )
+		options.corruption.seed = strtoull( value, nullptr, 10 );
+	else if ( strcmp( name, "--dropout-rate" ) == 0 )
+		options.corruption.dropouts.rate_hz = number;
+	else if ( strcmp( name, "--dropout-ms" ) == 0 )
+		options.corruption.dropouts.mean_duration_ms = number;
+	else if ( strcmp( name, "--flicker-rate" ) == 0 )
+		options.corruption.flicker.rate_hz = number;
+	else if ( strcmp( name, "--flicker-ms" ) == 0 )
+		options.corruption.flicker.mean_duration_ms = number;
+	else if ( strcmp( name, "--flicker-fraction" ) == 0 )
+		options.corruption.flicker_invalid_fraction = number;
+	else if ( strcmp( name, "--teleport-rate" ) == 0 )
+		options.corruption.teleports.rate_hz = number;
+	else if ( strcmp( name, "--teleport-ms" ) == 0 )
+		options.corruption.teleports.mean_duration_ms = number;
+	else if ( strcmp( name, "--teleport-distance" ) == 0 )
+		options.corruption.teleport_distance_m = number;
+	else if ( strcmp( name, "--latency-rate" ) == 0 )
+		options.corruption.latency_spikes.rate_hz = number;
+	else if ( strcmp( name, "--latency-ms" ) == 0 )
+		options.corruption.latency_spikes.mean_duration_ms = number;
+	else if ( strcmp( name, "--latency-delay" ) == 0 )
+		options.corruption.latency_spike_ms = number;
+	else if ( strcmp( name, "--position-loss-rate" ) == 0 )
+		options.corruption.position_losses.rate_hz = number;
+	else if ( strcmp( name, "--position-loss-ms" ) == 0 )
+		options.corruption.position_losses.mean_duration_ms = number;
+	else if ( strcmp( name, "--position-drift" ) == 0 )
+		options.corruption.position_drift_mps = number;
+	else if ( strcmp( name, "--source-rate" ) == 0 )
+		options.corruption.source_rate_hz = number;
+	else if ( strcmp( name, "--source-jitter" ) == 0 )
+		options.corruption.source_jitter_fraction = number;
+	else if ( strcmp( name, "--imu-rate" ) == 0 )
+		options.corruption.imu.rate_hz = number;
+	else if ( strcmp( name, "--gyro-noise" ) == 0 )
+		options.corruption.imu.gyro_noise_rad_s = number;
+	else if ( strcmp( name, "--gyro-bias" ) == 0 )
+		options.corruption.imu.gyro_bias_rad_s = number;
+	else if ( strcmp( name, "--accel-noise" ) == 0 )
+		options.corruption.imu.accel_noise_mps2 = number;
+	else if ( strcmp( name, "--accel-bias" ) == 0 )
+		options.corruption.imu.accel_bias_mps2 = number;
+	else
+		return false;
+
+	return true;
+}
+
+bool MyFinishScenarioBuildOptions( MyScenarioBuildOptions &options )
+{
+	options.walking.rate_hz = options.sample_rate_hz;
+	return options.sample_rate_hz > 0.0;
+}
+
+void MyPrintScenarioBuildUsage()
+{
+	fprintf( stderr,
+		"  synthetic motion, when no trace is given:\n"
+		"    --walk-seconds <s>           (default 60)\n"
+		"    --walk-speed <m/s>           (default 1.2)\n"
+		"    --step-rate <hz>             steps per second, both feet (default 1.8)\n"
+		"    --arm-swing <deg>            (default 25)\n"
+		"    --sample-rate <hz>           rate the ground truth is sampled at (default 1000)\n"
+		"  corruption injected into the source the driver sees:\n"
+		"    --seed <n>                   (default 1)\n"
+		"    --dropout-rate <hz>          --dropout-ms <ms>        (default 0.2, 150)\n"
+		"    --flicker-rate <hz>          --flicker-ms <ms>        (default 0.1, 300)\n"
+		"    --flicker-fraction <0..1>    samples lost while flickering (default 0.5)\n"
+		"    --teleport-rate <hz>         --teleport-ms <ms>       (default 0.05, 20)\n"
+		"    --teleport-distance <m>      (default 0.5)\n"
+		"    --latency-rate <hz>          --latency-ms <ms>        (default 0.1, 200)\n"
+		"    --latency-delay <ms>         how late poses arrive during a spike (default 50)\n"
+		"    --position-loss-rate <hz>    --position-loss-ms <ms>  rotation only, position drifting (default 0.1, 500)\n"
+		"    --position-drift <m/s>       how fast the position drifts while lost (default 0.5)\n"
+		"    --source-rate <hz>           rate the tracker takes its own samples at, 0 for every sample (default 0)\n"
+		"    --source-jitter <0..1>       how irregular its samples are, as a fraction of its period (default 0)\n"
+		"  the tracker's IMU, which reads right through the corruption:\n"
+		"    --imu-rate <hz>              0 for no IMU (default 500)\n"
+		"    --gyro-noise <rad/s>         --gyro-bias <rad/s>      (default 0.007, 0.005)\n"
+		"    --accel-noise <m/s2>         --accel-bias <m/s2>      (default 0.05, 0.05)\n" );
+}
@@ -0,0 +1,23 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include "pose_scenario.h"
+
+// Command line options shared by every tool that builds scenarios: the synthetic motion and the corruption injected
+// into it. Rates are in events per second, and durations in milliseconds.
+struct MyScenarioBuildOptions
+{
+	double sample_rate_hz;
+	MyWalkingMotionParams walking;
+	MyCorruptionParams corruption;
+};
+
+void MySetDefaultScenarioBuildOptions( MyScenarioBuildOptions &options );
+
+// Returns false if name isn't one of ours
+bool MyParseScenarioBuildOption( const char *name, const char *value, MyScenarioBuildOptions &options );
+
+// Call once everything is parsed. Returns false if the options don't make sense.
+bool MyFinishScenarioBuildOptions( MyScenarioBuildOptions &options );
+
+void MyPrintScenarioBuildUsage();
@@ -0,0 +1,47 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "tool_driver_context.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "openvr_driver.h"
+
+class MyToolDriverLog : public vr::IVRDriverLog
+{
+public:
+	void Log( const char *pchLogMessage ) override
+	{
+		fprintf( stderr, "%s", pchLogMessage );
+		if ( pchLogMessage[ 0 ] == 0 || pchLogMessage[ strlen( pchLogMessage ) - 1 ] != '\n' )
+			fputc( '\n', stderr );
+	}
+};
+
+class MyToolDriverContext : public vr::IVRDriverContext
+{
+public:
+	void *GetGenericInterface( const char *pchInterfaceVersion, vr::EVRInitError *peError ) override
+	{
+		if ( strcmp( pchInterfaceVersion, vr::IVRDriverLog_Version ) == 0 )
+		{
+			if ( peError != nullptr )
+				*peError = vr::VRInitError_None;
+			return &driver_log_;
+		}
+
+		if ( peError != nullptr )
+			*peError = vr::VRInitError_Init_InterfaceNotFound;
+		return nullptr;
+	}
+
+	vr::DriverHandle_t GetDriverHandle() override { return vr::k_ulInvalidDriverHandle; }
+
+private:
+	MyToolDriverLog driver_log_;
+};
+
+void MyInitToolDriverContext()
+{
+	static MyToolDriverContext context;
+	vr::VRDriverContext() = &context;
+}
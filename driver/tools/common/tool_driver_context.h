@@ -0,0 +1,6 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+// Sets up just enough of a driver context for driver code running in an offline tool: DriverLog goes to stderr,
+// and every other interface is unavailable. Call once, before using any driver code.
+void MyInitToolDriverContext();
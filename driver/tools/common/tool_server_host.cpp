@@ -0,0 +1,338 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "tool_server_host.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Where the HMD sits, standing still, for the whole run
+static const float my_tool_hmd_height_m = 1.7f;
+
+// The handle of the source device's IMU stream, the only IO buffer there is
+static const vr::IOBufferHandle_t my_tool_imu_buffer = 1;
+
+MyToolServerHost::MyToolServerHost()
+{
+	next_component_handle_ = 1;
+	num_submitted_poses_ = 0;
+	num_dropped_poses_ = 0;
+	source_device_index_ = vr::k_unTrackedDeviceIndexInvalid;
+	source_pose_ = {};
+	num_source_imu_samples_read_ = 0;
+}
+
+void MyToolServerHost::SetSetting( const char *section, const char *key, const char *value )
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	settings_[ std::string( section ) + "/" + key ] = value;
+}
+
+void MyToolServerHost::ReserveSubmittedPoses( size_t capacity )
+{
+	submitted_poses_.resize( capacity );
+	num_submitted_poses_ = 0;
+	num_dropped_poses_ = 0;
+}
+
+void MyToolServerHost::AddSourceDevice( vr::TrackedDeviceIndex_t device_index, const char *tracking_system_name, const char *serial_number )
+{
+	source_device_index_ = device_index;
+	source_pose_ = {};
+	source_imu_path_ = std::string( "/devices/" ) + tracking_system_name + "/" + serial_number + "/imu";
+
+	// Where the driver looks for the stream's path. Strings are kept with their terminator, the way drivers write them.
+	const vr::PropertyContainerHandle_t container = TrackedDeviceToPropertyContainer( device_index );
+	std::lock_guard< std::mutex > lock( mutex_ );
+	properties_[ { container, vr::Prop_TrackingSystemName_String } ] =
+		{ vr::k_unStringPropertyTag, std::string( tracking_system_name, strlen( tracking_system_name ) + 1 ) };
+	properties_[ { container, vr::Prop_SerialNumber_String } ] = { vr::k_unStringPropertyTag, std::string( serial_number, strlen( serial_number ) + 1 ) };
+}
+
+void MyToolServerHost::SetSourcePose( const vr::TrackedDevicePose_t &pose )
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	source_pose_ = pose;
+}
+
+void MyToolServerHost::AddSourceImuSample( const vr::ImuSample_t &sample )
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	source_imu_samples_.push_back( sample );
+}
+
+void *MyToolServerHost::GetGenericInterface( const char *pchInterfaceVersion, vr::EVRInitError *peError )
+{
+	void *driver_interface = nullptr;
+	if ( strcmp( pchInterfaceVersion, vr::IVRServerDriverHost_Version ) == 0 )
+		driver_interface = static_cast< vr::IVRServerDriverHost * >( this );
+	else if ( strcmp( pchInterfaceVersion, vr::IVRSettings_Version ) == 0 )
+		driver_interface = static_cast< vr::IVRSettings * >( this );
+	else if ( strcmp( pchInterfaceVersion, vr::IVRProperties_Version ) == 0 )
+		driver_interface = static_cast< vr::IVRProperties * >( this );
+	else if ( strcmp( pchInterfaceVersion, vr::IVRDriverInput_Version ) == 0 )
+		driver_interface = static_cast< vr::IVRDriverInput * >( this );
+	else if ( strcmp( pchInterfaceVersion, vr::IVRDriverLog_Version ) == 0 )
+		driver_interface = static_cast< vr::IVRDriverLog * >( this );
+	else if ( strcmp( pchInterfaceVersion, vr::IVRIOBuffer_Version ) == 0 )
+		driver_interface = static_cast< vr::IVRIOBuffer * >( this );
+	else if ( strcmp( pchInterfaceVersion, vr::IVRDriverManager_Version ) == 0 )
+		driver_interface = static_cast< vr::IVRDriverManager * >( this );
+	else if ( strcmp( pchInterfaceVersion, vr::IVRResources_Version ) == 0 )
+		driver_interface = static_cast< vr::IVRResources * >( this );
+
+	if ( peError != nullptr )
+		*peError = driver_interface != nullptr ? vr::VRInitError_None : vr::VRInitError_Init_InterfaceNotFound;
+	return driver_interface;
+}
+
+bool MyToolServerHost::TrackedDeviceAdded( const char *, vr::ETrackedDeviceClass, vr::ITrackedDeviceServerDriver *pDriver )
+{
+	// Index 0 is the HMD's
+	devices_.push_back( pDriver );
+	pDriver->Activate( (uint32_t)devices_.size() );
+	return true;
+}
+
+void MyToolServerHost::TrackedDevicePoseUpdated( uint32_t unWhichDevice, const vr::DriverPose_t &newPose, uint32_t )
+{
+	if ( num_submitted_poses_ >= submitted_poses_.size() )
+	{
+		num_dropped_poses_++;
+		return;
+	}
+
+	MySubmittedPose &submitted = submitted_poses_[ num_submitted_poses_++ ];
+	submitted.device_index = unWhichDevice;
+	submitted.pose = newPose;
+}
+
+void MyToolServerHost::GetRawTrackedDevicePoses( float, vr::TrackedDevicePose_t *pTrackedDevicePoseArray, uint32_t unTrackedDeviceCount )
+{
+	// Only the HMD and the source device are real. Everything else is out of range.
+	std::lock_guard< std::mutex > lock( mutex_ );
+	for ( uint32_t device_index = 0; device_index < unTrackedDeviceCount; device_index++ )
+	{
+		vr::TrackedDevicePose_t &pose = pTrackedDevicePoseArray[ device_index ];
+		if ( device_index == source_device_index_ )
+		{
+			pose = source_pose_;
+			continue;
+		}
+
+		pose = {};
+		pose.bDeviceIsConnected = device_index == vr::k_unTrackedDeviceIndex_Hmd;
+		pose.bPoseIsValid = pose.bDeviceIsConnected;
+		pose.eTrackingResult = pose.bPoseIsValid ? vr::TrackingResult_Running_OK : vr::TrackingResult_Uninitialized;
+		pose.mDeviceToAbsoluteTracking.m[ 0 ][ 0 ] = 1.f;
+		pose.mDeviceToAbsoluteTracking.m[ 1 ][ 1 ] = 1.f;
+		pose.mDeviceToAbsoluteTracking.m[ 2 ][ 2 ] = 1.f;
+		if ( pose.bPoseIsValid )
+			pose.mDeviceToAbsoluteTracking.m[ 1 ][ 3 ] = my_tool_hmd_height_m;
+	}
+}
+
+bool MyToolServerHost::MyGetSetting( const char *section, const char *key, std::string &value, vr::EVRSettingsError *peError )
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	const auto setting = settings_.find( std::string( section ) + "/" + key );
+	const bool is_set = setting != settings_.end();
+	if ( is_set )
+		value = setting->second;
+
+	if ( peError != nullptr )
+		*peError = is_set ? vr::VRSettingsError_None : vr::VRSettingsError_UnsetSettingHasNoDefault;
+	return is_set;
+}
+
+void MyToolServerHost::SetBool( const char *pchSection, const char *pchSettingsKey, bool bValue, vr::EVRSettingsError *peError )
+{
+	SetSetting( pchSection, pchSettingsKey, bValue ? "true" : "false" );
+	if ( peError != nullptr )
+		*peError = vr::VRSettingsError_None;
+}
+
+void MyToolServerHost::SetInt32( const char *pchSection, const char *pchSettingsKey, int32_t nValue, vr::EVRSettingsError *peError )
+{
+	SetSetting( pchSection, pchSettingsKey, std::to_string( nValue ).c_str() );
+	if ( peError != nullptr )
+		*peError = vr::VRSettingsError_None;
+}
+
+void MyToolServerHost::SetFloat( const char *pchSection, const char *pchSettingsKey, float flValue, vr::EVRSettingsError *peError )
+{
+	char value[ 32 ];
+	snprintf( value, sizeof( value ), "%.9g", flValue );
+	SetSetting( pchSection, pchSettingsKey, value );
+	if ( peError != nullptr )
+		*peError = vr::VRSettingsError_None;
+}
+
+void MyToolServerHost::SetString( const char *pchSection, const char *pchSettingsKey, const char *pchValue, vr::EVRSettingsError *peError )
+{
+	SetSetting( pchSection, pchSettingsKey, pchValue );
+	if ( peError != nullptr )
+		*peError = vr::VRSettingsError_None;
+}
+
+bool MyToolServerHost::GetBool( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError )
+{
+	std::string value;
+	return MyGetSetting( pchSection, pchSettingsKey, value, peError ) && ( value == "true" || value == "1" );
+}
+
+int32_t MyToolServerHost::GetInt32( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError )
+{
+	std::string value;
+	return MyGetSetting( pchSection, pchSettingsKey, value, peError ) ? (int32_t)strtol( value.c_str(), nullptr, 10 ) : 0;
+}
+
+float MyToolServerHost::GetFloat( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError )
+{
+	std::string value;
+	return MyGetSetting( pchSection, pchSettingsKey, value, peError ) ? (float)atof( value.c_str() ) : 0.f;
+}
+
+void MyToolServerHost::GetString( const char *pchSection, const char *pchSettingsKey, char *pchValue, uint32_t unValueLen, vr::EVRSettingsError *peError )
+{
+	std::string value;
+	MyGetSetting( pchSection, pchSettingsKey, value, peError );
+	if ( unValueLen > 0 )
+		snprintf( pchValue, unValueLen, "%s", value.c_str() );
+}
+
+vr::ETrackedPropertyError MyToolServerHost::ReadPropertyBatch( vr::PropertyContainerHandle_t ulContainerHandle, vr::PropertyRead_t *pBatch, uint32_t unBatchEntryCount )
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	for ( uint32_t entry = 0; entry < unBatchEntryCount; entry++ )
+	{
+		vr::PropertyRead_t &read = pBatch[ entry ];
+		const auto property = properties_.find( { ulContainerHandle, read.prop } );
+		if ( property == properties_.end() )
+		{
+			read.eError = vr::TrackedProp_UnknownProperty;
+			continue;
+		}
+
+		const std::string &value = property->second.second;
+		read.unTag = property->second.first;
+		read.unRequiredBufferSize = (uint32_t)value.size();
+		if ( read.unBufferSize < value.size() )
+		{
+			read.eError = vr::TrackedProp_BufferTooSmall;
+			continue;
+		}
+
+		memcpy( read.pvBuffer, value.data(), value.size() );
+		read.eError = vr::TrackedProp_Success;
+	}
+
+	return vr::TrackedProp_Success;
+}
+
+vr::ETrackedPropertyError MyToolServerHost::WritePropertyBatch( vr::PropertyContainerHandle_t ulContainerHandle, vr::PropertyWrite_t *pBatch, uint32_t unBatchEntryCount )
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	for ( uint32_t entry = 0; entry < unBatchEntryCount; entry++ )
+	{
+		vr::PropertyWrite_t &write = pBatch[ entry ];
+		if ( write.writeType == vr::PropertyWrite_Set )
+		{
+			properties_[ { ulContainerHandle, write.prop } ] =
+				{ write.unTag, std::string( static_cast< const char * >( write.pvBuffer ), write.unBufferSize ) };
+		}
+		else if ( write.writeType == vr::PropertyWrite_Erase )
+		{
+			properties_.erase( { ulContainerHandle, write.prop } );
+		}
+
+		write.eError = vr::TrackedProp_Success;
+	}
+
+	return vr::TrackedProp_Success;
+}
+
+vr::VRInputComponentHandle_t MyToolServerHost::MyNextComponentHandle()
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	return next_component_handle_++;
+}
+
+vr::EVRInputError MyToolServerHost::CreateBooleanComponent( vr::PropertyContainerHandle_t, const char *, vr::VRInputComponentHandle_t *pHandle )
+{
+	*pHandle = MyNextComponentHandle();
+	return vr::VRInputError_None;
+}
+
+vr::EVRInputError MyToolServerHost::CreateScalarComponent( vr::PropertyContainerHandle_t, const char *, vr::VRInputComponentHandle_t *pHandle, vr::EVRScalarType, vr::EVRScalarUnits )
+{
+	*pHandle = MyNextComponentHandle();
+	return vr::VRInputError_None;
+}
+
+vr::EVRInputError MyToolServerHost::CreateHapticComponent( vr::PropertyContainerHandle_t, const char *, vr::VRInputComponentHandle_t *pHandle )
+{
+	*pHandle = MyNextComponentHandle();
+	return vr::VRInputError_None;
+}
+
+vr::EVRInputError MyToolServerHost::CreateSkeletonComponent( vr::PropertyContainerHandle_t, const char *, const char *, const char *, vr::EVRSkeletalTrackingLevel,
+	const vr::VRBoneTransform_t *, uint32_t, vr::VRInputComponentHandle_t *pHandle )
+{
+	*pHandle = MyNextComponentHandle();
+	return vr::VRInputError_None;
+}
+
+void MyToolServerHost::Log( const char *pchLogMessage )
+{
+	fprintf( stderr, "%s", pchLogMessage );
+	if ( pchLogMessage[ 0 ] == 0 || pchLogMessage[ strlen( pchLogMessage ) - 1 ] != '\n' )
+		fputc( '\n', stderr );
+}
+
+vr::EIOBufferError MyToolServerHost::Open( const char *pchPath, vr::EIOBufferMode, uint32_t, uint32_t, vr::IOBufferHandle_t *pulBuffer )
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	if ( source_imu_path_.empty() || source_imu_path_ != pchPath )
+	{
+		*pulBuffer = vr::k_ulInvalidIOBufferHandle;
+		return vr::IOBuffer_PathDoesNotExist;
+	}
+
+	// A reader only sees what's sent after it opens the stream
+	num_source_imu_samples_read_ = source_imu_samples_.size();
+	*pulBuffer = my_tool_imu_buffer;
+	return vr::IOBuffer_Success;
+}
+
+vr::EIOBufferError MyToolServerHost::Close( vr::IOBufferHandle_t ulBuffer )
+{
+	return ulBuffer == my_tool_imu_buffer ? vr::IOBuffer_Success : vr::IOBuffer_InvalidHandle;
+}
+
+vr::EIOBufferError MyToolServerHost::Read( vr::IOBufferHandle_t ulBuffer, void *pDst, uint32_t unBytes, uint32_t *punRead )
+{
+	*punRead = 0;
+	if ( ulBuffer != my_tool_imu_buffer )
+		return vr::IOBuffer_InvalidHandle;
+
+	// Whole samples only, as many as fit
+	std::lock_guard< std::mutex > lock( mutex_ );
+	const size_t num_samples = std::min( (size_t)( unBytes / sizeof( vr::ImuSample_t ) ), source_imu_samples_.size() - num_source_imu_samples_read_ );
+	if ( num_samples > 0 )
+		memcpy( pDst, source_imu_samples_.data() + num_source_imu_samples_read_, num_samples * sizeof( vr::ImuSample_t ) );
+	num_source_imu_samples_read_ += num_samples;
+	*punRead = (uint32_t)( num_samples * sizeof( vr::ImuSample_t ) );
+	return vr::IOBuffer_Success;
+}
+
+uint32_t MyToolServerHost::GetDriverName( vr::DriverId_t nDriver, char *pchValue, uint32_t unBufferSize )
+{
+	static const char my_tool_driver_name[] = "simpletrackers";
+	if ( nDriver != 0 )
+		return 0;
+
+	if ( unBufferSize > 0 )
+		snprintf( pchValue, unBufferSize, "%s", my_tool_driver_name );
+	return sizeof( my_tool_driver_name );
+}
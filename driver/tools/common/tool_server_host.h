@@ -0,0 +1,153 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "openvr_driver.h"
+
+// A pose the driver handed to vrserver, in the order it was submitted
+struct MySubmittedPose
+{
+	uint32_t device_index;
+	vr::DriverPose_t pose;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Just enough of vrserver to run the whole driver inside an offline tool. Settings are whatever the tool sets
+// before Init, the HMD sits still and valid, there are no events, and every pose the driver submits is kept, so runs
+// can be compared. Devices the driver adds are activated straight away, from index 1 on. A tool can add one more
+// device of its own for the driver to follow, moved by hand between frames, with an IMU stream the only IO buffer.
+//-----------------------------------------------------------------------------
+class MyToolServerHost : public vr::IVRDriverContext,
+						 public vr::IVRServerDriverHost,
+						 public vr::IVRSettings,
+						 public vr::IVRProperties,
+						 public vr::IVRDriverInput,
+						 public vr::IVRDriverLog,
+						 public vr::IVRIOBuffer,
+						 public vr::IVRDriverManager,
+						 public vr::IVRResources
+{
+public:
+	MyToolServerHost();
+
+	void SetSetting( const char *section, const char *key, const char *value );
+
+	// Every device the driver added, by device index minus one
+	const std::vector< vr::ITrackedDeviceServerDriver * > &GetDevices() const { return devices_; }
+
+	// Makes room for this many submitted poses. The pose pump mustn't allocate, so any more than this are dropped.
+	// Call before Init.
+	void ReserveSubmittedPoses( size_t capacity );
+
+	// Every pose submitted so far, and how many didn't fit. Only safe to read while the driver isn't running its pose pump.
+	size_t GetNumSubmittedPoses() const { return num_submitted_poses_; }
+	const MySubmittedPose &GetSubmittedPose( size_t index ) const { return submitted_poses_[ index ]; }
+	uint64_t GetNumDroppedPoses() const { return num_dropped_poses_; }
+
+	// Adds a device at device_index, well clear of the driver's own, publishing its IMU's samples at
+	// /devices/<tracking system>/<serial number>/imu. It starts out disconnected. Call before Init.
+	void AddSourceDevice( vr::TrackedDeviceIndex_t device_index, const char *tracking_system_name, const char *serial_number );
+
+	// Moves the source device, and has its IMU send another sample. Only safe between frames.
+	void SetSourcePose( const vr::TrackedDevicePose_t &pose );
+	void AddSourceImuSample( const vr::ImuSample_t &sample );
+
+	// IVRDriverContext
+	void *GetGenericInterface( const char *pchInterfaceVersion, vr::EVRInitError *peError ) override;
+	vr::DriverHandle_t GetDriverHandle() override { return 1; }
+
+	// IVRServerDriverHost
+	bool TrackedDeviceAdded( const char *pchDeviceSerialNumber, vr::ETrackedDeviceClass eDeviceClass, vr::ITrackedDeviceServerDriver *pDriver ) override;
+	void TrackedDevicePoseUpdated( uint32_t unWhichDevice, const vr::DriverPose_t &newPose, uint32_t unPoseStructSize ) override;
+	void VsyncEvent( double ) override {}
+	void VendorSpecificEvent( uint32_t, vr::EVREventType, const vr::VREvent_Data_t &, double ) override {}
+	bool IsExiting() override { return false; }
+	bool PollNextEvent( vr::VREvent_t *, uint32_t ) override { return false; }
+	void GetRawTrackedDevicePoses( float fPredictedSecondsFromNow, vr::TrackedDevicePose_t *pTrackedDevicePoseArray, uint32_t unTrackedDeviceCount ) override;
+	void RequestRestart( const char *, const char *, const char *, const char * ) override {}
+	uint32_t GetFrameTimings( vr::Compositor_FrameTiming *, uint32_t ) override { return 0; }
+	void SetDisplayEyeToHead( uint32_t, const vr::HmdMatrix34_t &, const vr::HmdMatrix34_t & ) override {}
+	void SetDisplayProjectionRaw( uint32_t, const vr::HmdRect2_t &, const vr::HmdRect2_t & ) override {}
+	void SetRecommendedRenderTargetSize( uint32_t, uint32_t, uint32_t ) override {}
+
+	// IVRSettings. Numbers and bools are stored as text, the way they'd be written in a settings file.
+	const char *GetSettingsErrorNameFromEnum( vr::EVRSettingsError ) override { return ""; }
+	void SetBool( const char *pchSection, const char *pchSettingsKey, bool bValue, vr::EVRSettingsError *peError ) override;
+	void SetInt32( const char *pchSection, const char *pchSettingsKey, int32_t nValue, vr::EVRSettingsError *peError ) override;
+	void SetFloat( const char *pchSection, const char *pchSettingsKey, float flValue, vr::EVRSettingsError *peError ) override;
+	void SetString( const char *pchSection, const char *pchSettingsKey, const char *pchValue, vr::EVRSettingsError *peError ) override;
+	bool GetBool( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError ) override;
+	int32_t GetInt32( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError ) override;
+	float GetFloat( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError ) override;
+	void GetString( const char *pchSection, const char *pchSettingsKey, char *pchValue, uint32_t unValueLen, vr::EVRSettingsError *peError ) override;
+	void RemoveSection( const char *, vr::EVRSettingsError * ) override {}
+	void RemoveKeyInSection( const char *, const char *, vr::EVRSettingsError * ) override {}
+
+	// IVRProperties
+	vr::ETrackedPropertyError ReadPropertyBatch( vr::PropertyContainerHandle_t ulContainerHandle, vr::PropertyRead_t *pBatch, uint32_t unBatchEntryCount ) override;
+	vr::ETrackedPropertyError WritePropertyBatch( vr::PropertyContainerHandle_t ulContainerHandle, vr::PropertyWrite_t *pBatch, uint32_t unBatchEntryCount ) override;
+	const char *GetPropErrorNameFromEnum( vr::ETrackedPropertyError ) override { return ""; }
+	vr::PropertyContainerHandle_t TrackedDeviceToPropertyContainer( vr::TrackedDeviceIndex_t nDevice ) override { return nDevice + 1; }
+
+	// IVRDriverInput. Components get handles, and their updates go nowhere.
+	vr::EVRInputError CreateBooleanComponent( vr::PropertyContainerHandle_t, const char *, vr::VRInputComponentHandle_t *pHandle ) override;
+	vr::EVRInputError UpdateBooleanComponent( vr::VRInputComponentHandle_t, bool, double ) override { return vr::VRInputError_None; }
+	vr::EVRInputError CreateScalarComponent( vr::PropertyContainerHandle_t, const char *, vr::VRInputComponentHandle_t *pHandle, vr::EVRScalarType, vr::EVRScalarUnits ) override;
+	vr::EVRInputError UpdateScalarComponent( vr::VRInputComponentHandle_t, float, double ) override { return vr::VRInputError_None; }
+	vr::EVRInputError CreateHapticComponent( vr::PropertyContainerHandle_t, const char *, vr::VRInputComponentHandle_t *pHandle ) override;
+	vr::EVRInputError CreateSkeletonComponent( vr::PropertyContainerHandle_t, const char *, const char *, const char *, vr::EVRSkeletalTrackingLevel,
+		const vr::VRBoneTransform_t *, uint32_t, vr::VRInputComponentHandle_t *pHandle ) override;
+	vr::EVRInputError UpdateSkeletonComponent( vr::VRInputComponentHandle_t, vr::EVRSkeletalMotionRange, const vr::VRBoneTransform_t *, uint32_t ) override { return vr::VRInputError_None; }
+
+	// IVRDriverLog, to stderr
+	void Log( const char *pchLogMessage ) override;
+
+	// IVRIOBuffer. The source device's IMU stream is the only one, and it can only be read.
+	vr::EIOBufferError Open( const char *pchPath, vr::EIOBufferMode, uint32_t, uint32_t, vr::IOBufferHandle_t *pulBuffer ) override;
+	vr::EIOBufferError Close( vr::IOBufferHandle_t ulBuffer ) override;
+	vr::EIOBufferError Read( vr::IOBufferHandle_t ulBuffer, void *pDst, uint32_t unBytes, uint32_t *punRead ) override;
+	vr::EIOBufferError Write( vr::IOBufferHandle_t, void *, uint32_t ) override { return vr::IOBuffer_InvalidHandle; }
+	vr::PropertyContainerHandle_t PropertyContainer( vr::IOBufferHandle_t ) override { return vr::k_ulInvalidPropertyContainer; }
+	bool HasReaders( vr::IOBufferHandle_t ) override { return false; }
+
+	// IVRDriverManager. We're the only driver.
+	uint32_t GetDriverCount() const override { return 1; }
+	uint32_t GetDriverName( vr::DriverId_t nDriver, char *pchValue, uint32_t unBufferSize ) override;
+	vr::DriverHandle_t GetDriverHandle( const char * ) override { return 1; }
+	bool IsEnabled( vr::DriverId_t nDriver ) const override { return nDriver == 0; }
+
+	// IVRResources. There aren't any.
+	uint32_t LoadSharedResource( const char *, char *, uint32_t ) override { return 0; }
+	uint32_t GetResourceFullPath( const char *, const char *, char *, uint32_t ) override { return 0; }
+
+private:
+	bool MyGetSetting( const char *section, const char *key, std::string &value, vr::EVRSettingsError *peError );
+
+	vr::VRInputComponentHandle_t MyNextComponentHandle();
+
+	// The driver reads settings and properties from both of its threads
+	std::mutex mutex_;
+	std::map< std::string, std::string > settings_;
+	std::map< std::pair< vr::PropertyContainerHandle_t, vr::ETrackedDeviceProperty >, std::pair< vr::PropertyTypeTag_t, std::string > > properties_;
+	vr::VRInputComponentHandle_t next_component_handle_;
+
+	std::vector< vr::ITrackedDeviceServerDriver * > devices_;
+
+	vr::TrackedDeviceIndex_t source_device_index_;
+	vr::TrackedDevicePose_t source_pose_;
+	std::string source_imu_path_;
+
+	// Samples the source's IMU has sent, and how many of them the driver's read
+	std::vector< vr::ImuSample_t > source_imu_samples_;
+	size_t num_source_imu_samples_read_;
+
+	// Only the pose pump submits
+	std::vector< MySubmittedPose > submitted_poses_;
+	size_t num_submitted_poses_;
+	uint64_t num_dropped_poses_;
+};
@@ -0,0 +1,122 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+
+// The pool, and our index in it, if this thread is one of its workers
+static thread_local MyWorkStealingPool *my_current_pool = nullptr;
+static thread_local uint32_t my_current_worker_index = 0;
+
+MyWorkStealingPool::MyWorkStealingPool( uint32_t num_workers )
+	: num_queued_( 0 ), num_unfinished_( 0 ), is_stopping_( false ), next_queue_( 0 )
+{
+	if ( num_workers == 0 )
+		num_workers = std::max( std::thread::hardware_concurrency(), 1u );
+
+	for ( uint32_t i = 0; i < num_workers; i++ )
+		queues_.push_back( std::make_unique< MyWorkerQueue >() );
+
+	for ( uint32_t i = 0; i < num_workers; i++ )
+		threads_.emplace_back( &MyWorkStealingPool::WorkerMain, this, i );
+}
+
+MyWorkStealingPool::~MyWorkStealingPool()
+{
+	{
+		std::unique_lock< std::mutex > lock( mutex_ );
+		is_stopping_ = true;
+	}
+	work_condition_.notify_all();
+
+	for ( std::thread &thread : threads_ )
+		thread.join();
+}
+
+void MyWorkStealingPool::Submit( std::function< void() > task )
+{
+	const uint32_t index =
+		my_current_pool == this ? my_current_worker_index : next_queue_.fetch_add( 1, std::memory_order_relaxed ) % (uint32_t)queues_.size();
+
+	// Counted before it's queued, so it can't be finished before it's counted. A worker that wakes up in between
+	// just looks again.
+	{
+		std::unique_lock< std::mutex > lock( mutex_ );
+		num_unfinished_++;
+		num_queued_++;
+	}
+
+	MyWorkerQueue &queue = *queues_[ index ];
+	{
+		std::unique_lock< std::mutex > lock( queue.mutex );
+		queue.tasks.push_back( std::move( task ) );
+	}
+	work_condition_.notify_one();
+}
+
+void MyWorkStealingPool::Wait()
+{
+	std::unique_lock< std::mutex > lock( mutex_ );
+	idle_condition_.wait( lock, [ this ] { return num_unfinished_ == 0; } );
+}
+
+bool MyWorkStealingPool::TakeTask( uint32_t index, std::function< void() > &task )
+{
+	const uint32_t num_queues = (uint32_t)queues_.size();
+
+	// Our own work first, newest first, since whatever it touches is most likely still in cache
+	{
+		MyWorkerQueue &queue = *queues_[ index ];
+		std::unique_lock< std::mutex > lock( queue.mutex );
+		if ( !queue.tasks.empty() )
+		{
+			task = std::move( queue.tasks.back() );
+			queue.tasks.pop_back();
+			return true;
+		}
+	}
+
+	// Then steal the oldest from whoever's next along
+	for ( uint32_t offset = 1; offset < num_queues; offset++ )
+	{
+		MyWorkerQueue &queue = *queues_[ ( index + offset ) % num_queues ];
+		std::unique_lock< std::mutex > lock( queue.mutex );
+		if ( !queue.tasks.empty() )
+		{
+			task = std::move( queue.tasks.front() );
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void MyWorkStealingPool::WorkerMain( uint32_t index )
+{
+	my_current_pool = this;
+	my_current_worker_index = index;
+
+	std::function< void() > task;
+
+	while ( true )
+	{
+		if ( TakeTask( index, task ) )
+		{
+			num_queued_--;
+			task();
+			task = nullptr;
+
+			if ( --num_unfinished_ == 0 )
+			{
+				std::unique_lock< std::mutex > lock( mutex_ );
+				idle_condition_.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock< std::mutex > lock( mutex_ );
+		work_condition_.wait( lock, [ this ] { return is_stopping_ || num_queued_ > 0; } );
+		if ( is_stopping_ )
+			break;
+	}
+}
@@ -0,0 +1,57 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs tasks across a fixed set of worker threads. Every worker has its own queue, and takes work from
+// the back of it; a worker that runs out steals from the front of someone else's, so uneven tasks still keep
+// every core busy without any one queue being fought over.
+//-----------------------------------------------------------------------------
+class MyWorkStealingPool
+{
+public:
+	// 0 workers means one per hardware thread
+	explicit MyWorkStealingPool( uint32_t num_workers );
+	~MyWorkStealingPool();
+
+	uint32_t GetNumWorkers() const { return (uint32_t)threads_.size(); }
+
+	// Tasks submitted from one of our workers go on its own queue, others are dealt out in turn
+	void Submit( std::function< void() > task );
+
+	// Blocks until every task submitted so far, and any they submit, has finished
+	void Wait();
+
+private:
+	struct MyWorkerQueue
+	{
+		std::mutex mutex;
+		std::deque< std::function< void() > > tasks;
+	};
+
+	void WorkerMain( uint32_t index );
+	bool TakeTask( uint32_t index, std::function< void() > &task );
+
+	std::vector< std::unique_ptr< MyWorkerQueue > > queues_;
+	std::vector< std::thread > threads_;
+
+	// Guards sleeping and waking. The counts are only ever raised while holding it, so a worker checking them
+	// before going to sleep can't miss new work.
+	std::mutex mutex_;
+	std::condition_variable work_condition_;
+	std::condition_variable idle_condition_;
+	std::atomic< uint64_t > num_queued_;     // Submitted, but not yet taken by a worker
+	std::atomic< uint64_t > num_unfinished_; // Submitted, but not yet finished
+	bool is_stopping_;
+
+	std::atomic< uint32_t > next_queue_;
+};
@@ -0,0 +1,150 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// imu_mount_offset: runs the whole driver on its simulated clock under a stand-in for vrserver, with one tracker
+// proxying a device that's mounted a quarter turn of yaw away from what it tracks, and checks the tracker's held pose
+// turns the right way while its IMU carries it through a loss. Exits with 0 if it does.
+//
+//   imu_mount_offset
+//
+// The source spins about its own x axis, is tracked for a while, then lost. It keeps spinning for a while after that,
+// then stops, so the held pose has settled by the end, and should be where the spin took the device, mount offset and
+// all. Dead reckoning in the wrong frame turns about the mount's x axis instead, and ends up tens of degrees out.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "device_provider.h"
+#include "rotation_math.h"
+#include "tool_server_host.h"
+#include "vrmath.h"
+
+// The device the tracker proxies, past the driver's own
+static const vr::TrackedDeviceIndex_t my_source_device_index = 8;
+
+// How the source is mounted: a quarter turn of yaw, about its y axis, so its x axis is the mount's z
+static const char my_source_mount_offset[] = "0,0,0,90,0,0";
+
+// The source's spin, and how long it's tracked, spins while lost, then sits still while lost
+static const double my_source_spin_rate = 2.0;       // rad/s
+static const double my_source_tracked_time = 1.0;    // s
+static const double my_source_lost_spin_time = 0.3;  // s
+static const double my_source_lost_still_time = 0.2; // s
+
+// One frame, one source pose and one IMU sample
+static const double my_frame_time = 0.001; // s
+
+// The held pose has to end up this close to where the spin took the device. The error in the wrong frame is about 50°.
+static const double my_max_rotation_error_deg = 1.0;
+
+// The first tracker the driver creates
+static const char my_tracker_serial_number[] = "MyTrackerModelNumber10";
+
+// Each update the driver can submit, over the whole run, for sizing the host's record of what was submitted
+static const size_t my_max_submitted_poses = 4096;
+
+// How far the source has turned about its own x axis by this time
+static double MySourceAngle( double time )
+{
+	const double spin_time = std::min( time, my_source_tracked_time + my_source_lost_spin_time );
+	return my_source_spin_rate * spin_time;
+}
+
+static vr::TrackedDevicePose_t MySourcePose( double time, bool is_tracked )
+{
+	const double angle = MySourceAngle( time );
+
+	vr::TrackedDevicePose_t pose = {};
+	pose.bDeviceIsConnected = true;
+	pose.bPoseIsValid = is_tracked;
+	pose.eTrackingResult = is_tracked ? vr::TrackingResult_Running_OK : vr::TrackingResult_Running_OutOfRange;
+
+	// Turned by angle about x, a metre up
+	pose.mDeviceToAbsoluteTracking.m[ 0 ][ 0 ] = 1.f;
+	pose.mDeviceToAbsoluteTracking.m[ 1 ][ 1 ] = (float)cos( angle );
+	pose.mDeviceToAbsoluteTracking.m[ 1 ][ 2 ] = (float)-sin( angle );
+	pose.mDeviceToAbsoluteTracking.m[ 2 ][ 1 ] = (float)sin( angle );
+	pose.mDeviceToAbsoluteTracking.m[ 2 ][ 2 ] = (float)cos( angle );
+	pose.mDeviceToAbsoluteTracking.m[ 1 ][ 3 ] = 1.f;
+	return pose;
+}
+
+// The IMU's reading over the frame ending at this time, in the device's own frame: the spin, and gravity, which
+// points up along the device's turned y axis
+static vr::ImuSample_t MySourceImuSample( double time )
+{
+	const double angle = MySourceAngle( time );
+	const bool is_spinning = time <= my_source_tracked_time + my_source_lost_spin_time;
+
+	vr::ImuSample_t sample = {};
+	sample.fSampleTime = time;
+	sample.vAccel = { { 0.0, 9.81 * cos( angle ), -9.81 * sin( angle ) } };
+	sample.vGyro = { { is_spinning ? my_source_spin_rate : 0.0, 0.0, 0.0 } };
+	return sample;
+}
+
+int main( int, char ** )
+{
+	MyToolServerHost host;
+	host.SetSetting( "PoseLockDriver", "num_virtual_trackers", "1" );
+	host.SetSetting( "PoseLockDriver", "enabled_trackers", my_tracker_serial_number );
+	host.SetSetting( "PoseLockDriver", "simulated_clock_step_ms", "1" );
+	host.SetSetting( "PoseLockDriver", "telemetry_enabled", "false" );
+	host.SetSetting( "PoseLockProxy", ( std::string( "proxy_target_for_" ) + my_tracker_serial_number ).c_str(), std::to_string( my_source_device_index ).c_str() );
+	host.SetSetting( "PoseLockProxy", ( std::string( "use_imu_for_" ) + my_tracker_serial_number ).c_str(), "true" );
+	host.SetSetting( "PoseLockProxy", ( std::string( "mount_offset_for_" ) + my_tracker_serial_number ).c_str(), my_source_mount_offset );
+
+	host.AddSourceDevice( my_source_device_index, "lighthouse", "LHR-MOUNTED" );
+	host.ReserveSubmittedPoses( my_max_submitted_poses );
+
+	std::unique_ptr< MyDeviceProvider > provider( new MyDeviceProvider() );
+	if ( provider->Init( &host ) != vr::VRInitError_None )
+	{
+		fprintf( stderr, "the driver failed to start\n" );
+		return 1;
+	}
+
+	// Each frame, the source is moved to where it is by the end of it, and its IMU says how it got there
+	const double end_time = my_source_tracked_time + my_source_lost_spin_time + my_source_lost_still_time;
+	const uint32_t num_frames = (uint32_t)std::lround( end_time / my_frame_time );
+	for ( uint32_t frame = 1; frame <= num_frames; frame++ )
+	{
+		const double time = frame * my_frame_time;
+		host.SetSourcePose( MySourcePose( time, time <= my_source_tracked_time ) );
+		host.AddSourceImuSample( MySourceImuSample( time ) );
+		provider->RunFrame();
+	}
+
+	for ( vr::ITrackedDeviceServerDriver *device : host.GetDevices() )
+	{
+		device->Deactivate();
+	}
+	provider->Cleanup();
+
+	if ( host.GetNumSubmittedPoses() == 0 || host.GetNumDroppedPoses() > 0 )
+	{
+		printf( "the driver submitted %zu poses, and %llu more than we made room for\n", host.GetNumSubmittedPoses(),
+			(unsigned long long)host.GetNumDroppedPoses() );
+		return 1;
+	}
+
+	// Where the spin took the device, then the mount offset on top, the way the driver applies it
+	const double final_angle = MySourceAngle( end_time );
+	const vr::HmdQuaternion_t device_rotation = { cos( 0.5 * final_angle ), sin( 0.5 * final_angle ), 0.0, 0.0 };
+	const vr::HmdQuaternion_t expected = device_rotation * HmdQuaternion_FromEulerAngles( 0.0, 0.0, DEG_TO_RAD( 90.0 ) );
+
+	const vr::DriverPose_t &held = host.GetSubmittedPose( host.GetNumSubmittedPoses() - 1 ).pose;
+	const double error_deg = RAD_TO_DEG( MyAngleBetween( held.qRotation, expected ) );
+	printf( "held rotation (%.6f, %.6f, %.6f, %.6f), expected (%.6f, %.6f, %.6f, %.6f), %.3f° out\n", held.qRotation.w,
+		held.qRotation.x, held.qRotation.y, held.qRotation.z, expected.w, expected.x, expected.y, expected.z, error_deg );
+
+	if ( !( error_deg <= my_max_rotation_error_deg ) )
+	{
+		printf( "the held pose turned the wrong way\n" );
+		return 1;
+	}
+
+	printf( "the held pose turned with the device\n" );
+	return 0;
+}
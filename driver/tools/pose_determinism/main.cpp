@@ -0,0 +1,240 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// pose_determinism: runs the whole driver, pose pump and all, on its simulated clock under a stand-in for vrserver,
+// replaying the same scenario through every tracker several times over, and checks that every run submits exactly the
+// same poses, bit for bit, in the same order. Exits with 0 if they all match.
+//
+//   pose_determinism [--runs <n>] [--step <ms>] [--trace <path>] [scenario options]
+//
+// The scenario is synthetic full-body walking with corruption injected into it, written out as a raw trace for the
+// driver to replay. Each tracker is worn on the body joint it walks as, so lost trackers are filled in by the body model.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "device_provider.h"
+#include "pose_scenario.h"
+#include "scenario_options.h"
+#include "tool_server_host.h"
+
+// The body joint each track of the walking scenario is worn on, in the order MyGenerateWalkingMotion builds them, so
+// the body model is solved every pass, and estimates whichever of them drop out
+static const char *const my_walking_body_joints[] = { "waist", "left_foot", "right_foot", "left_hand", "right_hand" };
+
+// Each tracker updates at most this many times per step of the simulated clock, on average, for sizing the host's
+// record of what was submitted
+static const uint32_t my_max_updates_per_step = 4;
+
+struct MyDeterminismOptions
+{
+	uint32_t num_runs;
+	double step_ms;
+	std::string trace_path;
+	MyScenarioBuildOptions build;
+};
+
+static void MyPrintUsage()
+{
+	fprintf( stderr,
+		"usage: pose_determinism [options]\n"
+		"    --runs <n>                   how many times to run the driver over the scenario (default 2)\n"
+		"    --step <ms>                  simulated time per frame (default 1)\n"
+		"    --trace <path>               where to write the scenario for the driver to replay (default pose_determinism.trace)\n"
+		"  the walk is 10 seconds here, unless --walk-seconds says otherwise\n" );
+	MyPrintScenarioBuildUsage();
+}
+
+static bool MyParseOptions( int argc, char **argv, MyDeterminismOptions &options )
+{
+	options.num_runs = 2;
+	options.step_ms = 1.0;
+	options.trace_path = "pose_determinism.trace";
+	MySetDefaultScenarioBuildOptions( options.build );
+	options.build.walking.duration_s = 10.0;
+
+	for ( int arg = 1; arg < argc; arg++ )
+	{
+		const char *name = argv[ arg ];
+		if ( strcmp( name, "--help" ) == 0 || arg + 1 >= argc )
+			return false;
+
+		const char *value = argv[ ++arg ];
+		if ( strcmp( name, "--runs" ) == 0 )
+			options.num_runs = (uint32_t)atoi( value );
+		else if ( strcmp( name, "--step" ) == 0 )
+			options.step_ms = atof( value );
+		else if ( strcmp( name, "--trace" ) == 0 )
+			options.trace_path = value;
+		else if ( !MyParseScenarioBuildOption( name, value, options.build ) )
+		{
+			fprintf( stderr, "unknown option %s\n", name );
+			return false;
+		}
+	}
+
+	if ( options.num_runs < 2 || !( options.step_ms > 0.0 ) )
+		return false;
+
+	return MyFinishScenarioBuildOptions( options.build );
+}
+
+// Runs the driver over the scenario once, start to finish, the way vrserver would: Init, a RunFrame per step of the
+// clock, then deactivate every tracker and clean up. Returns false if the driver wouldn't start.
+static bool MyRunDriver( const MyDeterminismOptions &options, const std::vector< MyPoseTrack > &tracks, MyToolServerHost &host )
+{
+	std::string enabled_trackers;
+	for ( const MyPoseTrack &track : tracks )
+		enabled_trackers += track.serial_number + ",";
+
+	char step_ms[ 32 ];
+	snprintf( step_ms, sizeof( step_ms ), "%.9g", options.step_ms );
+
+	host.SetSetting( "PoseLockDriver", "num_virtual_trackers", std::to_string( tracks.size() ).c_str() );
+	host.SetSetting( "PoseLockDriver", "enabled_trackers", enabled_trackers.c_str() );
+	host.SetSetting( "PoseLockDriver", "replay_trace_path", options.trace_path.c_str() );
+	host.SetSetting( "PoseLockDriver", "simulated_clock_step_ms", step_ms );
+	host.SetSetting( "PoseLockDriver", "telemetry_enabled", "false" );
+
+	for ( size_t track = 0; track < tracks.size() && track < sizeof( my_walking_body_joints ) / sizeof( my_walking_body_joints[ 0 ] ); track++ )
+	{
+		host.SetSetting( "PoseLockProxy", ( "body_joint_for_" + tracks[ track ].serial_number ).c_str(), my_walking_body_joints[ track ] );
+	}
+
+	const uint32_t num_frames = (uint32_t)ceil( options.build.walking.duration_s * 1000.0 / options.step_ms );
+	host.ReserveSubmittedPoses( (size_t)num_frames * tracks.size() * my_max_updates_per_step );
+
+	// A fresh driver every run, so nothing's carried over from the last one
+	std::unique_ptr< MyDeviceProvider > provider( new MyDeviceProvider() );
+	if ( provider->Init( &host ) != vr::VRInitError_None )
+		return false;
+
+	for ( uint32_t frame = 0; frame < num_frames; frame++ )
+	{
+		provider->RunFrame();
+	}
+
+	for ( vr::ITrackedDeviceServerDriver *device : host.GetDevices() )
+	{
+		device->Deactivate();
+	}
+	provider->Cleanup();
+
+	return true;
+}
+
+// Bit for bit, rather than by value, so even a NaN or a negative zero has to come out the same
+template < class T >
+static bool MyIsSame( const T &a, const T &b )
+{
+	return memcmp( &a, &b, sizeof( T ) ) == 0;
+}
+
+// Compares every field the driver fills in, leaving out the struct's padding
+static bool MyIsSamePose( const MySubmittedPose &a, const MySubmittedPose &b )
+{
+	const vr::DriverPose_t &pose_a = a.pose;
+	const vr::DriverPose_t &pose_b = b.pose;
+	return a.device_index == b.device_index && MyIsSame( pose_a.poseTimeOffset, pose_b.poseTimeOffset ) &&
+		   MyIsSame( pose_a.qWorldFromDriverRotation, pose_b.qWorldFromDriverRotation ) &&
+		   MyIsSame( pose_a.vecWorldFromDriverTranslation, pose_b.vecWorldFromDriverTranslation ) &&
+		   MyIsSame( pose_a.qDriverFromHeadRotation, pose_b.qDriverFromHeadRotation ) &&
+		   MyIsSame( pose_a.vecDriverFromHeadTranslation, pose_b.vecDriverFromHeadTranslation ) &&
+		   MyIsSame( pose_a.vecPosition, pose_b.vecPosition ) && MyIsSame( pose_a.vecVelocity, pose_b.vecVelocity ) &&
+		   MyIsSame( pose_a.vecAcceleration, pose_b.vecAcceleration ) && MyIsSame( pose_a.qRotation, pose_b.qRotation ) &&
+		   MyIsSame( pose_a.vecAngularVelocity, pose_b.vecAngularVelocity ) &&
+		   MyIsSame( pose_a.vecAngularAcceleration, pose_b.vecAngularAcceleration ) && pose_a.result == pose_b.result &&
+		   pose_a.poseIsValid == pose_b.poseIsValid && pose_a.willDriftInYaw == pose_b.willDriftInYaw &&
+		   pose_a.shouldApplyHeadModel == pose_b.shouldApplyHeadModel && pose_a.deviceIsConnected == pose_b.deviceIsConnected;
+}
+
+// Returns false, and says where, if the two runs submitted anything differently
+static bool MyCompareRuns( const MyToolServerHost &first, const MyToolServerHost &run, uint32_t run_number )
+{
+	if ( run.GetNumSubmittedPoses() != first.GetNumSubmittedPoses() )
+	{
+		printf( "run %u submitted %zu poses, but run 1 submitted %zu\n", run_number, run.GetNumSubmittedPoses(), first.GetNumSubmittedPoses() );
+		return false;
+	}
+
+	for ( size_t index = 0; index < first.GetNumSubmittedPoses(); index++ )
+	{
+		const MySubmittedPose &expected = first.GetSubmittedPose( index );
+		const MySubmittedPose &actual = run.GetSubmittedPose( index );
+		if ( !MyIsSamePose( expected, actual ) )
+		{
+			printf( "run %u differs from run 1 at pose %zu: device %u at (%.9f, %.9f, %.9f), where run 1 had device %u at (%.9f, %.9f, %.9f)\n",
+				run_number, index, actual.device_index, actual.pose.vecPosition[ 0 ], actual.pose.vecPosition[ 1 ], actual.pose.vecPosition[ 2 ],
+				expected.device_index, expected.pose.vecPosition[ 0 ], expected.pose.vecPosition[ 1 ], expected.pose.vecPosition[ 2 ] );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main( int argc, char **argv )
+{
+	MyDeterminismOptions options;
+	if ( !MyParseOptions( argc, argv, options ) )
+	{
+		MyPrintUsage();
+		return 1;
+	}
+
+	std::vector< MyPoseTrack > truth;
+	MyGenerateWalkingMotion( options.build.walking, truth );
+
+	std::vector< MyPoseTrack > source;
+	MyCorruptTracks( truth, options.build.corruption, source );
+
+	// Named after the trackers the driver creates, from id 10 on, so each one replays a track
+	for ( size_t track = 0; track < source.size(); track++ )
+	{
+		source[ track ].serial_number = "MyTrackerModelNumber" + std::to_string( 10 + track );
+	}
+
+	if ( !MyWriteTraceTracks( options.trace_path.c_str(), source ) )
+	{
+		fprintf( stderr, "couldn't write the scenario to %s\n", options.trace_path.c_str() );
+		return 1;
+	}
+
+	// Only the first run's kept, to compare the others against
+	MyToolServerHost first;
+	bool is_deterministic = true;
+	for ( uint32_t run = 1; run <= options.num_runs && is_deterministic; run++ )
+	{
+		std::unique_ptr< MyToolServerHost > other( run > 1 ? new MyToolServerHost() : nullptr );
+		MyToolServerHost &host = run > 1 ? *other : first;
+
+		if ( !MyRunDriver( options, source, host ) )
+		{
+			fprintf( stderr, "the driver failed to start on run %u\n", run );
+			return 1;
+		}
+
+		if ( host.GetNumDroppedPoses() > 0 )
+		{
+			fprintf( stderr, "run %u submitted more poses than we made room for\n", run );
+			return 1;
+		}
+
+		printf( "run %u: %zu poses submitted\n", run, host.GetNumSubmittedPoses() );
+
+		if ( run > 1 )
+			is_deterministic = MyCompareRuns( first, host, run );
+	}
+
+	if ( first.GetNumSubmittedPoses() == 0 )
+	{
+		printf( "the driver didn't submit any poses\n" );
+		return 1;
+	}
+
+	printf( is_deterministic ? "every run submitted the same poses\n" : "runs submitted different poses\n" );
+	return is_deterministic ? 0 : 1;
+}
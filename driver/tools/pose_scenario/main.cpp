@@ -0,0 +1,173 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// pose_scenario: builds a dropout scenario from clean motion, runs the driver's pose pipeline over it with and without
+// pose locking, and locking with the tracker's IMU, and reports how far the submitted poses were from ground truth.
+//
+//   pose_scenario [--truth <trace> | --walk-seconds <s>] [--source <trace>] [options]
+//
+// The clean motion is either a recorded trace (raw or compressed) or synthetic full-body walking. Unless a source
+// trace is given, the source is the clean motion with corruption injected into it.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "pose_evaluation.h"
+#include "pose_scenario.h"
+#include "scenario_options.h"
+#include "tool_driver_context.h"
+#include "vrmath.h"
+
+struct MyScenarioOptions
+{
+	std::string truth_path;
+	std::string source_path;
+	std::string write_truth_path;
+	std::string write_source_path;
+	uint32_t update_rate_hz;
+	double resample_delay_ms;
+	MyScenarioBuildOptions build;
+};
+
+static void MyPrintUsage()
+{
+	fprintf( stderr,
+		"usage: pose_scenario [options]\n"
+		"    --truth <trace>              recorded trace to use as ground truth, instead of synthetic walking\n"
+		"    --source <trace>             use this trace as the source instead of injecting corruption\n"
+		"    --update-rate <hz>           fixed update rate, instead of the motion governor (default 0)\n"
+		"    --resample-delay <ms>        resample fresh poses onto an even grid this far behind the source (default off)\n"
+		"    --write-truth <trace>        write the ground truth as a raw trace\n"
+		"    --write-source <trace>       write the source as a raw trace, e.g. for the driver to replay\n" );
+	MyPrintScenarioBuildUsage();
+}
+
+static bool MyParseOptions( int argc, char **argv, MyScenarioOptions &options )
+{
+	options.update_rate_hz = 0;
+	options.resample_delay_ms = -1.0;
+	MySetDefaultScenarioBuildOptions( options.build );
+
+	for ( int arg = 1; arg < argc; arg++ )
+	{
+		const char *name = argv[ arg ];
+		if ( strcmp( name, "--help" ) == 0 || arg + 1 >= argc )
+			return false;
+
+		const char *value = argv[ ++arg ];
+
+		if ( strcmp( name, "--truth" ) == 0 )
+			options.truth_path = value;
+		else if ( strcmp( name, "--source" ) == 0 )
+			options.source_path = value;
+		else if ( strcmp( name, "--write-truth" ) == 0 )
+			options.write_truth_path = value;
+		else if ( strcmp( name, "--write-source" ) == 0 )
+			options.write_source_path = value;
+		else if ( strcmp( name, "--update-rate" ) == 0 )
+			options.update_rate_hz = (uint32_t)atof( value );
+		else if ( strcmp( name, "--resample-delay" ) == 0 )
+			options.resample_delay_ms = atof( value );
+		else if ( !MyParseScenarioBuildOption( name, value, options.build ) )
+		{
+			fprintf( stderr, "unknown option %s\n", name );
+			return false;
+		}
+	}
+
+	return MyFinishScenarioBuildOptions( options.build );
+}
+
+static void MyPrintMetrics( const char *mode, const char *track, const MyPoseErrorMetrics &metrics )
+{
+	printf( "%-12s %-24s %9.2f %9.2f %9.3f %9.3f %6llu %9.2f %9.2f %9.3f %8.4f %8.2f %8.1f %9.3f\n", mode, track, metrics.GetPositionRmse() * 1000.0,
+		metrics.max_position_error_m * 1000.0, RAD_TO_DEG( metrics.GetRotationRmse() ), RAD_TO_DEG( metrics.max_rotation_error_rad ),
+		(unsigned long long)metrics.num_reacquisitions, metrics.GetMeanSnapDistance() * 1000.0, metrics.max_snap_m * 1000.0,
+		RAD_TO_DEG( metrics.max_snap_rad ), metrics.GetCoverage(), metrics.GetMeanPoseAge() * 1000.0, metrics.GetUpdateRate(),
+		metrics.GetJudder() * 1000.0 );
+}
+
+int main( int argc, char **argv )
+{
+	MyScenarioOptions options;
+	if ( !MyParseOptions( argc, argv, options ) )
+	{
+		MyPrintUsage();
+		return 1;
+	}
+
+	MyInitToolDriverContext();
+
+	std::vector< MyPoseTrack > truth;
+	if ( !options.truth_path.empty() )
+	{
+		if ( !MyLoadTraceTracks( options.truth_path.c_str(), options.build.sample_rate_hz, truth ) )
+		{
+			fprintf( stderr, "couldn't load ground truth from %s\n", options.truth_path.c_str() );
+			return 1;
+		}
+	}
+	else
+	{
+		MyGenerateWalkingMotion( options.build.walking, truth );
+	}
+
+	std::vector< MyPoseTrack > source;
+	if ( !options.source_path.empty() )
+	{
+		if ( !MyLoadTraceTracks( options.source_path.c_str(), options.build.sample_rate_hz, source ) || source.size() != truth.size() )
+		{
+			fprintf( stderr, "couldn't load a source with the same tracks as the ground truth from %s\n", options.source_path.c_str() );
+			return 1;
+		}
+	}
+	else
+	{
+		MyCorruptTracks( truth, options.build.corruption, source );
+	}
+
+	if ( !options.write_truth_path.empty() && !MyWriteTraceTracks( options.write_truth_path.c_str(), truth ) )
+		fprintf( stderr, "couldn't write ground truth to %s\n", options.write_truth_path.c_str() );
+	if ( !options.write_source_path.empty() && !MyWriteTraceTracks( options.write_source_path.c_str(), source ) )
+		fprintf( stderr, "couldn't write source to %s\n", options.write_source_path.c_str() );
+
+	printf( "%-12s %-24s %9s %9s %9s %9s %6s %9s %9s %9s %8s %8s %8s %9s\n", "mode", "track", "rmse_mm", "max_mm", "rmse_deg", "max_deg", "snaps",
+		"snap_mm", "snap_max", "snap_deg", "coverage", "age_ms", "upd_hz", "judder_mm" );
+
+	// Recorded sources don't have IMU samples, only the ones we build do
+	bool has_imu = false;
+	for ( const MyPoseTrack &track : source )
+		has_imu |= !track.imu_samples.empty();
+
+	static const struct
+	{
+		const char *name;
+		bool pose_locking_enabled;
+		bool use_imu;
+	} modes[] = { { "passthrough", false, false }, { "locked", true, false }, { "locked_imu", true, true } };
+
+	for ( const auto &mode : modes )
+	{
+		// Without an IMU, locking with one is the same as locking without
+		if ( mode.use_imu && !has_imu )
+			continue;
+
+		const MyPipelineRunSettings settings = { mode.pose_locking_enabled, options.update_rate_hz, options.resample_delay_ms, mode.use_imu,
+			MyGetDefaultMotionRateGovernorParams() };
+
+		MyPoseErrorMetrics overall = {};
+		for ( size_t track = 0; track < truth.size(); track++ )
+		{
+			MyPoseErrorMetrics metrics = {};
+			MyEvaluatePipeline( truth[ track ], source[ track ], settings, metrics );
+			MyPrintMetrics( mode.name, truth[ track ].serial_number.c_str(), metrics );
+			overall.Add( metrics );
+		}
+
+		MyPrintMetrics( mode.name, "all", overall );
+	}
+
+	return 0;
+}
@@ -0,0 +1,445 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// pose_sweep: runs the driver's pose pipeline over a set of scenarios for many combinations of its tunable
+// parameters, spread over every core, and prints the Pareto front of pose age against error for each tracker.
+//
+//   pose_sweep [--trace <trace>]... [--grid <param>=<min>:<max>:<count>]... [--random <n>] [options]
+//
+// Each trace (raw or compressed) is ground truth, with corruption injected into it for the source, exactly as
+// pose_scenario does. With no traces it uses synthetic walking. Every parameter set sees the same sources.
+// Trackers are grouped by serial number across traces, so recording the same rig several times gives a front
+// per body part.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "pose_evaluation.h"
+#include "pose_scenario.h"
+#include "scenario_options.h"
+#include "tool_driver_context.h"
+#include "vrmath.h"
+#include "work_stealing_pool.h"
+
+// A parameter we can sweep, and how to apply it to the settings a run uses
+struct MySweepParam
+{
+	const char *name;
+	const char *description;
+	double ( *get )( const MyPipelineRunSettings &settings );
+	void ( *set )( MyPipelineRunSettings &settings, double value );
+};
+
+static double MyToMilliseconds( std::chrono::nanoseconds duration )
+{
+	return duration.count() / 1e6;
+}
+
+static std::chrono::nanoseconds MyFromMilliseconds( double milliseconds )
+{
+	return std::chrono::nanoseconds( (int64_t)( milliseconds * 1e6 ) );
+}
+
+static const MySweepParam my_sweep_params[] = {
+	{ "lock", "pose locking, 0 or 1", //
+		[]( const MyPipelineRunSettings &s ) { return s.pose_locking_enabled ? 1.0 : 0.0; },
+		[]( MyPipelineRunSettings &s, double v ) { s.pose_locking_enabled = v >= 0.5; } },
+	{ "imu", "dead reckoning from the IMU while locked, 0 or 1", //
+		[]( const MyPipelineRunSettings &s ) { return s.use_imu ? 1.0 : 0.0; },
+		[]( MyPipelineRunSettings &s, double v ) { s.use_imu = v >= 0.5; } },
+	{ "resample_delay_ms", "resampling delay, negative for off", //
+		[]( const MyPipelineRunSettings &s ) { return s.resample_delay_ms; },
+		[]( MyPipelineRunSettings &s, double v ) { s.resample_delay_ms = v; } },
+	{ "static_period_ms", "update period while static", //
+		[]( const MyPipelineRunSettings &s ) { return MyToMilliseconds( s.governor.periods[ MyMotionClass_Static ] ); },
+		[]( MyPipelineRunSettings &s, double v ) { s.governor.periods[ MyMotionClass_Static ] = MyFromMilliseconds( v ); } },
+	{ "slow_period_ms", "update period while moving slowly", //
+		[]( const MyPipelineRunSettings &s ) { return MyToMilliseconds( s.governor.periods[ MyMotionClass_Slow ] ); },
+		[]( MyPipelineRunSettings &s, double v ) { s.governor.periods[ MyMotionClass_Slow ] = MyFromMilliseconds( v ); } },
+	{ "fast_period_ms", "update period while moving fast", //
+		[]( const MyPipelineRunSettings &s ) { return MyToMilliseconds( s.governor.periods[ MyMotionClass_Fast ] ); },
+		[]( MyPipelineRunSettings &s, double v ) { s.governor.periods[ MyMotionClass_Fast ] = MyFromMilliseconds( v ); } },
+	{ "static_linear", "m/s above which a tracker isn't static", //
+		[]( const MyPipelineRunSettings &s ) { return s.governor.static_max_linear_speed; },
+		[]( MyPipelineRunSettings &s, double v ) { s.governor.static_max_linear_speed = v; } },
+	{ "static_angular", "rad/s above which a tracker isn't static", //
+		[]( const MyPipelineRunSettings &s ) { return s.governor.static_max_angular_speed; },
+		[]( MyPipelineRunSettings &s, double v ) { s.governor.static_max_angular_speed = v; } },
+	{ "fast_linear", "m/s above which a tracker is fast", //
+		[]( const MyPipelineRunSettings &s ) { return s.governor.fast_min_linear_speed; },
+		[]( MyPipelineRunSettings &s, double v ) { s.governor.fast_min_linear_speed = v; } },
+	{ "fast_angular", "rad/s above which a tracker is fast", //
+		[]( const MyPipelineRunSettings &s ) { return s.governor.fast_min_angular_speed; },
+		[]( MyPipelineRunSettings &s, double v ) { s.governor.fast_min_angular_speed = v; } },
+	{ "smoothing", "weight of each new speed measurement, 0..1", //
+		[]( const MyPipelineRunSettings &s ) { return s.governor.speed_smoothing; },
+		[]( MyPipelineRunSettings &s, double v ) { s.governor.speed_smoothing = v; } },
+	{ "demotion_ms", "time before dropping to a slower class", //
+		[]( const MyPipelineRunSettings &s ) { return MyToMilliseconds( s.governor.demotion_delay ); },
+		[]( MyPipelineRunSettings &s, double v ) { s.governor.demotion_delay = MyFromMilliseconds( v ); } },
+};
+
+static const size_t my_num_sweep_params = sizeof( my_sweep_params ) / sizeof( my_sweep_params[ 0 ] );
+
+struct MySweepRange
+{
+	size_t param;
+	double min;
+	double max;
+	uint32_t count; // Grid points, ends included
+};
+
+struct MySweepOptions
+{
+	std::vector< std::string > trace_paths;
+	std::vector< MySweepRange > ranges;
+	uint32_t num_random;
+	uint32_t num_threads;
+	double min_coverage;
+	std::string csv_path;
+	MyScenarioBuildOptions build;
+};
+
+// One scenario: a trace, or the synthetic walk, and the source built from it
+struct MySweepScenario
+{
+	std::vector< MyPoseTrack > truth;
+	std::vector< MyPoseTrack > source;
+};
+
+static void MyPrintUsage()
+{
+	fprintf( stderr,
+		"usage: pose_sweep [options]\n"
+		"    --trace <trace>              recorded trace to use as ground truth, can be given more than once\n"
+		"    --grid <param>=<min>:<max>:<count>\n"
+		"                                 sweep a parameter over count evenly spaced values, can be given more than once\n"
+		"    --random <n>                 try n random points in the ranges given, instead of every grid point\n"
+		"    --threads <n>                worker threads (default one per hardware thread)\n"
+		"    --min-coverage <0..1>        leave points showing a pose less often than this off the front (default 0.99)\n"
+		"    --csv <file>                 write every point, not just the front\n"
+		"  parameters, which otherwise keep the driver's defaults:\n" );
+
+	const MyPipelineRunSettings defaults = { true, 0, -1.0, true, MyGetDefaultMotionRateGovernorParams() };
+	for ( const MySweepParam &param : my_sweep_params )
+		fprintf( stderr, "    %-28s %s (default %g)\n", param.name, param.description, param.get( defaults ) );
+
+	MyPrintScenarioBuildUsage();
+}
+
+static bool MyParseRange( const char *value, MySweepRange &range )
+{
+	const char *equals = strchr( value, '=' );
+	if ( equals == nullptr )
+		return false;
+
+	const std::string name( value, equals - value );
+	range.param = my_num_sweep_params;
+	for ( size_t param = 0; param < my_num_sweep_params; param++ )
+	{
+		if ( name == my_sweep_params[ param ].name )
+			range.param = param;
+	}
+
+	if ( range.param == my_num_sweep_params )
+		return false;
+
+	range.count = 2;
+	const int num_fields = sscanf( equals + 1, "%lf:%lf:%u", &range.min, &range.max, &range.count );
+	if ( num_fields == 1 )
+	{
+		range.max = range.min;
+		range.count = 1;
+	}
+	else if ( num_fields < 1 )
+	{
+		return false;
+	}
+
+	return range.count > 0;
+}
+
+static bool MyParseOptions( int argc, char **argv, MySweepOptions &options )
+{
+	options.num_random = 0;
+	options.num_threads = 0;
+	options.min_coverage = 0.99;
+	MySetDefaultScenarioBuildOptions( options.build );
+
+	for ( int arg = 1; arg < argc; arg++ )
+	{
+		const char *name = argv[ arg ];
+		if ( strcmp( name, "--help" ) == 0 || arg + 1 >= argc )
+			return false;
+
+		const char *value = argv[ ++arg ];
+
+		if ( strcmp( name, "--trace" ) == 0 )
+		{
+			options.trace_paths.push_back( value );
+		}
+		else if ( strcmp( name, "--grid" ) == 0 )
+		{
+			MySweepRange range;
+			if ( !MyParseRange( value, range ) )
+			{
+				fprintf( stderr, "bad range %s\n", value );
+				return false;
+			}
+			options.ranges.push_back( range );
+		}
+		else if ( strcmp( name, "--random" ) == 0 )
+			options.num_random = (uint32_t)atoi( value );
+		else if ( strcmp( name, "--threads" ) == 0 )
+			options.num_threads = (uint32_t)atoi( value );
+		else if ( strcmp( name, "--min-coverage" ) == 0 )
+			options.min_coverage = atof( value );
+		else if ( strcmp( name, "--csv" ) == 0 )
+			options.csv_path = value;
+		else if ( !MyParseScenarioBuildOption( name, value, options.build ) )
+		{
+			fprintf( stderr, "unknown option %s\n", name );
+			return false;
+		}
+	}
+
+	return MyFinishScenarioBuildOptions( options.build );
+}
+
+// Every grid point, or num_random random points, with the parameters not swept left at the driver's defaults
+static void MyBuildParamSets( const MySweepOptions &options, std::vector< MyPipelineRunSettings > &param_sets )
+{
+	const MyPipelineRunSettings defaults = { true, 0, -1.0, true, MyGetDefaultMotionRateGovernorParams() };
+
+	if ( options.num_random > 0 )
+	{
+		std::mt19937_64 random( options.build.corruption.seed );
+		for ( uint32_t i = 0; i < options.num_random; i++ )
+		{
+			MyPipelineRunSettings settings = defaults;
+			for ( const MySweepRange &range : options.ranges )
+			{
+				my_sweep_params[ range.param ].set( settings, std::uniform_real_distribution< double >( range.min, range.max )( random ) );
+			}
+			param_sets.push_back( settings );
+		}
+		return;
+	}
+
+	// Count through the grid like an odometer
+	std::vector< uint32_t > steps( options.ranges.size(), 0 );
+	while ( true )
+	{
+		MyPipelineRunSettings settings = defaults;
+		for ( size_t i = 0; i < options.ranges.size(); i++ )
+		{
+			const MySweepRange &range = options.ranges[ i ];
+			const double t = range.count > 1 ? (double)steps[ i ] / ( range.count - 1 ) : 0.0;
+			my_sweep_params[ range.param ].set( settings, range.min + t * ( range.max - range.min ) );
+		}
+		param_sets.push_back( settings );
+
+		size_t i = 0;
+		for ( ; i < steps.size(); i++ )
+		{
+			if ( ++steps[ i ] < options.ranges[ i ].count )
+				break;
+			steps[ i ] = 0;
+		}
+
+		if ( i == steps.size() )
+			break;
+	}
+}
+
+// Indices of the points no other point beats on both pose age and position error, in order of pose age
+static std::vector< size_t > MyFindParetoFront( const std::vector< MyPoseErrorMetrics > &points, double min_coverage )
+{
+	std::vector< size_t > candidates;
+	for ( size_t i = 0; i < points.size(); i++ )
+	{
+		if ( points[ i ].GetCoverage() >= min_coverage )
+			candidates.push_back( i );
+	}
+
+	std::sort( candidates.begin(), candidates.end(), [ &points ]( size_t a, size_t b ) {
+		const double age_a = points[ a ].GetMeanPoseAge(), age_b = points[ b ].GetMeanPoseAge();
+		return age_a != age_b ? age_a < age_b : points[ a ].GetPositionRmse() < points[ b ].GetPositionRmse();
+	} );
+
+	// Going from youngest to oldest, a point is only on the front if it beats everything younger on error
+	std::vector< size_t > front;
+	for ( size_t candidate : candidates )
+	{
+		if ( front.empty() || points[ candidate ].GetPositionRmse() < points[ front.back() ].GetPositionRmse() )
+			front.push_back( candidate );
+	}
+
+	return front;
+}
+
+static void MyPrintSweptParams( FILE *file, const MySweepOptions &options, const MyPipelineRunSettings &settings, const char *format )
+{
+	for ( const MySweepRange &range : options.ranges )
+		fprintf( file, format, my_sweep_params[ range.param ].get( settings ) );
+}
+
+int main( int argc, char **argv )
+{
+	MySweepOptions options;
+	if ( !MyParseOptions( argc, argv, options ) )
+	{
+		MyPrintUsage();
+		return 1;
+	}
+
+	MyInitToolDriverContext();
+
+	// Scenarios are built once, up front, and only ever read from the workers
+	std::vector< MySweepScenario > scenarios;
+	if ( options.trace_paths.empty() )
+	{
+		scenarios.emplace_back();
+		MyGenerateWalkingMotion( options.build.walking, scenarios.back().truth );
+	}
+
+	for ( const std::string &path : options.trace_paths )
+	{
+		scenarios.emplace_back();
+		if ( !MyLoadTraceTracks( path.c_str(), options.build.sample_rate_hz, scenarios.back().truth ) )
+		{
+			fprintf( stderr, "couldn't load %s\n", path.c_str() );
+			return 1;
+		}
+	}
+
+	for ( size_t scenario = 0; scenario < scenarios.size(); scenario++ )
+	{
+		// Different corruption for each trace, but the same every time the sweep is run
+		MyCorruptionParams corruption = options.build.corruption;
+		corruption.seed += scenario;
+		MyCorruptTracks( scenarios[ scenario ].truth, corruption, scenarios[ scenario ].source );
+	}
+
+	// Group tracks by serial number, across scenarios
+	std::vector< std::string > groups;
+	struct MySweepTrack
+	{
+		size_t scenario;
+		size_t track;
+		size_t group;
+	};
+	std::vector< MySweepTrack > tracks;
+
+	for ( size_t scenario = 0; scenario < scenarios.size(); scenario++ )
+	{
+		for ( size_t track = 0; track < scenarios[ scenario ].truth.size(); track++ )
+		{
+			const std::string &serial_number = scenarios[ scenario ].truth[ track ].serial_number;
+			const size_t group = std::find( groups.begin(), groups.end(), serial_number ) - groups.begin();
+			if ( group == groups.size() )
+				groups.push_back( serial_number );
+
+			tracks.push_back( { scenario, track, group } );
+		}
+	}
+
+	std::vector< MyPipelineRunSettings > param_sets;
+	MyBuildParamSets( options, param_sets );
+
+	// One task per parameter set and track. Tracks vary a lot in length, which is what the stealing is for.
+	std::vector< MyPoseErrorMetrics > results( param_sets.size() * tracks.size(), MyPoseErrorMetrics{} );
+
+	const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	uint32_t num_workers;
+	{
+		MyWorkStealingPool pool( options.num_threads );
+		num_workers = pool.GetNumWorkers();
+
+		for ( size_t param_set = 0; param_set < param_sets.size(); param_set++ )
+		{
+			for ( size_t track = 0; track < tracks.size(); track++ )
+			{
+				pool.Submit( [ &, param_set, track ] {
+					const MySweepScenario &scenario = scenarios[ tracks[ track ].scenario ];
+					MyEvaluatePipeline( scenario.truth[ tracks[ track ].track ], scenario.source[ tracks[ track ].track ], param_sets[ param_set ],
+						results[ param_set * tracks.size() + track ] );
+				} );
+			}
+		}
+
+		pool.Wait();
+	}
+	const double elapsed_s = std::chrono::duration< double >( std::chrono::steady_clock::now() - start_time ).count();
+
+	fprintf( stderr, "ran %zu parameter sets over %zu tracks on %u threads in %.2f s\n", param_sets.size(), tracks.size(), num_workers, elapsed_s );
+
+	// Gather the results per group, with everything together as one last group
+	groups.push_back( "all" );
+	std::vector< std::vector< MyPoseErrorMetrics > > group_results( groups.size(), std::vector< MyPoseErrorMetrics >( param_sets.size(), MyPoseErrorMetrics{} ) );
+
+	for ( size_t param_set = 0; param_set < param_sets.size(); param_set++ )
+	{
+		for ( size_t track = 0; track < tracks.size(); track++ )
+		{
+			const MyPoseErrorMetrics &metrics = results[ param_set * tracks.size() + track ];
+			group_results[ tracks[ track ].group ][ param_set ].Add( metrics );
+			group_results.back()[ param_set ].Add( metrics );
+		}
+	}
+
+	if ( !options.csv_path.empty() )
+	{
+		FILE *csv = fopen( options.csv_path.c_str(), "w" );
+		if ( csv == nullptr )
+		{
+			fprintf( stderr, "couldn't write %s\n", options.csv_path.c_str() );
+		}
+		else
+		{
+			fprintf( csv, "group,age_ms,rmse_mm,rmse_deg,coverage,update_hz,judder_mm" );
+			for ( const MySweepRange &range : options.ranges )
+				fprintf( csv, ",%s", my_sweep_params[ range.param ].name );
+			fprintf( csv, "\n" );
+
+			for ( size_t group = 0; group < groups.size(); group++ )
+			{
+				for ( size_t param_set = 0; param_set < param_sets.size(); param_set++ )
+				{
+					const MyPoseErrorMetrics &metrics = group_results[ group ][ param_set ];
+					fprintf( csv, "%s,%.4f,%.4f,%.4f,%.5f,%.2f,%.4f", groups[ group ].c_str(), metrics.GetMeanPoseAge() * 1000.0,
+						metrics.GetPositionRmse() * 1000.0, RAD_TO_DEG( metrics.GetRotationRmse() ), metrics.GetCoverage(), metrics.GetUpdateRate(),
+						metrics.GetJudder() * 1000.0 );
+					MyPrintSweptParams( csv, options, param_sets[ param_set ], ",%g" );
+					fprintf( csv, "\n" );
+				}
+			}
+
+			fclose( csv );
+		}
+	}
+
+	for ( size_t group = 0; group < groups.size(); group++ )
+	{
+		printf( "%s\n", groups[ group ].c_str() );
+		printf( "  %8s %9s %9s %8s %8s", "age_ms", "rmse_mm", "rmse_deg", "coverage", "upd_hz" );
+		for ( const MySweepRange &range : options.ranges )
+			printf( " %16s", my_sweep_params[ range.param ].name );
+		printf( "\n" );
+
+		for ( size_t param_set : MyFindParetoFront( group_results[ group ], options.min_coverage ) )
+		{
+			const MyPoseErrorMetrics &metrics = group_results[ group ][ param_set ];
+			printf( "  %8.2f %9.2f %9.3f %8.4f %8.1f", metrics.GetMeanPoseAge() * 1000.0, metrics.GetPositionRmse() * 1000.0,
+				RAD_TO_DEG( metrics.GetRotationRmse() ), metrics.GetCoverage(), metrics.GetUpdateRate() );
+			MyPrintSweptParams( stdout, options, param_sets[ param_set ], " %16g" );
+			printf( "\n" );
+		}
+	}
+
+	return 0;
+}